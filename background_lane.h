@@ -0,0 +1,157 @@
+//
+//  background_lane.h
+//  A lane for opportunistic work (cache warming, compaction, ...) that must
+//  never slow the foreground.  Its threads run at SCHED_IDLE - or nice 19
+//  where that isn't allowed - so the kernel only gives them CPU nothing else
+//  wants, and they only claim a task when every foreground scheduler the
+//  lane watches has no unclaimed work.
+//  A long task calls wait_for_idle_foreground() at its checkpoints:  if
+//  foreground work has turned up it waits there until the foreground is idle
+//  again, so the foreground never competes with a task that started before
+//  it arrived.
+//
+//  Like event_loop.h, each lane thread is one long running work item of a
+//  scheduler.  Linux only (SCHED_IDLE, per thread nice).
+//
+
+#ifndef background_lane_h
+#define background_lane_h
+
+#include "scheduler.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// how often a waiting background thread looks at the foreground again
+#define BACKGROUND_POLL_US  500
+
+// lowers the calling thread to SCHED_IDLE, or failing that nice 19.  true if SCHED_IDLE took.
+inline bool make_thread_idle_priority() {
+    sched_param param;
+    memset(&param, 0, sizeof(param));
+    if (pthread_setschedparam(pthread_self(), SCHED_IDLE, &param) == 0) return true;
+    setpriority(PRIO_PROCESS, (id_t)syscall(SYS_gettid), 19);   // on Linux this is per thread
+    return false;
+}
+
+struct background_lane : worker {
+    background_lane(int threadCount=1) : _threadCount(scheduler::resolve_thread_count(threadCount)), _done(false), _idleGranted(true) {}
+    ~background_lane() {join();}
+
+    // starts the lane's threads, which wait for submit()
+    void run() {
+        _done = false;
+        _pool.reset(new scheduler(this, _threadCount, _threadCount));     // a work item per thread, each one a dispatch loop
+        _pool->run();
+    }
+
+    // queues w->do_work(work) to run when the foreground is idle.  any thread may call it.
+    void submit(worker *w, int work) {
+        {
+            std::lock_guard<std::mutex> lk(_mutex);
+            _tasks.push_back({w, work});
+        }
+        _cv.notify_one();
+    }
+
+    // waits for everything submitted to finish (when the foreground allows), then stops the threads
+    void join() {
+        if (!_pool) return;
+        {
+            std::lock_guard<std::mutex> lk(_mutex);
+            _done = true;
+        }
+        _cv.notify_all();
+        _pool->join();
+        _pool.reset();
+    }
+
+    // defer to s:  no task starts, and wait_for_idle_foreground() waits, while s has work not yet handed out.
+    // unwatch it before it is destroyed.
+    void watch(scheduler *s) {
+        std::lock_guard<std::mutex> lk(_watchMutex);
+        _watched.push_back(s);
+    }
+
+    void unwatch(scheduler *s) {
+        std::lock_guard<std::mutex> lk(_watchMutex);
+        _watched.erase(std::remove(_watched.begin(), _watched.end(), s), _watched.end());
+    }
+
+    // whether any watched scheduler has unclaimed work
+    bool foreground_busy() {
+        std::lock_guard<std::mutex> lk(_watchMutex);
+        for (scheduler *s : _watched) {
+            if (s->pending_work() > 0) return true;
+        }
+        return false;
+    }
+
+    // for background tasks to call at their checkpoints:  returns at once if the foreground is idle,
+    // otherwise waits until it is.  returns whether it waited.
+    bool wait_for_idle_foreground() {
+        if (!foreground_busy()) return false;
+        while (foreground_busy()) std::this_thread::sleep_for(std::chrono::microseconds(BACKGROUND_POLL_US));
+        return true;
+    }
+
+    // tasks waiting to start
+    size_t pending() {
+        std::lock_guard<std::mutex> lk(_mutex);
+        return _tasks.size();
+    }
+
+    // whether every lane thread got SCHED_IDLE, rather than nice 19.  valid once a task has run.
+    bool idle_priority_granted() const {return _idleGranted;}
+
+    // the lane's work item:  lower this thread's priority, then run tasks when the foreground is idle
+    void do_work(int thread) {
+        if (!make_thread_idle_priority()) _idleGranted = false;
+        for (;;) {
+            {
+                std::unique_lock<std::mutex> lk(_mutex);
+                _cv.wait(lk, [this] {return _done || !_tasks.empty();});
+                if (_tasks.empty()) return;
+            }
+            wait_for_idle_foreground();
+            background_task task;
+            {
+                std::lock_guard<std::mutex> lk(_mutex);
+                if (_tasks.empty()) continue;   // another lane thread took it while this one waited
+                task = _tasks.front();
+                _tasks.pop_front();
+            }
+            task.w->do_work(task.work);
+        }
+    }
+
+private:
+    struct background_task {
+        worker *w;
+        int work;
+    };
+
+    int _threadCount;
+    std::deque<background_task> _tasks;
+    bool _done;
+    std::mutex _mutex;              // guards _tasks and _done
+    std::condition_variable _cv;
+    std::vector<scheduler *> _watched;
+    std::mutex _watchMutex;
+    std::atomic<bool> _idleGranted;
+    std::unique_ptr<scheduler> _pool;
+};
+
+#endif /* background_lane_h */
@@ -0,0 +1,344 @@
+//
+//  block_compress.h
+//  Block parallel compression on the scheduler, with its own codec so there
+//  is nothing extra to link.  The input is cut into fixed size blocks that
+//  are compressed independently, one block per work item, and written into
+//  a frame:
+//
+//      header      magic "EKLZ", block size, raw size, block count
+//      index       per block:  offset in the frame, stored size, flags
+//      blocks      each one an LZ stream, or the raw bytes if that was smaller
+//
+//  The index makes decompression parallel too (a block per work item), and
+//  lets a range of the raw data be read back without touching other blocks.
+//
+//  The codec is a byte oriented LZ77, in the spirit of LZ4:  a greedy parser
+//  over a hash table of 4 byte sequences, 64 KB window, sequences of
+//      token (literal length:4, match length - 4:4), [more literal length],
+//      literals, offset (2 bytes), [more match length]
+//  where a 15 in the token means more length follows in bytes of 255 until
+//  one is smaller.  The last sequence is literals only.  The decoder checks
+//  every length and offset against both buffers, so a corrupt frame is
+//  reported rather than read or written out of bounds.
+//
+//  Multi byte fields are little endian regardless of the host.
+//
+
+#ifndef block_compress_h
+#define block_compress_h
+
+#include "scheduler.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// raw bytes per block by default.  Big enough that the codec's state is
+// noise, small enough that a block and its output stay in L2.
+#define BLOCK_COMPRESS_DEFAULT  (1 << 20)
+
+// hash table entries are 1 << LZ_HASH_BITS
+#define LZ_HASH_BITS    14
+
+#define LZ_MIN_MATCH    4
+#define LZ_MAX_OFFSET   65535
+
+// bytes at the end of a block that are always literals, so the match finder can read 4 bytes anywhere before them
+#define LZ_TAIL_LITERALS    12
+
+#define BLOCK_FRAME_MAGIC   0x5a4c4b45u     // "EKLZ"
+#define BLOCK_HEADER_BYTES  24
+#define BLOCK_INDEX_BYTES   16
+#define BLOCK_STORED_RAW    1               // index flag:  the block is its raw bytes
+
+//-------------------------------------------------------------------------
+// little endian fields
+
+inline void lz_store16(unsigned char *p, uint32_t v) {p[0] = (unsigned char)v; p[1] = (unsigned char)(v >> 8);}
+inline void lz_store32(unsigned char *p, uint32_t v) {lz_store16(p, v); lz_store16(p + 2, v >> 16);}
+inline void lz_store64(unsigned char *p, uint64_t v) {lz_store32(p, (uint32_t)v); lz_store32(p + 4, (uint32_t)(v >> 32));}
+inline uint32_t lz_load16(const unsigned char *p) {return p[0] | ((uint32_t)p[1] << 8);}
+inline uint32_t lz_load32(const unsigned char *p) {return lz_load16(p) | (lz_load16(p + 2) << 16);}
+inline uint64_t lz_load64(const unsigned char *p) {return lz_load32(p) | ((uint64_t)lz_load32(p + 4) << 32);}
+
+// 4 bytes in host order, only ever compared with each other and hashed
+inline uint32_t lz_read32(const unsigned char *p) {
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return v;
+}
+
+inline uint32_t lz_hash(uint32_t sequence) {
+    return (sequence * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+//-------------------------------------------------------------------------
+// the codec
+
+// the most lz_compress can write for size bytes of input
+inline size_t lz_bound(size_t size) {
+    return size + size / 255 + 16;
+}
+
+// writes a length past the 15 that fits in the token
+inline unsigned char *lz_write_length(unsigned char *op, size_t length) {
+    for (; length >= 255; length -= 255) *op++ = 255;
+    *op++ = (unsigned char)length;
+    return op;
+}
+
+// compresses size bytes of src into dst, which has room for capacity bytes.
+// returns the compressed size, or 0 if it wouldn't fit.
+inline size_t lz_compress(const char *source, size_t size, char *destination, size_t capacity) {
+    const unsigned char *src = (const unsigned char *)source;
+    unsigned char *dst = (unsigned char *)destination;
+    unsigned char *op = dst;
+    unsigned char *const opEnd = dst + capacity;
+    std::vector<uint32_t> table(1 << LZ_HASH_BITS, 0);
+
+    size_t ip = 0, anchor = 0;
+    size_t limit = size > LZ_TAIL_LITERALS ? size - LZ_TAIL_LITERALS : 0;
+    while (ip < limit) {
+        uint32_t sequence = lz_read32(src + ip);
+        uint32_t h = lz_hash(sequence);
+        size_t candidate = table[h];
+        table[h] = (uint32_t)ip;
+        if (candidate >= ip || ip - candidate > LZ_MAX_OFFSET || lz_read32(src + candidate) != sequence) {
+            ip += 1 + ((ip - anchor) >> 6);     // the longer since the last match, the bigger the steps
+            continue;
+        }
+
+        // extend the match back over literals, and forward up to the tail
+        while (ip > anchor && candidate > 0 && src[ip-1] == src[candidate-1]) {
+            --ip;
+            --candidate;
+        }
+        size_t length = LZ_MIN_MATCH;
+        size_t matchLimit = size - LZ_TAIL_LITERALS + LZ_MIN_MATCH;
+        while (ip + length + 8 <= matchLimit) {
+            uint64_t a, b;      // 8 bytes at a time while they all match
+            memcpy(&a, src + ip + length, 8);
+            memcpy(&b, src + candidate + length, 8);
+            if (a != b) break;
+            length += 8;
+        }
+        while (ip + length < matchLimit && src[candidate+length] == src[ip+length]) ++length;
+
+        size_t literals = ip - anchor;
+        if ((size_t)(opEnd - op) < literals + literals / 255 + 8 + (length - LZ_MIN_MATCH) / 255) return 0;
+        unsigned char *token = op++;
+        *token = (unsigned char)((std::min(literals, (size_t)15) << 4) | std::min(length - LZ_MIN_MATCH, (size_t)15));
+        if (literals >= 15) op = lz_write_length(op, literals - 15);
+        memcpy(op, src + anchor, literals);
+        op += literals;
+        lz_store16(op, (uint32_t)(ip - candidate));
+        op += 2;
+        if (length - LZ_MIN_MATCH >= 15) op = lz_write_length(op, length - LZ_MIN_MATCH - 15);
+
+        ip += length;
+        anchor = ip;
+        if (ip - 2 < limit) table[lz_hash(lz_read32(src + ip - 2))] = (uint32_t)(ip - 2);
+    }
+
+    // the last sequence, literals only
+    size_t literals = size - anchor;
+    if ((size_t)(opEnd - op) < literals + literals / 255 + 2) return 0;
+    *op++ = (unsigned char)(std::min(literals, (size_t)15) << 4);
+    if (literals >= 15) op = lz_write_length(op, literals - 15);
+    memcpy(op, src + anchor, literals);
+    op += literals;
+    return op - dst;
+}
+
+// reads a length past the 15 in the token.  false if the input runs out.
+inline bool lz_read_length(const unsigned char *&ip, const unsigned char *ipEnd, size_t &length) {
+    unsigned char b;
+    do {
+        if (ip >= ipEnd) return false;
+        b = *ip++;
+        length += b;
+    } while (b == 255);
+    return true;
+}
+
+// decompresses size bytes of src into dst, which has room for capacity bytes.
+// returns the decompressed size, or -1 if src is not a valid stream or doesn't fit.
+inline long long lz_decompress(const char *source, size_t size, char *destination, size_t capacity) {
+    const unsigned char *ip = (const unsigned char *)source;
+    const unsigned char *const ipEnd = ip + size;
+    unsigned char *const dst = (unsigned char *)destination;
+    size_t op = 0;
+    while (ip < ipEnd) {
+        unsigned token = *ip++;
+        size_t literals = token >> 4;
+        if (literals == 15 && !lz_read_length(ip, ipEnd, literals)) return -1;
+        if (literals > (size_t)(ipEnd - ip) || literals > capacity - op) return -1;
+        memcpy(dst + op, ip, literals);
+        ip += literals;
+        op += literals;
+        if (ip == ipEnd) break;     // the last sequence has no match
+
+        if (ipEnd - ip < 2) return -1;
+        size_t offset = lz_load16(ip);
+        ip += 2;
+        size_t length = token & 15;
+        if (length == 15 && !lz_read_length(ip, ipEnd, length)) return -1;
+        length += LZ_MIN_MATCH;
+        if (offset == 0 || offset > op || length > capacity - op) return -1;
+
+        unsigned char *out = dst + op;
+        const unsigned char *match = out - offset;
+        if (offset >= length) {
+            memcpy(out, match, length);
+        } else {
+            for (size_t i = 0; i < length; ++i) out[i] = match[i];     // overlapping, a run
+        }
+        op += length;
+    }
+    return (long long)op;
+}
+
+//-------------------------------------------------------------------------
+// frames
+
+// compresses size bytes of data into a frame, a block per work item
+inline std::vector<char> parallel_compress(const char *data, size_t size, size_t blockSize=BLOCK_COMPRESS_DEFAULT, int threadCount=0) {
+    blockSize = std::max(blockSize, (size_t)1);
+    int blockCount = (int)((size + blockSize - 1) / blockSize);
+    std::vector<std::vector<char>> blocks(blockCount);
+    std::vector<unsigned char> raw(blockCount, 0);
+
+    parallel_for(blockCount, [&](int b) {
+        size_t start = b * blockSize;
+        size_t count = std::min(blockSize, size - start);
+        std::vector<char> &out = blocks[b];
+        out.resize(lz_bound(count));
+        size_t packed = lz_compress(data + start, count, out.data(), count);    // no bigger than storing it raw
+        if (packed == 0) {
+            raw[b] = 1;
+            out.clear();
+        } else {
+            out.resize(packed);
+        }
+    }, threadCount);
+
+    // block offsets are a prefix sum of the stored sizes
+    size_t offset = BLOCK_HEADER_BYTES + (size_t)blockCount * BLOCK_INDEX_BYTES;
+    std::vector<size_t> offsets(blockCount);
+    for (int b = 0; b < blockCount; ++b) {
+        offsets[b] = offset;
+        offset += raw[b] ? std::min(blockSize, size - b * blockSize) : blocks[b].size();
+    }
+
+    std::vector<char> frame(offset);
+    unsigned char *header = (unsigned char *)frame.data();
+    lz_store32(header, BLOCK_FRAME_MAGIC);
+    lz_store32(header + 4, (uint32_t)blockSize);
+    lz_store64(header + 8, size);
+    lz_store32(header + 16, (uint32_t)blockCount);
+    lz_store32(header + 20, 0);
+    parallel_for(blockCount, [&](int b) {
+        size_t start = b * blockSize;
+        size_t stored = raw[b] ? std::min(blockSize, size - start) : blocks[b].size();
+        unsigned char *entry = header + BLOCK_HEADER_BYTES + (size_t)b * BLOCK_INDEX_BYTES;
+        lz_store64(entry, offsets[b]);
+        lz_store32(entry + 8, (uint32_t)stored);
+        lz_store32(entry + 12, raw[b] ? BLOCK_STORED_RAW : 0);
+        memcpy(frame.data() + offsets[b], raw[b] ? data + start : blocks[b].data(), stored);
+        std::vector<char>().swap(blocks[b]);
+    }, threadCount);
+    return frame;
+}
+
+// a frame in memory, for reading back all or part of it
+struct compressed_frame {
+    compressed_frame() : _frame(nullptr), _size(0), _blockSize(0), _rawSize(0), _blockCount(0) {}
+
+    // checks the header and index.  false if this isn't a valid frame.
+    bool open(const char *frame, size_t size) {
+        const unsigned char *p = (const unsigned char *)frame;
+        _blockCount = 0;
+        if (size < BLOCK_HEADER_BYTES || lz_load32(p) != BLOCK_FRAME_MAGIC) return false;
+        size_t blockSize = lz_load32(p + 4);
+        uint64_t rawSize = lz_load64(p + 8);
+        uint64_t blockCount = lz_load32(p + 16);
+        if (blockSize == 0 || blockCount != (rawSize + blockSize - 1) / blockSize) return false;
+        if ((size - BLOCK_HEADER_BYTES) / BLOCK_INDEX_BYTES < blockCount) return false;
+        for (uint64_t b = 0; b < blockCount; ++b) {
+            const unsigned char *entry = p + BLOCK_HEADER_BYTES + b * BLOCK_INDEX_BYTES;
+            uint64_t offset = lz_load64(entry), stored = lz_load32(entry + 8);
+            if (offset > size || stored > size - offset) return false;
+        }
+        _frame = p;
+        _size = size;
+        _blockSize = blockSize;
+        _rawSize = rawSize;
+        _blockCount = (int)blockCount;
+        return true;
+    }
+
+    uint64_t raw_size() const {return _rawSize;}
+    size_t block_size() const {return _blockSize;}
+    int block_count() const {return _blockCount;}
+
+    // raw bytes in block b
+    size_t block_raw_size(int b) const {
+        return (size_t)std::min((uint64_t)_blockSize, _rawSize - (uint64_t)b * _blockSize);
+    }
+
+    // decompresses block b into out, which has room for block_raw_size(b).  false if the block is corrupt.
+    bool decompress_block(int b, char *out) const {
+        const unsigned char *entry = _frame + BLOCK_HEADER_BYTES + (size_t)b * BLOCK_INDEX_BYTES;
+        const char *stored = (const char *)_frame + lz_load64(entry);
+        size_t storedSize = lz_load32(entry + 8);
+        size_t rawSize = block_raw_size(b);
+        if (lz_load32(entry + 12) & BLOCK_STORED_RAW) {
+            if (storedSize != rawSize) return false;
+            memcpy(out, stored, rawSize);
+            return true;
+        }
+        return lz_decompress(stored, storedSize, out, rawSize) == (long long)rawSize;
+    }
+
+    // decompresses raw bytes [offset, offset + count) into out, touching only the blocks they are in
+    bool read(uint64_t offset, size_t count, char *out, int threadCount=0) const {
+        if (offset > _rawSize || count > _rawSize - offset) return false;
+        if (count == 0) return true;
+        int first = (int)(offset / _blockSize);
+        int last = (int)((offset + count - 1) / _blockSize);
+        std::vector<unsigned char> ok(last - first + 1, 0);
+        parallel_for(last - first + 1, [&](int i) {
+            int b = first + i;
+            uint64_t start = (uint64_t)b * _blockSize;
+            size_t rawSize = block_raw_size(b);
+            if (start >= offset && start + rawSize <= offset + count) {
+                ok[i] = decompress_block(b, out + (start - offset));    // whole block, straight into place
+                return;
+            }
+            std::vector<char> block(rawSize);
+            if (!decompress_block(b, block.data())) return;
+            uint64_t from = std::max(start, offset), to = std::min(start + rawSize, offset + count);
+            memcpy(out + (from - offset), block.data() + (from - start), to - from);
+            ok[i] = 1;
+        }, threadCount);
+        return std::find(ok.begin(), ok.end(), 0) == ok.end();
+    }
+
+private:
+    const unsigned char *_frame;
+    size_t _size;
+    size_t _blockSize;
+    uint64_t _rawSize;
+    int _blockCount;
+};
+
+// decompresses a whole frame, a block per work item.  false if it isn't a valid frame.
+inline bool parallel_decompress(const char *frame, size_t size, std::vector<char> &out, int threadCount=0) {
+    compressed_frame f;
+    if (!f.open(frame, size)) return false;
+    out.resize(f.raw_size());
+    return f.read(0, f.raw_size(), out.data(), threadCount);
+}
+
+#endif /* block_compress_h */
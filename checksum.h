@@ -0,0 +1,229 @@
+//
+//  checksum.h
+//  Parallel CRC32C and 64 bit hashing of big buffers on the scheduler:  each
+//  work item checksums one block, then the block results are combined.
+//
+//  CRC32C blocks are combined exactly, with the GF(2) algebra zlib uses for
+//  crc32_combine:  crc(A B) = crc(A) * x^(8 |B|) + crc(B) mod P, so
+//  parallel_crc32c gives the same value as crc32c over the whole buffer.
+//  crc32c uses the SSE4.2 crc32 instruction when compiled for it (-msse4.2
+//  or -march=native), otherwise slicing-by-8 tables.
+//
+//  xxhash64 is XXH64.  A hash like that can't be combined, so
+//  parallel_hash64 is a two level tree instead:  XXH64 of every fixed size
+//  block, then XXH64 of those block hashes.  Fixed blocks mean the value
+//  doesn't depend on the thread count, and an input of one block or less
+//  hashes to plain xxhash64.
+//
+
+#ifndef checksum_h
+#define checksum_h
+
+#include "scheduler.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#if defined(__SSE4_2__)
+#include <nmmintrin.h>
+#endif
+
+// bytes per work item.  It is part of parallel_hash64's definition, so changing it changes those hashes.
+#define CHECKSUM_BLOCK  (1 << 20)
+
+// CRC32C (Castagnoli), reflected
+#define CRC32C_POLY     0x82f63b78u
+
+//-------------------------------------------------------------------------
+// CRC32C
+
+// slicing-by-8 tables, built on first use
+inline const uint32_t (&crc32c_table())[8][256] {
+    struct tables {
+        uint32_t t[8][256];
+        tables() {
+            for (uint32_t i = 0; i < 256; ++i) {
+                uint32_t c = i;
+                for (int k = 0; k < 8; ++k) c = (c & 1) ? (c >> 1) ^ CRC32C_POLY : c >> 1;
+                t[0][i] = c;
+            }
+            for (uint32_t i = 0; i < 256; ++i) {
+                for (int s = 1; s < 8; ++s) t[s][i] = (t[s-1][i] >> 8) ^ t[0][t[s-1][i] & 0xff];
+            }
+        }
+    };
+    static const tables t;
+    return t.t;
+}
+
+// 8 bytes in little endian order, whatever the host
+inline uint64_t checksum_load64(const unsigned char *p) {
+    uint64_t v;
+    memcpy(&v, p, 8);
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    v = __builtin_bswap64(v);
+#endif
+    return v;
+}
+
+inline uint32_t checksum_load32(const unsigned char *p) {
+    uint32_t v;
+    memcpy(&v, p, 4);
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    v = __builtin_bswap32(v);
+#endif
+    return v;
+}
+
+// continues crc (0 to start) over size bytes of data, the same calling convention as zlib's crc32
+inline uint32_t crc32c(uint32_t crc, const void *data, size_t size) {
+    const unsigned char *p = (const unsigned char *)data;
+    uint32_t c = ~crc;
+#if defined(__SSE4_2__)
+    uint64_t c64 = c;
+    for (; size >= 8; size -= 8, p += 8) c64 = _mm_crc32_u64(c64, checksum_load64(p));
+    c = (uint32_t)c64;
+    for (; size > 0; --size) c = _mm_crc32_u8(c, *p++);
+#else
+    const uint32_t (&t)[8][256] = crc32c_table();
+    for (; size >= 8; size -= 8, p += 8) {
+        uint64_t v = checksum_load64(p) ^ c;
+        c = t[7][v & 0xff] ^ t[6][(v >> 8) & 0xff] ^ t[5][(v >> 16) & 0xff] ^ t[4][(v >> 24) & 0xff]
+          ^ t[3][(v >> 32) & 0xff] ^ t[2][(v >> 40) & 0xff] ^ t[1][(v >> 48) & 0xff] ^ t[0][v >> 56];
+    }
+    for (; size > 0; --size) c = (c >> 8) ^ t[0][(c ^ *p++) & 0xff];
+#endif
+    return ~c;
+}
+
+// a * b mod P, polynomials over GF(2) in the reflected bit order
+inline uint32_t crc32c_multmodp(uint32_t a, uint32_t b) {
+    uint32_t m = 1u << 31, p = 0;
+    for (;;) {
+        if (a & m) {
+            p ^= b;
+            if ((a & (m - 1)) == 0) break;
+        }
+        m >>= 1;
+        b = (b & 1) ? (b >> 1) ^ CRC32C_POLY : b >> 1;
+    }
+    return p;
+}
+
+// x^(8 size) mod P:  the operator that moves a crc past size zero bytes
+inline uint32_t crc32c_shift(uint64_t size) {
+    struct powers {
+        uint32_t x2n[64];   // x^(2^k) mod P
+        powers() {
+            x2n[0] = 1u << 30;  // x^1
+            for (int k = 1; k < 64; ++k) x2n[k] = crc32c_multmodp(x2n[k-1], x2n[k-1]);
+        }
+    };
+    static const powers pw;
+    uint32_t p = 1u << 31;      // x^0
+    for (int k = 3; size; size >>= 1, ++k) {
+        if (size & 1) p = crc32c_multmodp(pw.x2n[k & 63], p);
+    }
+    return p;
+}
+
+// the crc of A followed by B, from crc(A), crc(B) and B's length
+inline uint32_t crc32c_combine(uint32_t crcA, uint32_t crcB, uint64_t sizeB) {
+    return crc32c_multmodp(crc32c_shift(sizeB), crcA) ^ crcB;
+}
+
+// crc32c of size bytes, a block per work item.  the same value as crc32c(0, data, size).
+inline uint32_t parallel_crc32c(const void *data, size_t size, int threadCount=0) {
+    const char *p = (const char *)data;
+    int blockCount = (int)((size + CHECKSUM_BLOCK - 1) / CHECKSUM_BLOCK);
+    if (blockCount <= 1) return crc32c(0, p, size);
+    std::vector<uint32_t> crcs(blockCount);
+    parallel_for(blockCount, [&](int b) {
+        size_t start = (size_t)b * CHECKSUM_BLOCK;
+        crcs[b] = crc32c(0, p + start, std::min((size_t)CHECKSUM_BLOCK, size - start));
+    }, threadCount);
+
+    // every block but the last is full size, so they share one shift operator
+    uint32_t shift = crc32c_shift(CHECKSUM_BLOCK);
+    uint32_t crc = crcs[0];
+    for (int b = 1; b < blockCount - 1; ++b) crc = crc32c_multmodp(shift, crc) ^ crcs[b];
+    return crc32c_combine(crc, crcs[blockCount-1], size - (size_t)(blockCount - 1) * CHECKSUM_BLOCK);
+}
+
+//-------------------------------------------------------------------------
+// XXH64
+
+#define XXH_PRIME64_1   11400714785074694791ull
+#define XXH_PRIME64_2   14029467366897019727ull
+#define XXH_PRIME64_3   1609587929392839161ull
+#define XXH_PRIME64_4   9650029242287828579ull
+#define XXH_PRIME64_5   2870177450012600261ull
+
+inline uint64_t xxh_rotl(uint64_t v, int r) {return (v << r) | (v >> (64 - r));}
+
+inline uint64_t xxh_round(uint64_t acc, uint64_t input) {
+    return xxh_rotl(acc + input * XXH_PRIME64_2, 31) * XXH_PRIME64_1;
+}
+
+inline uint64_t xxh_merge(uint64_t acc, uint64_t v) {
+    return (acc ^ xxh_round(0, v)) * XXH_PRIME64_1 + XXH_PRIME64_4;
+}
+
+// XXH64 of size bytes of data
+inline uint64_t xxhash64(const void *data, size_t size, uint64_t seed=0) {
+    const unsigned char *p = (const unsigned char *)data;
+    const unsigned char *const end = p + size;
+    uint64_t h;
+    if (size >= 32) {
+        // four independent lanes over 32 byte stripes
+        uint64_t v1 = seed + XXH_PRIME64_1 + XXH_PRIME64_2, v2 = seed + XXH_PRIME64_2, v3 = seed, v4 = seed - XXH_PRIME64_1;
+        for (; end - p >= 32; p += 32) {
+            v1 = xxh_round(v1, checksum_load64(p));
+            v2 = xxh_round(v2, checksum_load64(p + 8));
+            v3 = xxh_round(v3, checksum_load64(p + 16));
+            v4 = xxh_round(v4, checksum_load64(p + 24));
+        }
+        h = xxh_rotl(v1, 1) + xxh_rotl(v2, 7) + xxh_rotl(v3, 12) + xxh_rotl(v4, 18);
+        h = xxh_merge(h, v1);
+        h = xxh_merge(h, v2);
+        h = xxh_merge(h, v3);
+        h = xxh_merge(h, v4);
+    } else {
+        h = seed + XXH_PRIME64_5;
+    }
+    h += size;
+
+    for (; end - p >= 8; p += 8) h = xxh_rotl(h ^ xxh_round(0, checksum_load64(p)), 27) * XXH_PRIME64_1 + XXH_PRIME64_4;
+    if (end - p >= 4) {
+        h = xxh_rotl(h ^ (checksum_load32(p) * XXH_PRIME64_1), 23) * XXH_PRIME64_2 + XXH_PRIME64_3;
+        p += 4;
+    }
+    for (; p < end; ++p) h = xxh_rotl(h ^ (*p * XXH_PRIME64_5), 11) * XXH_PRIME64_1;
+
+    h ^= h >> 33;
+    h *= XXH_PRIME64_2;
+    h ^= h >> 29;
+    h *= XXH_PRIME64_3;
+    h ^= h >> 32;
+    return h;
+}
+
+// a 64 bit hash of size bytes, a block per work item:  xxhash64 of each
+// CHECKSUM_BLOCK, then xxhash64 of those hashes (little endian) seeded with
+// seed + size.  one block or less is just xxhash64(data, size, seed).
+inline uint64_t parallel_hash64(const void *data, size_t size, uint64_t seed=0, int threadCount=0) {
+    const char *p = (const char *)data;
+    int blockCount = (int)((size + CHECKSUM_BLOCK - 1) / CHECKSUM_BLOCK);
+    if (blockCount <= 1) return xxhash64(p, size, seed);
+    std::vector<unsigned char> hashes((size_t)blockCount * 8);
+    parallel_for(blockCount, [&](int b) {
+        size_t start = (size_t)b * CHECKSUM_BLOCK;
+        uint64_t h = xxhash64(p + start, std::min((size_t)CHECKSUM_BLOCK, size - start), seed);
+        for (int i = 0; i < 8; ++i) hashes[(size_t)b * 8 + i] = (unsigned char)(h >> (8 * i));
+    }, threadCount);
+    return xxhash64(hashes.data(), hashes.size(), seed + size);
+}
+
+#endif /* checksum_h */
@@ -0,0 +1,393 @@
+//
+//  csv_parser.h
+//  Parallel CSV and JSON-lines parsing on the scheduler, into columns of
+//  std::string_view that point back into the input (no field is copied).
+//
+//  CSV can have quoted fields holding delimiters and newlines, so a chunk of
+//  the input can't know on its own where its first record starts.  So:
+//  1. each fixed size chunk counts its quote characters (SIMD compares)
+//  2. an exclusive scan of those counts tells every chunk whether it starts
+//     inside quotes (RFC 4180 escapes "" leave the parity alone)
+//  3. each chunk finds its first newline outside quotes; records starting
+//     from there up to the next chunk's first record belong to this chunk
+//  4. each chunk walks the delimiters, quotes and newlines of its records,
+//     found 64 bytes at a time with AVX2 or SSE2 (or a scalar loop), and
+//     writes its fields to its own column buffers
+//  5. the chunks' columns are concatenated.
+//
+//  JSON-lines can't have a raw newline inside a string, so records are
+//  simply newline delimited chunks (file_chunker::chunk_bounds), and each
+//  line is scanned for the top level keys asked for.
+//
+//  Needs C++17 for std::string_view.  Build with -mavx2 (or -march=native)
+//  to get the AVX2 path; x86-64 always has SSE2.
+//
+
+#ifndef csv_parser_h
+#define csv_parser_h
+
+#include "scheduler.h"
+#include "parallel_scan.h"
+#include "file_chunker.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+// bytes per work item for the CSV passes
+#define CSV_CHUNK   (1 << 20)
+
+// column oriented parse results.  Every column has rows entries; fields a row
+// didn't have are empty.  The views point into the parsed text, which must outlive the table.
+struct parsed_table {
+    std::vector<std::string> names;                         // the header (CSV) or the keys asked for (JSON-lines)
+    std::vector<std::vector<std::string_view>> columns;
+    size_t rows = 0;
+};
+
+//-------------------------------------------------------------------------
+// SIMD structural character search
+
+// bit i of each mask is set when p[i] is that character, for i in 0..63.
+// p must have 64 readable bytes.
+inline void csv_scan_block(const char *p, char delimiter, uint64_t &quotes, uint64_t &delimiters, uint64_t &newlines) {
+#if defined(__AVX2__)
+    const __m256i q = _mm256_set1_epi8('"'), d = _mm256_set1_epi8(delimiter), n = _mm256_set1_epi8('\n');
+    const __m256i lo = _mm256_loadu_si256((const __m256i *)p);
+    const __m256i hi = _mm256_loadu_si256((const __m256i *)(p + 32));
+    quotes = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(lo, q)) | ((uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(hi, q)) << 32);
+    delimiters = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(lo, d)) | ((uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(hi, d)) << 32);
+    newlines = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(lo, n)) | ((uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(hi, n)) << 32);
+#elif defined(__SSE2__)
+    const __m128i q = _mm_set1_epi8('"'), d = _mm_set1_epi8(delimiter), n = _mm_set1_epi8('\n');
+    quotes = delimiters = newlines = 0;
+    for (int i = 0; i < 4; ++i) {
+        const __m128i v = _mm_loadu_si128((const __m128i *)(p + 16*i));
+        quotes |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, q)) << (16*i);
+        delimiters |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, d)) << (16*i);
+        newlines |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, n)) << (16*i);
+    }
+#else
+    quotes = delimiters = newlines = 0;
+    for (int i = 0; i < 64; ++i) {
+        quotes |= (uint64_t)(p[i] == '"') << i;
+        delimiters |= (uint64_t)(p[i] == delimiter) << i;
+        newlines |= (uint64_t)(p[i] == '\n') << i;
+    }
+#endif
+}
+
+// csv_scan_block for data[pos .. end), which may be less than 64 bytes.  Bits past end are clear.
+inline void csv_scan(const char *data, size_t pos, size_t end, char delimiter, uint64_t &quotes, uint64_t &delimiters, uint64_t &newlines) {
+    if (end - pos >= 64) {
+        csv_scan_block(data + pos, delimiter, quotes, delimiters, newlines);
+        return;
+    }
+    char padded[64] = {0};
+    std::memcpy(padded, data + pos, end - pos);
+    csv_scan_block(padded, delimiter, quotes, delimiters, newlines);
+    const uint64_t valid = ((uint64_t)1 << (end - pos)) - 1;
+    quotes &= valid;
+    delimiters &= valid;
+    newlines &= valid;
+}
+
+inline int csv_popcount(uint64_t v) {return __builtin_popcountll(v);}
+inline int csv_lowest_bit(uint64_t v) {return __builtin_ctzll(v);}
+
+//-------------------------------------------------------------------------
+// CSV
+
+// a field's text:  outer quotes are removed, "" escapes inside are left as is (see csv_unescape)
+inline std::string_view csv_field(const char *data, size_t start, size_t end) {
+    if (end - start >= 2 && data[start] == '"' && data[end-1] == '"') {
+        ++start;
+        --end;
+    }
+    return std::string_view(data + start, end - start);
+}
+
+// a quoted field's "" escapes turned back into "
+inline std::string csv_unescape(std::string_view field) {
+    std::string out;
+    out.reserve(field.size());
+    for (size_t i = 0; i < field.size(); ++i) {
+        out += field[i];
+        if (field[i] == '"' && i + 1 < field.size() && field[i+1] == '"') ++i;
+    }
+    return out;
+}
+
+// the fields of each record starting in [begin, end) go to columns, one entry per
+// column per record.  begin is the start of a record (outside quotes).  Returns the record count.
+inline size_t csv_parse_records(const char *data, size_t begin, size_t end, size_t size, char delimiter,
+                                std::vector<std::vector<std::string_view>> &columns) {
+    const size_t columnCount = columns.size();
+    size_t rows = 0;
+    size_t field = 0;           // field number within the current record
+    size_t fieldStart = begin;
+    bool inQuotes = false;
+
+    auto end_field = [&](size_t fieldEnd, bool lastInRecord) {
+        if (lastInRecord && fieldEnd > fieldStart && data[fieldEnd-1] == '\r') --fieldEnd;
+        if (field < columnCount) columns[field].push_back(csv_field(data, fieldStart, fieldEnd));
+        ++field;
+    };
+    auto end_record = [&]() {
+        for (; field < columnCount; ++field) columns[field].push_back(std::string_view());
+        field = 0;
+        ++rows;
+    };
+
+    // a record that starts before end is finished even if it runs past end
+    for (size_t pos = begin; pos < size; pos += 64) {
+        if (field == 0 && fieldStart >= end) return rows;
+        uint64_t quotes, delimiters, newlines;
+        csv_scan(data, pos, std::min(pos + 64, size), delimiter, quotes, delimiters, newlines);
+        uint64_t structural = quotes | delimiters | newlines;
+        while (structural) {
+            int bit = csv_lowest_bit(structural);
+            structural &= structural - 1;
+            size_t i = pos + bit;
+            if ((quotes >> bit) & 1) {
+                inQuotes = !inQuotes;
+            } else if (!inQuotes) {
+                bool newline = (newlines >> bit) & 1;
+                end_field(i, newline);
+                fieldStart = i + 1;
+                if (newline) {
+                    end_record();
+                    if (fieldStart >= end) return rows;
+                }
+            }
+        }
+    }
+    // the text doesn't end with a newline:  the last record ends at the end of the text
+    if (fieldStart < size || field > 0) {
+        end_field(size, true);
+        end_record();
+    }
+    return rows;
+}
+
+// concatenates each chunk's columns into table.columns, a chunk per work item
+inline void gather_columns(std::vector<std::vector<std::vector<std::string_view>>> &chunkColumns, parsed_table &table, int threadCount) {
+    const int chunks = (int)chunkColumns.size();
+    std::vector<size_t> offsets(chunks + 1, 0);
+    for (int c = 0; c < chunks; ++c) {
+        offsets[c+1] = offsets[c] + (chunkColumns[c].empty() ? 0 : chunkColumns[c][0].size());
+    }
+    table.rows = offsets[chunks];
+    for (auto &column : table.columns) column.resize(table.rows);
+    parallel_for(chunks, [&](int c) {
+        for (size_t col = 0; col < chunkColumns[c].size(); ++col) {
+            std::copy(chunkColumns[c][col].begin(), chunkColumns[c][col].end(), table.columns[col].begin() + offsets[c]);
+        }
+    }, threadCount);
+}
+
+// parses CSV text into table.  The number of columns is the number of fields in
+// the first record; with hasHeader that record gives table.names and isn't a row.
+// Longer records are truncated, shorter ones padded with empty fields.
+inline void parse_csv(std::string_view text, parsed_table &table, bool hasHeader=true, char delimiter=',', int threadCount=0) {
+    const char *data = text.data();
+    const size_t size = text.size();
+    table = parsed_table();
+    if (size == 0) return;
+
+    // the first record, serially, to learn the column count and where the body starts
+    size_t firstEnd = 0;
+    size_t columnCount = 1;
+    bool inQuotes = false;
+    for (; firstEnd < size; ++firstEnd) {
+        if (data[firstEnd] == '"') {
+            inQuotes = !inQuotes;
+        } else if (!inQuotes && data[firstEnd] == delimiter) {
+            ++columnCount;
+        } else if (!inQuotes && data[firstEnd] == '\n') {
+            ++firstEnd;
+            break;
+        }
+    }
+    table.columns.resize(columnCount);
+    size_t bodyStart = 0;
+    if (hasHeader) {
+        std::vector<std::vector<std::string_view>> header(columnCount);
+        csv_parse_records(data, 0, 1, size, delimiter, header);
+        for (auto &name : header) table.names.push_back(csv_unescape(name[0]));
+        bodyStart = firstEnd;
+    }
+
+    const int chunks = (int)((size - bodyStart + CSV_CHUNK - 1) / CSV_CHUNK);
+    if (chunks == 0) return;
+    auto chunk_begin = [&](int c) {return bodyStart + (size_t)c * CSV_CHUNK;};
+    auto chunk_end = [&](int c) {return std::min(bodyStart + (size_t)(c+1) * CSV_CHUNK, size);};
+
+    // 1. quotes per chunk
+    std::vector<size_t> quoteCounts(chunks);
+    parallel_for(chunks, [&](int c) {
+        size_t count = 0;
+        for (size_t pos = chunk_begin(c); pos < chunk_end(c); pos += 64) {
+            uint64_t quotes, delimiters, newlines;
+            csv_scan(data, pos, std::min(pos + 64, chunk_end(c)), delimiter, quotes, delimiters, newlines);
+            count += csv_popcount(quotes);
+        }
+        quoteCounts[c] = count;
+    }, threadCount);
+
+    // 2. quotes before each chunk, odd means the chunk starts inside a quoted field
+    parallel_exclusive_scan(quoteCounts.data(), quoteCounts.data(), quoteCounts.size(), (size_t)0, std::plus<size_t>(), threadCount);
+
+    // 3. where the first record starting in each chunk begins, size if none does
+    std::vector<size_t> recordStart(chunks + 1, size);
+    recordStart[0] = bodyStart;
+    parallel_for(chunks, [&](int c) {
+        if (c == 0) return;
+        bool inQuotes = quoteCounts[c] & 1;
+        for (size_t pos = chunk_begin(c); pos < chunk_end(c); pos += 64) {
+            uint64_t quotes, delimiters, newlines;
+            csv_scan(data, pos, std::min(pos + 64, chunk_end(c)), delimiter, quotes, delimiters, newlines);
+            uint64_t structural = quotes | newlines;
+            while (structural) {
+                int bit = csv_lowest_bit(structural);
+                structural &= structural - 1;
+                if ((quotes >> bit) & 1) {
+                    inQuotes = !inQuotes;
+                } else if (!inQuotes) {
+                    recordStart[c] = pos + bit + 1;
+                    return;
+                }
+            }
+        }
+    }, threadCount);
+    // a chunk with no record start of its own ends where the next one's records start
+    for (int c = chunks - 1; c > 0; --c) recordStart[c] = std::min(recordStart[c], recordStart[c+1]);
+
+    // 4. each chunk parses the records that start in it
+    std::vector<std::vector<std::vector<std::string_view>>> chunkColumns(chunks, std::vector<std::vector<std::string_view>>(columnCount));
+    parallel_for(chunks, [&](int c) {
+        if (recordStart[c] < recordStart[c+1]) {
+            csv_parse_records(data, recordStart[c], recordStart[c+1], size, delimiter, chunkColumns[c]);
+        }
+    }, threadCount);
+
+    // 5. concatenate
+    gather_columns(chunkColumns, table, threadCount);
+}
+
+//-------------------------------------------------------------------------
+// JSON-lines
+
+// index just past the JSON string starting at data[i] (an opening quote), honoring backslash escapes.
+// std::string::npos if the string isn't closed before end.
+inline size_t jsonl_string_end(const char *data, size_t i, size_t end) {
+    for (++i; i < end; ++i) {
+        if (data[i] == '\\') ++i;
+        else if (data[i] == '"') return i + 1;
+    }
+    return std::string::npos;
+}
+
+// jsonl_string_end, but end for an unclosed string
+inline size_t jsonl_skip_string(const char *data, size_t i, size_t end) {
+    size_t stop = jsonl_string_end(data, i, end);
+    return stop == std::string::npos ? end : stop;
+}
+
+inline size_t jsonl_skip_space(const char *data, size_t i, size_t end) {
+    while (i < end && (data[i] == ' ' || data[i] == '\t' || data[i] == '\r')) ++i;
+    return i;
+}
+
+// index just past the JSON value starting at data[i]:  a string, a nested object
+// or array (skipped whole), or a scalar running to the next , } or ]
+inline size_t jsonl_skip_value(const char *data, size_t i, size_t end) {
+    if (i < end && data[i] == '"') return jsonl_skip_string(data, i, end);
+    const size_t start = i;
+    int depth = 0;
+    for (; i < end; ++i) {
+        char c = data[i];
+        if (c == '"') {
+            i = jsonl_skip_string(data, i, end) - 1;
+        } else if (c == '{' || c == '[') {
+            ++depth;
+        } else if (c == '}' || c == ']') {
+            if (depth == 0) break;
+            if (--depth == 0) return i + 1;
+        } else if (c == ',' && depth == 0) {
+            break;
+        }
+    }
+    // trim trailing whitespace off a scalar
+    while (i > start && (data[i-1] == ' ' || data[i-1] == '\t' || data[i-1] == '\r')) --i;
+    return i;
+}
+
+// the top level values of one line's object, for the keys in names.  Strings
+// lose their quotes (escapes are left as is), anything else is its raw text.
+// A line that isn't an object, or stops making sense, leaves the rest of its fields empty.
+inline void jsonl_parse_line(const char *data, size_t begin, size_t end, const std::vector<std::string> &names,
+                             std::vector<std::vector<std::string_view>> &columns) {
+    const size_t row = columns.empty() ? 0 : columns[0].size();
+    for (auto &column : columns) column.push_back(std::string_view());
+
+    size_t i = jsonl_skip_space(data, begin, end);
+    if (i >= end || data[i] != '{') return;
+    i = jsonl_skip_space(data, i + 1, end);
+    while (i < end && data[i] == '"') {
+        size_t keyEnd = jsonl_string_end(data, i, end);
+        if (keyEnd == std::string::npos) return;   // a key cut off by the end of the line
+        std::string_view key(data + i + 1, keyEnd - i - 2);
+        i = jsonl_skip_space(data, keyEnd, end);
+        if (i >= end || data[i] != ':') return;
+        i = jsonl_skip_space(data, i + 1, end);
+        if (i >= end) return;
+        bool quoted = data[i] == '"';
+        size_t valueEnd = quoted ? jsonl_string_end(data, i, end) : jsonl_skip_value(data, i, end);
+        if (valueEnd == std::string::npos) return;
+        for (size_t c = 0; c < names.size(); ++c) {
+            if (key == names[c]) {
+                columns[c][row] = quoted ? std::string_view(data + i + 1, valueEnd - i - 2)
+                                         : std::string_view(data + i, valueEnd - i);
+                break;
+            }
+        }
+        i = jsonl_skip_space(data, valueEnd, end);
+        if (i >= end || data[i] != ',') return;
+        i = jsonl_skip_space(data, i + 1, end);
+    }
+}
+
+// parses JSON-lines text into table, one column per entry of keys, one row per non-blank line.
+// Only top level keys of each line's object are looked at.
+inline void parse_jsonl(std::string_view text, const std::vector<std::string> &keys, parsed_table &table, int threadCount=0) {
+    const char *data = text.data();
+    table = parsed_table();
+    table.names = keys;
+    table.columns.resize(keys.size());
+
+    std::vector<size_t> bounds = file_chunker::chunk_bounds(data, text.size(), CSV_CHUNK, '\n');
+    const int chunks = (int)bounds.size() - 1;
+    std::vector<std::vector<std::vector<std::string_view>>> chunkColumns(chunks, std::vector<std::vector<std::string_view>>(keys.size()));
+    parallel_for(chunks, [&](int c) {
+        size_t pos = bounds[c];
+        while (pos < bounds[c+1]) {
+            const void *found = memchr(data + pos, '\n', bounds[c+1] - pos);
+            size_t lineEnd = found ? (size_t)((const char *)found - data) : bounds[c+1];
+            if (jsonl_skip_space(data, pos, lineEnd) < lineEnd) {
+                jsonl_parse_line(data, pos, lineEnd, keys, chunkColumns[c]);
+            }
+            pos = lineEnd + 1;
+        }
+    }, threadCount);
+
+    gather_columns(chunkColumns, table, threadCount);
+}
+
+#endif /* csv_parser_h */
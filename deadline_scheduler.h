@@ -0,0 +1,208 @@
+//
+//  deadline_scheduler.h
+//  Earliest deadline first (EDF) dispatch for work with latency deadlines.
+//  Each submitted item is a worker, a work index and a deadline;  whenever a
+//  pool thread is free it takes the pending item with the earliest deadline
+//  (equal deadlines in submission order), from a binary heap.
+//  Every completion is measured against its deadline, so stats() can report
+//  how many were missed and the distribution of slack - how much time was
+//  left at completion - for sizing the pool against a latency target.  Slack
+//  is counted in a fixed log scale histogram per pool thread, so a service
+//  that runs for months uses no more memory for it than one that just began,
+//  and stats() can read it while the threads are recording.
+//
+//  Used like a scheduler with add_work():  run(), submit() as work arrives,
+//  then join() to finish everything submitted.  Like event_loop.h, each pool
+//  thread is one long running work item of a scheduler.
+//
+
+#ifndef deadline_scheduler_h
+#define deadline_scheduler_h
+
+#include "scheduler.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// slack histogram:  each octave of microseconds (1-2, 2-4, ...) is split in DEADLINE_SLACK_SUBS
+// buckets, up to 2^DEADLINE_SLACK_OCTAVES us, on each side of zero
+#define DEADLINE_SLACK_OCTAVES  40
+#define DEADLINE_SLACK_SUBS     8
+#define DEADLINE_SLACK_SIDE     (1 + DEADLINE_SLACK_OCTAVES * DEADLINE_SLACK_SUBS)    // buckets per sign, the first for under 1 us
+#define DEADLINE_SLACK_BUCKETS  (2 * DEADLINE_SLACK_SIDE)
+
+// the histogram bucket for a slack of us microseconds.  buckets go from the most negative slack up.
+inline int deadline_slack_bucket(double us) {
+    double a = std::fabs(us);
+    int magnitude = 0;
+    if (a >= 1) {
+        int octave = std::ilogb(a);
+        if (octave >= DEADLINE_SLACK_OCTAVES) {
+            magnitude = DEADLINE_SLACK_SIDE - 1;
+        } else {
+            int sub = (int)((a / std::ldexp(1.0, octave) - 1) * DEADLINE_SLACK_SUBS);
+            magnitude = 1 + octave * DEADLINE_SLACK_SUBS + std::min(sub, DEADLINE_SLACK_SUBS - 1);
+        }
+    }
+    return us < 0 ? DEADLINE_SLACK_SIDE - 1 - magnitude : DEADLINE_SLACK_SIDE + magnitude;
+}
+
+// the middle of a bucket's range of slack, in microseconds
+inline double deadline_slack_value(int bucket) {
+    bool negative = bucket < DEADLINE_SLACK_SIDE;
+    int magnitude = negative ? DEADLINE_SLACK_SIDE - 1 - bucket : bucket - DEADLINE_SLACK_SIDE;
+    double mid = 0.5;
+    if (magnitude > 0) {
+        int octave = (magnitude - 1) / DEADLINE_SLACK_SUBS;
+        int sub = (magnitude - 1) % DEADLINE_SLACK_SUBS;
+        mid = std::ldexp(1.0 + (sub + 0.5) / DEADLINE_SLACK_SUBS, octave);
+    }
+    return negative ? -mid : mid;
+}
+
+// what stats() reports, slack in microseconds
+struct deadline_stats {
+    size_t completed;
+    size_t missed;                  // completed after their deadline
+    std::vector<uint64_t> slack;    // deadline - completion, items per deadline_slack_bucket.  negative is a miss.
+
+    // the slack p percent of items had less than, p in 0..100.  To the middle of its bucket,
+    // which is within 1/16 of the value.
+    double slack_percentile(double p) const {
+        if (completed == 0) return 0;
+        uint64_t rank = (uint64_t)(p / 100 * (completed - 1) + 0.5);
+        uint64_t seen = 0;
+        for (int b = 0; b < (int)slack.size(); ++b) {
+            seen += slack[b];
+            if (seen > rank) return deadline_slack_value(b);
+        }
+        return deadline_slack_value((int)slack.size() - 1);
+    }
+};
+
+struct deadline_scheduler : worker {
+    typedef std::chrono::steady_clock clock;
+
+    deadline_scheduler(int threadCount=0) : _threadCount(scheduler::resolve_thread_count(threadCount)), _sequence(0), _done(false),
+                                            _slacks(new slack_histogram[_threadCount]) {}
+    ~deadline_scheduler() {join();}
+
+    // starts the pool threads, which wait for submit()
+    void run() {
+        _done = false;
+        _pool.reset(new scheduler(this, _threadCount, _threadCount));     // a work item per thread, each one a dispatch loop
+        _pool->run();
+    }
+
+    // queues w->do_work(work), to be done by deadline.  may be called before run() and from any thread, including the pool's.
+    void submit(worker *w, int work, clock::time_point deadline) {
+        {
+            std::lock_guard<std::mutex> lk(_mutex);
+            _heap.push_back({deadline, _sequence++, w, work});
+            std::push_heap(_heap.begin(), _heap.end(), later);
+        }
+        _cv.notify_one();
+    }
+
+    // queues w->do_work(work), to be done within deadlineMicroseconds from now
+    void submit_within(worker *w, int work, uint64_t deadlineMicroseconds) {
+        submit(w, work, clock::now() + std::chrono::microseconds(deadlineMicroseconds));
+    }
+
+    // waits for everything submitted to finish, then stops the threads
+    void join() {
+        if (!_pool) return;
+        {
+            std::lock_guard<std::mutex> lk(_mutex);
+            _done = true;
+        }
+        _cv.notify_all();
+        _pool->join();
+        _pool.reset();
+    }
+
+    // items waiting for a thread
+    size_t pending() {
+        std::lock_guard<std::mutex> lk(_mutex);
+        return _heap.size();
+    }
+
+    int number_of_threads_used() const {return _threadCount;}
+
+    // misses and slack of everything completed since the last reset_stats().  may be called at any
+    // time;  while the pool runs, items finishing meanwhile may or may not be counted.
+    deadline_stats stats() {
+        deadline_stats s;
+        s.slack.assign(DEADLINE_SLACK_BUCKETS, 0);
+        for (int t = 0; t < _threadCount; ++t) {
+            for (int b = 0; b < DEADLINE_SLACK_BUCKETS; ++b) s.slack[b] += _slacks[t].buckets[b].load(std::memory_order_relaxed);
+        }
+        s.completed = s.missed = 0;
+        for (int b = 0; b < DEADLINE_SLACK_BUCKETS; ++b) {
+            s.completed += s.slack[b];
+            if (b < DEADLINE_SLACK_SIDE) s.missed += s.slack[b];
+        }
+        return s;
+    }
+
+    void reset_stats() {
+        for (int t = 0; t < _threadCount; ++t) {
+            for (auto &b : _slacks[t].buckets) b.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    // the pool's work item:  run the earliest deadline until join() and the heap is empty
+    void do_work(int thread) {
+        slack_histogram &slacks = _slacks[thread];
+        for (;;) {
+            edf_task task;
+            {
+                std::unique_lock<std::mutex> lk(_mutex);
+                _cv.wait(lk, [this] {return _done || !_heap.empty();});
+                if (_heap.empty()) return;
+                std::pop_heap(_heap.begin(), _heap.end(), later);
+                task = _heap.back();
+                _heap.pop_back();
+            }
+            task.w->do_work(task.work);
+            double slack = std::chrono::duration<double, std::micro>(task.deadline - clock::now()).count();
+            slacks.buckets[deadline_slack_bucket(slack)].fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+private:
+    struct edf_task {
+        clock::time_point deadline;
+        uint64_t sequence;      // ties go to the first submitted
+        worker *w;
+        int work;
+    };
+
+    // heap order:  the root is the earliest deadline
+    static bool later(const edf_task &a, const edf_task &b) {
+        if (a.deadline != b.deadline) return a.deadline > b.deadline;
+        return a.sequence > b.sequence;
+    }
+
+    int _threadCount;
+    std::vector<edf_task> _heap;
+    uint64_t _sequence;
+    bool _done;
+    std::mutex _mutex;          // guards _heap, _sequence and _done
+    std::condition_variable _cv;
+    // per pool thread, so recording is an uncontended atomic add, and stats() can read while it records
+    struct slack_histogram {
+        std::atomic<uint64_t> buckets[DEADLINE_SLACK_BUCKETS] = {};
+    };
+    std::unique_ptr<slack_histogram[]> _slacks;
+    std::unique_ptr<scheduler> _pool;
+};
+
+#endif /* deadline_scheduler_h */
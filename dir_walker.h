@@ -0,0 +1,157 @@
+//
+//  dir_walker.h
+//  Walks a directory tree in parallel and feeds every file it finds straight
+//  into a running scheduler with add_work(), so processing starts while the
+//  tree is still being listed.
+//  Directories are work items of their own scheduler:  listing one pushes its
+//  subdirectories as new work, and whichever pool thread is idle claims the
+//  next one, so a deep branch doesn't leave the other threads waiting on it.
+//
+//  POSIX only (opendir/readdir).  Symbolic links are not followed.
+//
+
+#ifndef dir_walker_h
+#define dir_walker_h
+
+#include "scheduler.h"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <dirent.h>
+#include <sys/stat.h>
+
+// inherit from this, override do_file() with your own method.  Then walk()
+// a root directory, like run() and join() on a scheduler.
+struct dir_walker : worker {
+    dir_walker() : _lister(this), _fileScheduler(nullptr), _dirScheduler(nullptr), _pendingDirs(0) {}
+
+    // lists root recursively, calling do_file for every regular file found,
+    // across threadCount threads, while dirThreadCount threads do the listing.
+    // returns when every file has been processed.
+    void walk(const std::string &root, int threadCount=0, int dirThreadCount=0) {
+        {
+            std::lock_guard<std::mutex> lk(_pathMutex);
+            _dirs.clear();
+            _files.clear();
+            _dirs.push_back(root);
+        }
+        _pendingDirs = 1;
+
+        scheduler files(this, 0, threadCount);
+        _fileScheduler = &files;
+        files.run();    // its threads wait for add_work() from the listing below
+
+        scheduler dirs(&_lister, 1, dirThreadCount);
+        _dirScheduler = &dirs;
+        dirs.run();
+        {
+            // the listing is done when no directory is queued or being listed
+            std::unique_lock<std::mutex> lk(_doneMutex);
+            _doneCv.wait(lk, [this] {return _pendingDirs == 0;});
+        }
+        dirs.join();
+        files.join();
+        _fileScheduler = nullptr;
+        _dirScheduler = nullptr;
+    }
+
+    // override to skip files, called from the listing threads.  name is the entry name, path the full path.
+    virtual bool want_file(const std::string &path, const char *name) {return true;}
+
+    // called once per file, from the pool's threads.  index is in the order files were found.
+    virtual void do_file(int index, const std::string &path) =0;
+
+    // the file scheduler's work item:  look up the path for the index
+    void do_work(int work) {do_file(work, file_path(work));}
+
+    int file_count() {
+        std::lock_guard<std::mutex> lk(_pathMutex);
+        return (int)_files.size();
+    }
+
+    std::string file_path(int index) {
+        std::lock_guard<std::mutex> lk(_pathMutex);
+        return _files[index];
+    }
+
+private:
+    // the directory scheduler's worker:  list directory number `work`
+    struct lister : worker {
+        dir_walker *_walker;
+        lister(dir_walker *walker) : _walker(walker) {}
+        void do_work(int work) {_walker->list_dir(work);}
+    };
+
+    lister _lister;
+    scheduler *_fileScheduler;          // running while walk() is, fed a work item per file found
+    scheduler *_dirScheduler;           // running while walk() is, fed a work item per directory found
+    std::deque<std::string> _dirs;      // directory work item i is _dirs[i]
+    std::deque<std::string> _files;     // file work item i is _files[i]
+    std::mutex _pathMutex;              // guards _dirs and _files
+    std::atomic<int> _pendingDirs;      // directories found but not yet listed
+    std::mutex _doneMutex;
+    std::condition_variable _doneCv;    // signalled when _pendingDirs reaches 0
+
+    void list_dir(int index) {
+        std::string dir;
+        {
+            std::lock_guard<std::mutex> lk(_pathMutex);
+            dir = _dirs[index];
+        }
+        if (DIR *d = opendir(dir.c_str())) {
+            while (struct dirent *entry = readdir(d)) {
+                const char *name = entry->d_name;
+                if (name[0] == '.' && (name[1] == 0 || (name[1] == '.' && name[2] == 0))) continue;
+                std::string path = dir + "/" + name;
+
+                unsigned char type = entry->d_type;
+                if (type == DT_UNKNOWN) {
+                    // some file systems don't fill in d_type
+                    struct stat st;
+                    if (lstat(path.c_str(), &st) != 0) continue;
+                    type = S_ISDIR(st.st_mode) ? DT_DIR : (S_ISREG(st.st_mode) ? DT_REG : DT_UNKNOWN);
+                }
+
+                if (type == DT_DIR) {
+                    ++_pendingDirs;     // before it is queued, so the count can't touch 0 early
+                    {
+                        std::lock_guard<std::mutex> lk(_pathMutex);
+                        _dirs.push_back(path);
+                    }
+                    _dirScheduler->add_work();
+                } else if (type == DT_REG && want_file(path, name)) {
+                    // the path goes in before add_work, so any index the scheduler hands out has one
+                    {
+                        std::lock_guard<std::mutex> lk(_pathMutex);
+                        _files.push_back(path);
+                    }
+                    _fileScheduler->add_work();
+                }
+            }
+            closedir(d);
+        }
+        if (--_pendingDirs == 0) {
+            std::lock_guard<std::mutex> lk(_doneMutex);
+            _doneCv.notify_all();
+        }
+    }
+};
+
+// lists every regular file under root, in parallel.  The order is the order they were found.
+inline std::vector<std::string> list_files(const std::string &root, int dirThreadCount=0) {
+    struct collector : dir_walker {
+        void do_file(int index, const std::string &path) {}
+    };
+    collector c;
+    c.walk(root, 1, dirThreadCount);
+    std::vector<std::string> files;
+    int count = c.file_count();
+    files.reserve(count);
+    for (int i = 0; i < count; ++i) files.push_back(c.file_path(i));
+    return files;
+}
+
+#endif /* dir_walker_h */
@@ -0,0 +1,253 @@
+//
+//  event_loop.h
+//  An edge-triggered epoll reactor whose callbacks run on a scheduler's pool.
+//  One reactor thread waits in epoll_wait and queues each ready registration
+//  onto a fixed ring;  the pool's threads take them off and call the
+//  registration's handler.  Nothing is allocated per event:  registrations
+//  live in a slot table sized at construction, and a registration is on the
+//  ring at most once, so the ring never holds more than the table.
+//
+//  A registration's handler never runs on two threads at once.  Events that
+//  arrive while it runs are collected and it is called again as soon as it
+//  returns, so with edge triggering nothing is lost as long as the handler
+//  reads (or writes) until EAGAIN.
+//
+//  Each pool thread is one long running work item of the scheduler, which
+//  loops taking registrations off the ring until stop().
+//
+//  Linux only (epoll, eventfd).
+//
+
+#ifndef event_loop_h
+#define event_loop_h
+
+#include "scheduler.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <errno.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+// events taken from the kernel per epoll_wait
+#define EVENT_LOOP_BATCH    256
+
+// inherit from this, override on_event() with your own method, and add() it to an event_loop
+struct event_handler {
+    // called on a pool thread when fd is ready.  events is every EPOLL* bit seen since the
+    // last call.  With edge triggering, read or write until EAGAIN before returning.
+    virtual void on_event(int id, int fd, uint32_t events) =0;
+};
+
+struct event_loop : worker {
+    event_loop(int maxRegistrations=1024) : _slots(maxRegistrations), _ready(maxRegistrations), _epoll(-1), _wake(-1), _stopping(false) {
+        for (int i = maxRegistrations - 1; i >= 0; --i) _free.push_back(i);
+    }
+    ~event_loop() {stop();}
+
+    // starts the reactor thread and threadCount pool threads.  false if epoll can't be set up.
+    bool start(int threadCount=0) {
+        _epoll = epoll_create1(EPOLL_CLOEXEC);
+        _wake = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (_epoll < 0 || _wake < 0) {
+            close_fds();
+            return false;
+        }
+        epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.u64 = ~0ull;    // the wake up fd, not a registration
+        epoll_ctl(_epoll, EPOLL_CTL_ADD, _wake, &ev);
+
+        _stopping = false;
+        _readyHead = _readyCount = 0;
+        threadCount = scheduler::resolve_thread_count(threadCount);
+        _pool.reset(new scheduler(this, threadCount, threadCount));     // a work item per thread, each one a dispatch loop
+        _pool->run();
+        _reactor = std::thread(&event_loop::reactor, this);
+        return true;
+    }
+
+    // stops the reactor, lets the pool finish what is queued, and joins every thread
+    void stop() {
+        if (!_pool) return;
+        _stopping = true;
+        uint64_t one = 1;
+        ssize_t r = write(_wake, &one, sizeof(one));
+        (void)r;
+        _reactor.join();
+        {
+            std::lock_guard<std::mutex> lk(_readyMutex);
+            _readyCv.notify_all();
+        }
+        _pool->join();
+        _pool.reset();
+        close_fds();
+    }
+
+    // watches fd for events (EPOLLIN, EPOLLOUT, ...;  edge triggering is added), calling h->on_event
+    // when it's ready.  returns the registration id, or -1 if the table is full or epoll refused the fd.
+    int add(int fd, event_handler *h, uint32_t events=EPOLLIN | EPOLLRDHUP) {
+        int id;
+        {
+            std::lock_guard<std::mutex> lk(_freeMutex);
+            if (_free.empty()) return -1;
+            id = _free.back();
+            _free.pop_back();
+        }
+        slot &s = _slots[id];
+        s.fd = fd;
+        s.handler = h;
+        s.pending = 0;
+        s.closing = false;
+        uint32_t generation = ++s.generation;
+        s.state = SLOT_IDLE;
+
+        epoll_event ev;
+        ev.events = events | EPOLLET;
+        ev.data.u64 = (uint64_t)generation << 32 | (uint32_t)id;
+        if (epoll_ctl(_epoll, EPOLL_CTL_ADD, fd, &ev) != 0) {
+            s.state = SLOT_FREE;
+            release(id);
+            return -1;
+        }
+        return id;
+    }
+
+    // changes the events watched for registration id
+    bool modify(int id, uint32_t events) {
+        slot &s = _slots[id];
+        epoll_event ev;
+        ev.events = events | EPOLLET;
+        ev.data.u64 = (uint64_t)s.generation.load() << 32 | (uint32_t)id;
+        return epoll_ctl(_epoll, EPOLL_CTL_MOD, s.fd, &ev) == 0;
+    }
+
+    // stops watching registration id.  Its handler won't be called again after it returns, if it
+    // is running;  call this from the handler itself (or when it can't be running) before closing the fd.
+    void remove(int id) {
+        slot &s = _slots[id];
+        s.closing = true;
+        epoll_ctl(_epoll, EPOLL_CTL_DEL, s.fd, nullptr);
+        retire(id);
+    }
+
+    // the pool's work item:  run handlers off the ready ring until stop()
+    void do_work(int work) {
+        for (;;) {
+            int id;
+            {
+                std::unique_lock<std::mutex> lk(_readyMutex);
+                _readyCv.wait(lk, [this] {return _stopping || _readyCount > 0;});
+                if (_readyCount == 0) return;
+                id = _ready[_readyHead];
+                _readyHead = (_readyHead + 1) % (int)_ready.size();
+                --_readyCount;
+            }
+            dispatch(id);
+        }
+    }
+
+private:
+    enum {
+        SLOT_FREE,
+        SLOT_IDLE,      // registered, waiting for an event
+        SLOT_QUEUED,    // on the ready ring
+        SLOT_RUNNING,   // its handler is running
+        SLOT_AGAIN      // its handler is running, and more events came in
+    };
+
+    struct slot {
+        int fd;
+        event_handler *handler;
+        std::atomic<uint32_t> pending{0};       // events not yet passed to the handler
+        std::atomic<int> state{SLOT_FREE};
+        std::atomic<uint32_t> generation{0};    // bumped on every add, so late events for an old registration are dropped
+        std::atomic<bool> closing{false};
+    };
+
+    std::vector<slot> _slots;
+    std::vector<int> _free;         // free slot ids
+    std::mutex _freeMutex;
+    std::vector<int> _ready;        // ring of slot ids waiting for a pool thread
+    int _readyHead;
+    int _readyCount;
+    std::mutex _readyMutex;         // guards the ring
+    std::condition_variable _readyCv;
+    int _epoll;
+    int _wake;                      // eventfd that stop() uses to wake the reactor
+    std::atomic<bool> _stopping;
+    std::thread _reactor;
+    std::unique_ptr<scheduler> _pool;
+
+    void close_fds() {
+        if (_epoll >= 0) close(_epoll);
+        if (_wake >= 0) close(_wake);
+        _epoll = _wake = -1;
+    }
+
+    void release(int id) {
+        std::lock_guard<std::mutex> lk(_freeMutex);
+        _free.push_back(id);
+    }
+
+    // frees a closing slot once its handler is neither queued nor running.  whoever gets it there frees it.
+    void retire(int id) {
+        int expected = SLOT_IDLE;
+        if (_slots[id].state.compare_exchange_strong(expected, SLOT_FREE)) release(id);
+    }
+
+    void reactor() {
+        epoll_event events[EVENT_LOOP_BATCH];
+        while (!_stopping) {
+            int n = epoll_wait(_epoll, events, EVENT_LOOP_BATCH, -1);
+            if (n < 0 && errno != EINTR) break;
+            for (int i = 0; i < n; ++i) {
+                if (events[i].data.u64 == ~0ull) continue;
+                int id = (int)(uint32_t)events[i].data.u64;
+                slot &s = _slots[id];
+                if (s.generation.load() != (uint32_t)(events[i].data.u64 >> 32)) continue;
+                s.pending |= events[i].events;
+                // hand it to the pool if idle, or tell the running handler to go again
+                int state = s.state.load();
+                for (;;) {
+                    if (state == SLOT_IDLE) {
+                        if (!s.state.compare_exchange_weak(state, SLOT_QUEUED)) continue;
+                        push_ready(id);
+                    } else if (state == SLOT_RUNNING) {
+                        if (!s.state.compare_exchange_weak(state, SLOT_AGAIN)) continue;
+                    }
+                    break;
+                }
+            }
+        }
+    }
+
+    void push_ready(int id) {
+        {
+            std::lock_guard<std::mutex> lk(_readyMutex);
+            _ready[(_readyHead + _readyCount) % (int)_ready.size()] = id;
+            ++_readyCount;
+        }
+        _readyCv.notify_one();
+    }
+
+    void dispatch(int id) {
+        slot &s = _slots[id];
+        s.state = SLOT_RUNNING;
+        for (;;) {
+            uint32_t events = s.pending.exchange(0);
+            if (!s.closing && events) s.handler->on_event(id, s.fd, events);
+            int expected = SLOT_RUNNING;
+            if (s.state.compare_exchange_strong(expected, SLOT_IDLE)) break;
+            s.state = SLOT_RUNNING;     // it was SLOT_AGAIN
+        }
+        if (s.closing) retire(id);
+    }
+};
+
+#endif /* event_loop_h */
@@ -0,0 +1,226 @@
+//
+//  fair_share_scheduler.h
+//  Weighted fair sharing of one pool between concurrent jobs.  A scheduler
+//  hands out its indices in order, so when several jobs share a pool the
+//  first big one holds every thread until it drains.  Here each job - a
+//  worker and a count of work indices - has its own queue, and free threads
+//  pick between the jobs with deficit round robin:  the job at the front of
+//  the round gets a quantum of weight * FAIR_SHARE_QUANTUM_US of credit, runs
+//  items while its credit lasts, and the round moves on.  An item is charged
+//  to its job when it is handed out, at the job's average item time so far
+//  (a whole quantum before any has finished), so one job can't take every
+//  free thread at once;  when it finishes the charge is corrected to its
+//  actual run time.  Credit can go negative, and the debt is carried into
+//  the next round, so over time every job gets pool time in proportion to
+//  its weight, however long its items are.
+//  A new job joins the end of the round, so it waits at most one round of
+//  the others' quanta for its first item, whatever else is queued.
+//
+//  Used like deadline_scheduler.h:  run(), add_job() as jobs arrive, wait()
+//  for each job, then join().  Each pool thread is one long running work
+//  item of a scheduler.
+//
+
+#ifndef fair_share_scheduler_h
+#define fair_share_scheduler_h
+
+#include "scheduler.h"
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// pool time, in microseconds, a weight 1 job may use per round
+#define FAIR_SHARE_QUANTUM_US   500
+
+struct fair_share_scheduler : worker {
+    typedef std::chrono::steady_clock clock;
+
+    fair_share_scheduler(int threadCount=0) : _threadCount(scheduler::resolve_thread_count(threadCount)), _cursor(0), _done(false) {}
+    ~fair_share_scheduler() {join();}
+
+    // starts the pool threads, which wait for add_job()
+    void run() {
+        _done = false;
+        _pool.reset(new scheduler(this, _threadCount, _threadCount));     // a work item per thread, each one a dispatch loop
+        _pool->run();
+    }
+
+    // queues w->do_work(0 .. maxWork-1) as a job with the given share of the pool (weight >= 1).
+    // returns the job's id, for wait().  may be called before run() and from any thread.
+    int add_job(worker *w, int maxWork, int weight=1) {
+        int id;
+        {
+            std::lock_guard<std::mutex> lk(_mutex);
+            if (_free.empty()) {
+                id = (int)_jobs.size();
+                _jobs.push_back(fair_job());
+            } else {
+                id = _free.back();
+                _free.pop_back();
+            }
+            fair_job &j = _jobs[id];
+            j.w = w;
+            j.maxWork = maxWork > 0 ? maxWork : 0;
+            j.next = j.done = 0;
+            j.weight = weight > 0 ? weight : 1;
+            j.deficit = 0;
+            j.used = 0;
+            j.waited = false;
+            if (j.maxWork > 0) {
+                // the end of the round is just behind the cursor
+                _active.insert(_active.begin() + _cursor, id);
+                if (_active.size() == 1) grant(id);
+                else ++_cursor;
+            }
+        }
+        _cv.notify_all();
+        return id;
+    }
+
+    // waits for every item of job to finish.  Its id may be reused after this returns.
+    // A second wait for the same id, or a wait after join(), returns at once.
+    void wait(int job) {
+        std::unique_lock<std::mutex> lk(_mutex);
+        if (!known(job) || _jobs[job].waited) return;
+        _doneCv.wait(lk, [this, job] {return !known(job) || _jobs[job].done == _jobs[job].maxWork;});
+        if (!known(job) || _jobs[job].waited) return;     // join() dropped it, or another wait() took it
+        _jobs[job].waited = true;
+        _free.push_back(job);
+    }
+
+    // whether every item of job has finished.  true after join().
+    bool finished(int job) {
+        std::lock_guard<std::mutex> lk(_mutex);
+        return !known(job) || _jobs[job].done == _jobs[job].maxWork;
+    }
+
+    // items of job that have finished so far.  0 after join().
+    int completed(int job) {
+        std::lock_guard<std::mutex> lk(_mutex);
+        return known(job) ? _jobs[job].done : 0;
+    }
+
+    // waits for every job to finish, then stops the threads.  Ids not yet waited for are dropped.
+    void join() {
+        if (!_pool) return;
+        {
+            std::lock_guard<std::mutex> lk(_mutex);
+            _done = true;
+        }
+        _cv.notify_all();
+        _pool->join();
+        _pool.reset();
+        std::lock_guard<std::mutex> lk(_mutex);
+        _jobs.clear();
+        _free.clear();
+    }
+
+    // jobs with items not yet handed out
+    size_t active_jobs() {
+        std::lock_guard<std::mutex> lk(_mutex);
+        return _active.size();
+    }
+
+    int number_of_threads_used() const {return _threadCount;}
+
+    // the pool's work item:  take items round robin by credit until join() and nothing is left
+    void do_work(int thread) {
+        for (;;) {
+            int id;
+            worker *w;
+            int work;
+            int64_t charged;
+            {
+                std::unique_lock<std::mutex> lk(_mutex);
+                _cv.wait(lk, [this] {return _done || !_active.empty();});
+                if (_active.empty()) return;
+                id = next_job();
+                fair_job &j = _jobs[id];
+                w = j.w;
+                work = j.next++;
+                // charge the item now, so the job's credit runs out as threads take its items
+                charged = j.done > 0 ? j.used / j.done + 1 : (int64_t)FAIR_SHARE_QUANTUM_US;
+                j.deficit -= charged;
+                if (j.next == j.maxWork) leave(id);
+            }
+            auto start = clock::now();
+            w->do_work(work);
+            int64_t used = std::chrono::duration_cast<std::chrono::microseconds>(clock::now() - start).count();
+            {
+                std::lock_guard<std::mutex> lk(_mutex);
+                fair_job &j = _jobs[id];
+                j.deficit -= used + 1 - charged;    // at least a microsecond, so tiny items still use up the quantum
+                j.used += used;
+                if (++j.done == j.maxWork) _doneCv.notify_all();
+            }
+        }
+    }
+
+private:
+    struct fair_job {
+        worker *w;
+        int maxWork;
+        int next;           // the next index to hand out
+        int done;           // indices finished
+        int weight;
+        int64_t deficit;    // credit left this round, in microseconds
+        int64_t used;       // run time of the finished indices, in microseconds
+        bool waited;        // wait() has returned, and the id is free
+    };
+
+    int _threadCount;
+    std::vector<fair_job> _jobs;    // by id
+    std::vector<int> _free;         // ids to reuse
+    std::vector<int> _active;       // ids of jobs with items to hand out, in round order
+    size_t _cursor;                 // _active[_cursor] is the job being served
+    bool _done;
+    std::mutex _mutex;              // guards everything above
+    std::condition_variable _cv;    // pool threads wait here for jobs
+    std::condition_variable _doneCv;    // wait() waits here
+    std::unique_ptr<scheduler> _pool;
+
+    // whether job is an id add_job() returned since the last join()
+    bool known(int job) const {return job >= 0 && job < (int)_jobs.size();}
+
+    // a job's turn has come:  give it this round's credit, on top of any debt from the last.
+    // A turn only ends once the credit is spent, so anything left over is refunds from items
+    // charged more than they ran, which are the job's to keep.
+    void grant(int id) {
+        fair_job &j = _jobs[id];
+        j.deficit += (int64_t)j.weight * FAIR_SHARE_QUANTUM_US;
+    }
+
+    // the job to take an item from, moving the round on past jobs that have used their credit.
+    // Each pass grants every job a quantum, so this ends even when every job is in debt.
+    int next_job() {
+        for (;;) {
+            int id = _active[_cursor];
+            if (_jobs[id].deficit > 0) return id;
+            _cursor = (_cursor + 1) % _active.size();
+            grant(_active[_cursor]);
+        }
+    }
+
+    // takes a job with nothing left to hand out out of the round
+    void leave(int id) {
+        size_t i = 0;
+        while (_active[i] != id) ++i;
+        _active.erase(_active.begin() + i);
+        if (_active.empty()) {
+            _cursor = 0;
+            return;
+        }
+        if (i < _cursor) {
+            --_cursor;
+        } else if (i == _cursor) {
+            // the next job in the round starts its turn
+            if (_cursor == _active.size()) _cursor = 0;
+            grant(_active[_cursor]);
+        }
+    }
+};
+
+#endif /* fair_share_scheduler_h */
@@ -0,0 +1,551 @@
+//
+//  fiber_scheduler.h
+//  A scheduler whose work items run as stackful fibers, for items that spend
+//  their time waiting - on a sleep, a lock or a socket.  On a plain scheduler
+//  each waiting item holds an OS thread;  here each item gets a small stack
+//  from a pool (with a guard page below it, so an overflow faults instead of
+//  corrupting a neighbour) and runs on it by user space context switching.
+//  The blocking helpers below - fiber_sleep, fiber_mutex,
+//  fiber_condition_variable, fiber_wait_fd, fiber_yield - park the fiber
+//  and return its thread to the pool, which starts or resumes other items,
+//  so thousands of waiting items share a few threads.
+//
+//  Items are started in index order, at most maxFibers alive at once.  A
+//  parked fiber is resumed on whichever pool thread is free, so do_work must
+//  not keep thread_local state or thread_index() across a blocking helper.
+//  Ordinary blocking calls (std::mutex, read(), sleep_for) still block the
+//  whole thread, and so every fiber waiting behind it.
+//
+//  One reactor thread wakes sleeping fibers from a timerfd and fibers
+//  waiting on fds from epoll.  Like event_loop.h, each pool thread is one
+//  long running work item of a scheduler.  Contexts are switched with
+//  ucontext, which costs a signal mask system call per switch:  cheap next to
+//  a wait, not for switching every few instructions.  Linux only.
+//
+
+#ifndef fiber_scheduler_h
+#define fiber_scheduler_h
+
+#include "scheduler.h"
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <vector>
+#include <errno.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <ucontext.h>
+#include <unistd.h>
+
+// usable stack per fiber, on top of a guard page
+#define FIBER_STACK_BYTES   (64 * 1024)
+
+// fibers alive at once, by default
+#define FIBER_MAX_LIVE      4096
+
+// how long a second fiber waiting on an fd that already has a waiter sleeps before trying again
+#define FIBER_FD_BUSY_US    1000
+
+struct fiber_scheduler;
+
+// one work item's context and stack.  Used by the helpers below;  clients don't touch it.
+struct fiber {
+    ucontext_t context;
+    char *stack;            // the mapping, guard page first
+    size_t stackBytes;      // the mapping's size
+    fiber_scheduler *owner;
+    int work;
+    bool finished;
+    int fd;                 // for fiber_wait_fd
+    uint32_t events;        // asked for, then what was seen
+    std::chrono::steady_clock::time_point wake;     // for fiber_sleep
+};
+
+// per pool thread:  the context to switch back to, and what to do once the fiber is off its stack
+struct fiber_thread {
+    ucontext_t context;
+    fiber *current;
+    void (*after)(fiber *);
+};
+
+// the calling pool thread's state, or nullptr.  Not inlined, and not pure, so a fiber that
+// was parked on one thread and resumed on another reads the new thread's state, not a cached one.
+__attribute__((noinline)) inline fiber_thread *&fiber_thread_ref() {
+    static thread_local fiber_thread *state = nullptr;
+    asm volatile("");
+    return state;
+}
+
+// the fiber running on this thread, or nullptr off a fiber
+inline fiber *current_fiber() {
+    fiber_thread *t = fiber_thread_ref();
+    return t ? t->current : nullptr;
+}
+
+// switches from the running fiber back to its thread, which then calls after(f).  returns when f is resumed.
+// after() is the place to publish f to whoever will wake it, because by then nothing runs on f's stack.
+inline void fiber_park(void (*after)(fiber *)) {
+    fiber_thread *t = fiber_thread_ref();
+    fiber *f = t->current;
+    t->after = after;
+    swapcontext(&f->context, &t->context);
+}
+
+struct fiber_scheduler : worker {
+    typedef std::chrono::steady_clock clock;
+
+    fiber_scheduler(worker *w, int maxWork, int threadCount=0, int maxFibers=FIBER_MAX_LIVE, size_t stackBytes=FIBER_STACK_BYTES)
+        : _w(w), _maxWork(maxWork), _nextWork(0), _threadCount(scheduler::resolve_thread_count(threadCount)),
+          _maxFibers(maxFibers > 0 ? maxFibers : 1), _live(0), _doneAddingWork(false), _epoll(-1), _timerFd(-1), _wake(-1) {
+        size_t page = (size_t)sysconf(_SC_PAGESIZE);
+        _guardBytes = page;
+        _stackBytes = (stackBytes + page - 1) / page * page;
+    }
+
+    ~fiber_scheduler() {
+        join();
+        for (fiber *f : _spare) {
+            munmap(f->stack, f->stackBytes);
+            delete f;
+        }
+    }
+
+    void add_work(int newWork=1) {
+        {
+            std::lock_guard<std::mutex> lk(_mutex);
+            _maxWork += newWork;
+        }
+        _cv.notify_all();
+    }
+
+    // starts the pool threads and the reactor.  false if epoll or the timerfd can't be made.
+    bool run() {
+        _epoll = epoll_create1(EPOLL_CLOEXEC);
+        _timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        _wake = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (_epoll < 0 || _timerFd < 0 || _wake < 0) {
+            close_fds();
+            return false;
+        }
+        epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.u64 = REACTOR_WAKE;
+        epoll_ctl(_epoll, EPOLL_CTL_ADD, _wake, &ev);
+        ev.data.u64 = REACTOR_TIMER;
+        epoll_ctl(_epoll, EPOLL_CTL_ADD, _timerFd, &ev);
+
+        _nextWork = 0;
+        _peak = 0;
+        _doneAddingWork = false;
+        _reactor = std::thread(&fiber_scheduler::reactor, this);
+        _pool.reset(new scheduler(this, _threadCount, _threadCount));     // a work item per thread, each one a dispatch loop
+        _pool->run();
+        return true;
+    }
+
+    // waits for every item to finish, then stops the threads
+    void join() {
+        if (!_pool) return;
+        {
+            std::lock_guard<std::mutex> lk(_mutex);
+            _doneAddingWork = true;
+        }
+        _cv.notify_all();
+        _pool->join();
+        _pool.reset();
+        uint64_t one = 1;
+        ssize_t r = write(_wake, &one, sizeof(one));
+        (void)r;
+        _reactor.join();
+        close_fds();
+    }
+
+    int number_of_threads_used() const {return _threadCount;}
+
+    // the most fibers that were alive at once, in the last run
+    int peak_fibers() {
+        std::lock_guard<std::mutex> lk(_mutex);
+        return _peak;
+    }
+
+    // queues a parked fiber to be resumed.  For the blocking helpers.
+    void make_ready(fiber *f) {
+        {
+            std::lock_guard<std::mutex> lk(_mutex);
+            _ready.push_back(f);
+        }
+        _cv.notify_one();
+    }
+
+    // puts a parked fiber to sleep until f->wake.  For fiber_sleep, as its after() step.
+    void add_sleeper(fiber *f) {
+        std::lock_guard<std::mutex> lk(_timerMutex);
+        _sleepers.push_back(f);
+        std::push_heap(_sleepers.begin(), _sleepers.end(), wakes_later);
+        if (_sleepers.front() == f) arm_timer();
+    }
+
+    // has the reactor resume a parked fiber once f->fd has f->events.  For fiber_wait_fd, as its after() step.
+    // If another fiber is already waiting on the fd, f sleeps a while instead, with f->events 0 to say so.
+    void add_fd_waiter(fiber *f) {
+        epoll_event ev;
+        ev.events = f->events | EPOLLONESHOT;
+        ev.data.ptr = f;
+        if (epoll_ctl(_epoll, EPOLL_CTL_ADD, f->fd, &ev) == 0) return;
+        if (errno == EEXIST) {
+            f->events = 0;
+            f->wake = clock::now() + std::chrono::microseconds(FIBER_FD_BUSY_US);
+            add_sleeper(f);
+        } else {
+            make_ready(f);      // not pollable (a regular file):  let the fiber go ahead and try
+        }
+    }
+
+    // the pool's work item:  start and resume fibers until join() and every item is done
+    void do_work(int thread) {
+        fiber_thread state;
+        state.current = nullptr;
+        state.after = nullptr;
+        fiber_thread_ref() = &state;
+        for (;;) {
+            fiber *f = nullptr;
+            bool fresh = false;
+            {
+                std::unique_lock<std::mutex> lk(_mutex);
+                _cv.wait(lk, [this] {return !_ready.empty() || can_start() || (_doneAddingWork && _nextWork >= _maxWork && _live == 0);});
+                if (!_ready.empty()) {
+                    f = _ready.front();
+                    _ready.pop_front();
+                } else if (can_start()) {
+                    f = new_fiber();
+                    f->work = _nextWork++;
+                    _peak = std::max(_peak, ++_live);
+                    fresh = true;
+                } else {
+                    break;
+                }
+            }
+            if (fresh) start_fiber(f);
+            state.current = f;
+            swapcontext(&state.context, &f->context);
+            state.current = nullptr;
+            if (state.after) {
+                void (*after)(fiber *) = state.after;
+                state.after = nullptr;
+                after(f);
+            } else if (f->finished) {
+                bool last;
+                {
+                    std::lock_guard<std::mutex> lk(_mutex);
+                    _spare.push_back(f);
+                    --_live;
+                    last = _doneAddingWork && _nextWork >= _maxWork && _live == 0;
+                }
+                if (last) _cv.notify_all();
+                else _cv.notify_one();      // a slot for a new fiber is free
+            }
+        }
+        fiber_thread_ref() = nullptr;
+    }
+
+private:
+    enum : uint64_t {
+        REACTOR_WAKE = 0,   // epoll data for the eventfd join() writes
+        REACTOR_TIMER = 1   // and for the timerfd;  anything else is a fiber
+    };
+
+    worker *_w;
+    int _maxWork;
+    int _nextWork;              // the next index to start a fiber for
+    int _threadCount;
+    int _maxFibers;
+    int _live;                  // fibers started and not finished
+    int _peak = 0;
+    bool _doneAddingWork;
+    size_t _guardBytes;
+    size_t _stackBytes;
+    std::deque<fiber *> _ready;     // parked fibers to resume
+    std::vector<fiber *> _spare;    // finished fibers, their stacks kept for reuse
+    std::mutex _mutex;              // guards everything above
+    std::condition_variable _cv;    // pool threads wait here
+    std::vector<fiber *> _sleepers; // heap, the earliest wake first
+    std::mutex _timerMutex;         // guards _sleepers and the timerfd's setting
+    int _epoll;
+    int _timerFd;
+    int _wake;
+    std::thread _reactor;
+    std::unique_ptr<scheduler> _pool;
+
+    bool can_start() const {return _nextWork < _maxWork && _live < _maxFibers;}
+
+    // a fiber with a stack, reused or newly mapped.  called with _mutex held.
+    fiber *new_fiber() {
+        if (!_spare.empty()) {
+            fiber *f = _spare.back();
+            _spare.pop_back();
+            return f;
+        }
+        fiber *f = new fiber();
+        f->stackBytes = _guardBytes + _stackBytes;
+        f->stack = (char *)mmap(nullptr, f->stackBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_STACK, -1, 0);
+        if (f->stack == MAP_FAILED) {
+            delete f;
+            throw std::bad_alloc();
+        }
+        if (mprotect(f->stack, _guardBytes, PROT_NONE) != 0) {     // stacks grow down, into the guard
+            munmap(f->stack, f->stackBytes);
+            delete f;
+            throw std::bad_alloc();
+        }
+        f->owner = this;
+        return f;
+    }
+
+    // points a fiber's context at the top of its stack, to run entry()
+    void start_fiber(fiber *f) {
+        f->finished = false;
+        getcontext(&f->context);
+        f->context.uc_stack.ss_sp = f->stack + _guardBytes;
+        f->context.uc_stack.ss_size = _stackBytes;
+        f->context.uc_link = nullptr;
+        makecontext(&f->context, (void (*)())entry, 0);
+    }
+
+    // where every fiber starts:  run the item, then hand the stack back to whichever thread is running it
+    static void entry() {
+        fiber *f = current_fiber();
+        f->owner->_w->do_work(f->work);
+        f->finished = true;
+        setcontext(&fiber_thread_ref()->context);
+    }
+
+    static bool wakes_later(const fiber *a, const fiber *b) {return a->wake > b->wake;}
+
+    // sets the timerfd for the earliest sleeper, or disarms it.  called with _timerMutex held.
+    void arm_timer() {
+        itimerspec spec = {};
+        if (!_sleepers.empty()) {
+            auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(_sleepers.front()->wake.time_since_epoch()).count();
+            if (ns <= 0) ns = 1;
+            spec.it_value.tv_sec = ns / 1000000000;
+            spec.it_value.tv_nsec = ns % 1000000000;
+        }
+        timerfd_settime(_timerFd, TFD_TIMER_ABSTIME, &spec, nullptr);
+    }
+
+    void reactor() {
+        epoll_event events[256];
+        for (;;) {
+            int n = epoll_wait(_epoll, events, 256, -1);
+            if (n < 0 && errno != EINTR) break;
+            for (int i = 0; i < n; ++i) {
+                if (events[i].data.u64 == REACTOR_WAKE) return;
+                if (events[i].data.u64 == REACTOR_TIMER) {
+                    uint64_t expirations;
+                    ssize_t r = read(_timerFd, &expirations, sizeof(expirations));
+                    (void)r;
+                    wake_sleepers();
+                    continue;
+                }
+                fiber *f = (fiber *)events[i].data.ptr;
+                epoll_ctl(_epoll, EPOLL_CTL_DEL, f->fd, nullptr);
+                f->events = events[i].events;
+                make_ready(f);
+            }
+        }
+    }
+
+    void wake_sleepers() {
+        std::lock_guard<std::mutex> lk(_timerMutex);
+        auto now = clock::now();
+        while (!_sleepers.empty() && _sleepers.front()->wake <= now) {
+            std::pop_heap(_sleepers.begin(), _sleepers.end(), wakes_later);
+            make_ready(_sleepers.back());
+            _sleepers.pop_back();
+        }
+        arm_timer();
+    }
+
+    void close_fds() {
+        if (_epoll >= 0) close(_epoll);
+        if (_timerFd >= 0) close(_timerFd);
+        if (_wake >= 0) close(_wake);
+        _epoll = _timerFd = _wake = -1;
+    }
+};
+
+// lets other fibers run, then carries on.  Off a fiber, std::this_thread::yield().
+inline void fiber_yield() {
+    if (!current_fiber()) {
+        std::this_thread::yield();
+        return;
+    }
+    fiber_park([](fiber *f) {f->owner->make_ready(f);});
+}
+
+// parks the calling fiber for at least microseconds.  Off a fiber, sleeps the thread.
+inline void fiber_sleep(uint64_t microseconds) {
+    fiber *f = current_fiber();
+    if (!f) {
+        std::this_thread::sleep_for(std::chrono::microseconds(microseconds));
+        return;
+    }
+    f->wake = std::chrono::steady_clock::now() + std::chrono::microseconds(microseconds);
+    fiber_park([](fiber *f) {f->owner->add_sleeper(f);});
+}
+
+// parks the calling fiber until fd has one of events (EPOLLIN, EPOLLOUT, ...).  returns the events
+// seen.  Off a fiber, poll()s.  One fiber at a time waits on an fd in epoll:  a second one
+// waiting on the same fd rechecks every FIBER_FD_BUSY_US until the first is done.
+inline uint32_t fiber_wait_fd(int fd, uint32_t events) {
+    fiber *f = current_fiber();
+    if (!f) {
+        pollfd p;
+        p.fd = fd;
+        p.events = (short)events;
+        p.revents = 0;
+        poll(&p, 1, -1);
+        return (uint32_t)p.revents;
+    }
+    do {
+        f->fd = fd;
+        f->events = events;
+        fiber_park([](fiber *f) {f->owner->add_fd_waiter(f);});
+    } while (f->events == 0);   // the fd had another waiter
+    return f->events;
+}
+
+// a mutex that parks the fiber waiting for it, rather than its thread.  Ownership passes
+// straight to the longest waiter on unlock.  Off a fiber lock() spins, yielding the thread,
+// so setup code can use it too.
+struct fiber_mutex {
+    fiber_mutex() : _locked(false) {}
+
+    void lock() {
+        std::unique_lock<std::mutex> lk(_m);
+        if (!_locked) {
+            _locked = true;
+            return;
+        }
+        fiber *f = current_fiber();
+        if (!f) {
+            while (_locked) {
+                lk.unlock();
+                std::this_thread::yield();
+                lk.lock();
+            }
+            _locked = true;
+            return;
+        }
+        _waiters.push_back(f);
+        lk.release();
+        park_unlocking(_m);     // unlock() hands the mutex over before waking us
+    }
+
+    bool try_lock() {
+        std::lock_guard<std::mutex> lk(_m);
+        if (_locked) return false;
+        _locked = true;
+        return true;
+    }
+
+    void unlock() {
+        fiber *next = nullptr;
+        {
+            std::lock_guard<std::mutex> lk(_m);
+            if (_waiters.empty()) {
+                _locked = false;
+            } else {
+                next = _waiters.front();
+                _waiters.pop_front();
+            }
+        }
+        if (next) next->owner->make_ready(next);
+    }
+
+    // parks the calling fiber, unlocking m (held by the caller) once it is off its stack
+    static void park_unlocking(std::mutex &m) {
+        unlocking() = &m;
+        fiber_park([](fiber *) {
+            std::mutex *m = unlocking();
+            unlocking() = nullptr;
+            m->unlock();
+        });
+    }
+
+private:
+    bool _locked;
+    std::deque<fiber *> _waiters;
+    std::mutex _m;
+
+    // the mutex park_unlocking hands to its after() step.  Set and read on the same thread, between
+    // the fiber parking and its thread running after(), so thread_local is enough.
+    static std::mutex *&unlocking() {
+        static thread_local std::mutex *m = nullptr;
+        return m;
+    }
+};
+
+// a condition variable for fibers, used with a fiber_mutex
+struct fiber_condition_variable {
+    // unlocks lock and parks until notified, then relocks it.  Off a fiber there is nothing to
+    // park:  it unlocks, yields the thread and relocks, a spurious wake up, so wait in a loop
+    // (or with a predicate).
+    void wait(std::unique_lock<fiber_mutex> &lock) {
+        fiber *f = current_fiber();
+        if (!f) {
+            lock.unlock();
+            std::this_thread::yield();
+            lock.lock();
+            return;
+        }
+        std::unique_lock<std::mutex> lk(_m);
+        _waiters.push_back(f);
+        lock.unlock();
+        lk.release();
+        fiber_mutex::park_unlocking(_m);
+        lock.lock();
+    }
+
+    template <typename Predicate>
+    void wait(std::unique_lock<fiber_mutex> &lock, Predicate pred) {
+        while (!pred()) wait(lock);
+    }
+
+    void notify_one() {
+        fiber *f = nullptr;
+        {
+            std::lock_guard<std::mutex> lk(_m);
+            if (_waiters.empty()) return;
+            f = _waiters.front();
+            _waiters.pop_front();
+        }
+        f->owner->make_ready(f);
+    }
+
+    void notify_all() {
+        std::deque<fiber *> waiters;
+        {
+            std::lock_guard<std::mutex> lk(_m);
+            waiters.swap(_waiters);
+        }
+        for (fiber *f : waiters) f->owner->make_ready(f);
+    }
+
+private:
+    std::deque<fiber *> _waiters;
+    std::mutex _m;
+};
+
+#endif /* fiber_scheduler_h */
@@ -0,0 +1,182 @@
+//
+//  file_chunker.h
+//  Memory maps a large file and hands it to the scheduler in roughly equal
+//  chunks, each snapped forward to a record delimiter (a newline by default),
+//  so every chunk holds whole records.  Workers get a std::string_view into
+//  the mapping - nothing is copied or read() by the worker.
+//  As chunks are claimed, the kernel is told (madvise WILLNEED) to start
+//  reading the chunks a little ahead of the claiming cursor.
+//
+//  POSIX only (mmap), and needs C++17 for std::string_view.
+//
+
+#ifndef file_chunker_h
+#define file_chunker_h
+
+#include "scheduler.h"
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstring>
+#include <string_view>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// default chunk size, big enough that the per chunk overhead is noise
+#define CHUNKER_DEFAULT_BYTES   (4 << 20)
+
+// how many chunks past the one being claimed get a WILLNEED hint
+#define CHUNKER_PREFETCH_AHEAD  4
+
+// a read only mapping of a whole file
+struct mapped_file {
+    mapped_file() : _data(nullptr), _size(0) {}
+    ~mapped_file() {close();}
+    mapped_file(const mapped_file &) = delete;
+    mapped_file &operator=(const mapped_file &) = delete;
+
+    // maps path, returns false if it can't be opened or mapped.  An empty file maps to an empty view.
+    bool open(const char *path) {
+        close();
+        int fd = ::open(path, O_RDONLY);
+        if (fd < 0) return false;
+        struct stat st;
+        if (fstat(fd, &st) != 0) {
+            ::close(fd);
+            return false;
+        }
+        _size = (size_t)st.st_size;
+        if (_size > 0) {
+            void *p = mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p == MAP_FAILED) {
+                _size = 0;
+                ::close(fd);
+                return false;
+            }
+            _data = (const char *)p;
+            madvise(p, _size, MADV_SEQUENTIAL);
+        }
+        ::close(fd);    // the mapping keeps the file alive
+        return true;
+    }
+
+    void close() {
+        if (_data) munmap((void *)_data, _size);
+        _data = nullptr;
+        _size = 0;
+    }
+
+    // asks the kernel to start reading [offset, offset+length) in now
+    void will_need(size_t offset, size_t length) const {
+        if (!_data || length == 0) return;
+        // madvise wants a page aligned start
+        const size_t page = (size_t)sysconf(_SC_PAGESIZE);
+        size_t start = offset & ~(page - 1);
+        madvise((void *)(_data + start), offset + length - start, MADV_WILLNEED);
+    }
+
+    std::string_view view() const {return std::string_view(_data, _size);}
+    const char *data() const {return _data;}
+    size_t size() const {return _size;}
+
+private:
+    const char *_data;
+    size_t _size;
+};
+
+//-------------------------------------------------------------------------
+
+// inherit from this, override do_chunk() with your own method.
+// Then open() a file and run() it, like a worker with a scheduler.
+struct file_chunker : worker {
+    file_chunker() : _advised(0) {}
+
+    // maps path and splits it into chunks of about chunkBytes, each ending just after a delimiter
+    // (except possibly the last).  returns false if the file can't be mapped.
+    bool open(const char *path, size_t chunkBytes=CHUNKER_DEFAULT_BYTES, char delimiter='\n') {
+        _bounds.clear();
+        if (!_file.open(path)) return false;
+        _bounds = chunk_bounds(_file.data(), _file.size(), chunkBytes, delimiter);
+        return true;
+    }
+
+    // splits data[0..size) into chunks of about chunkBytes, each snapped forward
+    // to just after a delimiter.  Chunk i is [bounds[i], bounds[i+1]).
+    static std::vector<size_t> chunk_bounds(const char *data, size_t size, size_t chunkBytes, char delimiter) {
+        if (chunkBytes < 1) chunkBytes = 1;
+        std::vector<size_t> bounds(1, 0);
+        while (bounds.back() < size) {
+            size_t target = bounds.back() + chunkBytes;
+            if (target >= size) {
+                bounds.push_back(size);
+                break;
+            }
+            // a record longer than chunkBytes just makes its chunk bigger
+            const void *found = memchr(data + target, delimiter, size - target);
+            bounds.push_back(found ? (size_t)((const char *)found - data) + 1 : size);
+        }
+        return bounds;
+    }
+
+    int chunk_count() const {return _bounds.empty() ? 0 : (int)_bounds.size() - 1;}
+
+    // the records of chunk i, a view into the mapped file
+    std::string_view chunk(int i) const {
+        return std::string_view(_file.data() + _bounds[i], _bounds[i+1] - _bounds[i]);
+    }
+
+    const mapped_file &file() const {return _file;}
+
+    // runs do_chunk over every chunk on a scheduler, returns when all are done
+    void run(int threadCount=0) {
+        _advised = 0;
+        advise_through(CHUNKER_PREFETCH_AHEAD);
+        run_work(this, chunk_count(), threadCount);
+    }
+
+    // called once per chunk, from the pool's threads.  chunkIndex is in file order.
+    virtual void do_chunk(int chunkIndex, std::string_view records) =0;
+
+    void do_work(int work) {
+        // the scheduler hands out indexes in order, so work is the claiming cursor
+        advise_through(work + 1 + CHUNKER_PREFETCH_AHEAD);
+        do_chunk(work, chunk(work));
+    }
+
+private:
+    mapped_file _file;
+    std::vector<size_t> _bounds;    // chunk i is [_bounds[i], _bounds[i+1])
+    std::atomic<int> _advised;      // chunks below this have had their WILLNEED hint
+
+    // hints every chunk below end that hasn't been hinted yet, each exactly once
+    void advise_through(int end) {
+        end = std::min(end, chunk_count());
+        int from = _advised.load();
+        while (from < end) {
+            if (_advised.compare_exchange_weak(from, end)) {
+                _file.will_need(_bounds[from], _bounds[end] - _bounds[from]);
+                return;
+            }
+        }
+    }
+};
+
+// the lambda form:  maps path and calls f(chunkIndex, records) for every chunk across
+// the thread pool.  returns false if the file can't be mapped.
+template <typename F>
+bool process_file_chunks(const char *path, F f, size_t chunkBytes=CHUNKER_DEFAULT_BYTES, char delimiter='\n', int threadCount=0) {
+    struct lambda_chunker : file_chunker {
+        F &_f;
+        lambda_chunker(F &f) : _f(f) {}
+        void do_chunk(int chunkIndex, std::string_view records) {_f(chunkIndex, records);}
+    };
+    lambda_chunker chunker(f);
+    if (!chunker.open(path, chunkBytes, delimiter)) return false;
+    chunker.run(threadCount);
+    return true;
+}
+
+#endif /* file_chunker_h */
@@ -0,0 +1,242 @@
+//
+//  graph.h
+//  A compressed sparse row (CSR) graph, and parallel traversals over it on the scheduler.
+//  parallel_bfs - direction optimizing breadth first search.  Each level is one
+//      scheduler run over the frontier (top down) or over the unvisited vertices
+//      (bottom up), switching between them on the frontier's size.  Visited
+//      vertices are an atomic bitmap, new frontier vertices go to per thread
+//      buffers that are concatenated between levels.
+//  parallel_connected_components - lock free union-find, one work item per
+//      range of vertices linking along their edges, then a parallel path
+//      compression pass that turns parents into component labels.
+//
+
+#ifndef graph_h
+#define graph_h
+
+#include "scheduler.h"
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+// vertices per work item for the passes that walk every vertex
+#define GRAPH_VERTEX_TILE   4096    // a multiple of 64, so a tile owns whole bitmap words
+
+// frontier vertices per work item in a top down BFS step
+#define GRAPH_FRONTIER_TILE 1024
+
+// direction optimizing thresholds, from Beamer et al.:  go bottom up when the
+// frontier's edges are more than 1/ALPHA of the unexplored edges, go back top
+// down when the frontier shrinks below 1/BETA of the vertices
+#define GRAPH_BFS_ALPHA 14
+#define GRAPH_BFS_BETA  24
+
+struct csr_graph {
+    std::vector<size_t> offsets;    // vertex v's neighbors are edges[offsets[v] .. offsets[v+1])
+    std::vector<uint32_t> edges;
+    bool symmetric;                 // every edge is stored in both directions
+
+    csr_graph() : offsets(1, 0), symmetric(true) {}
+
+    uint32_t vertex_count() const {return (uint32_t)(offsets.size() - 1);}
+    size_t edge_count() const {return edges.size();}
+    size_t degree(uint32_t v) const {return offsets[v+1] - offsets[v];}
+
+    // builds the CSR arrays from an edge list.  With undirected each (a, b) is
+    // also stored as (b, a), and the graph is marked symmetric.
+    static csr_graph from_edges(uint32_t vertexCount, const std::vector<std::pair<uint32_t, uint32_t>> &edgeList, bool undirected=true) {
+        csr_graph g;
+        g.symmetric = undirected;
+        g.offsets.assign((size_t)vertexCount + 1, 0);
+        for (auto &e : edgeList) {
+            ++g.offsets[e.first + 1];
+            if (undirected) ++g.offsets[e.second + 1];
+        }
+        for (uint32_t v = 0; v < vertexCount; ++v) g.offsets[v+1] += g.offsets[v];
+        g.edges.resize(g.offsets[vertexCount]);
+        std::vector<size_t> fill(g.offsets.begin(), g.offsets.end() - 1);
+        for (auto &e : edgeList) {
+            g.edges[fill[e.first]++] = e.second;
+            if (undirected) g.edges[fill[e.second]++] = e.first;
+        }
+        return g;
+    }
+};
+
+inline int graph_vertex_tiles(uint32_t vertexCount) {
+    return (int)(((size_t)vertexCount + GRAPH_VERTEX_TILE - 1) / GRAPH_VERTEX_TILE);
+}
+
+//-------------------------------------------------------------------------
+// BFS
+
+// sets bit v, returns true if this call is the one that set it
+inline bool graph_claim(std::vector<std::atomic<uint64_t>> &bits, uint32_t v) {
+    const uint64_t mask = (uint64_t)1 << (v & 63);
+    if (bits[v >> 6].load(std::memory_order_relaxed) & mask) return false;   // cheap test before the atomic write
+    return !(bits[v >> 6].fetch_or(mask, std::memory_order_relaxed) & mask);
+}
+
+inline bool graph_test(const std::vector<std::atomic<uint64_t>> &bits, uint32_t v) {
+    return (bits[v >> 6].load(std::memory_order_relaxed) >> (v & 63)) & 1;
+}
+
+// depth[v] = number of edges on the shortest path from source to v, -1 if unreachable.
+// Bottom up steps need incoming edges, so they are only used on symmetric graphs.
+inline void parallel_bfs(const csr_graph &g, uint32_t source, std::vector<int32_t> &depth, int threadCount=0) {
+    const uint32_t n = g.vertex_count();
+    depth.assign(n, -1);
+    if (source >= n) return;
+    const int threads = scheduler::resolve_thread_count(threadCount);
+
+    std::vector<std::atomic<uint64_t>> visited(((size_t)n + 63) / 64);
+    std::vector<std::atomic<uint64_t>> inFrontier(visited.size());
+    for (auto &w : visited) w.store(0, std::memory_order_relaxed);
+    std::vector<std::vector<uint32_t>> threadNext(threads);
+    std::vector<size_t> threadNextEdges(threads, 0);   // sum of the degrees in threadNext
+
+    std::vector<uint32_t> frontier(1, source);
+    graph_claim(visited, source);
+    depth[source] = 0;
+    size_t frontierEdges = g.degree(source);
+    size_t unexploredEdges = g.edge_count() - frontierEdges;
+    bool bottomUp = false;
+
+    for (int32_t level = 0; !frontier.empty(); ++level) {
+        if (g.symmetric) {
+            if (!bottomUp && frontierEdges > unexploredEdges / GRAPH_BFS_ALPHA) bottomUp = true;
+            else if (bottomUp && frontier.size() < n / GRAPH_BFS_BETA) bottomUp = false;
+        }
+
+        if (bottomUp) {
+            // every unvisited vertex looks for a parent in the frontier
+            for (auto &w : inFrontier) w.store(0, std::memory_order_relaxed);
+            parallel_for((int)((frontier.size() + GRAPH_FRONTIER_TILE - 1) / GRAPH_FRONTIER_TILE), [&](int t) {
+                size_t last = std::min((size_t)(t+1) * GRAPH_FRONTIER_TILE, frontier.size());
+                for (size_t i = (size_t)t * GRAPH_FRONTIER_TILE; i < last; ++i) graph_claim(inFrontier, frontier[i]);
+            }, threads);
+            parallel_for(graph_vertex_tiles(n), [&](int t) {
+                std::vector<uint32_t> &next = threadNext[scheduler::thread_index()];
+                size_t &nextEdges = threadNextEdges[scheduler::thread_index()];
+                uint32_t last = (uint32_t)std::min((size_t)(t+1) * GRAPH_VERTEX_TILE, (size_t)n);
+                for (uint32_t v = t * GRAPH_VERTEX_TILE; v < last; ++v) {
+                    if (graph_test(visited, v)) continue;
+                    for (size_t e = g.offsets[v]; e < g.offsets[v+1]; ++e) {
+                        if (graph_test(inFrontier, g.edges[e])) {
+                            graph_claim(visited, v);
+                            depth[v] = level + 1;
+                            next.push_back(v);
+                            nextEdges += g.degree(v);
+                            break;
+                        }
+                    }
+                }
+            }, threads);
+        } else {
+            // every frontier vertex claims its unvisited neighbors
+            int tiles = (int)((frontier.size() + GRAPH_FRONTIER_TILE - 1) / GRAPH_FRONTIER_TILE);
+            parallel_for(tiles, [&](int t) {
+                std::vector<uint32_t> &next = threadNext[scheduler::thread_index()];
+                size_t &nextEdges = threadNextEdges[scheduler::thread_index()];
+                size_t last = std::min((size_t)(t+1) * GRAPH_FRONTIER_TILE, frontier.size());
+                for (size_t i = (size_t)t * GRAPH_FRONTIER_TILE; i < last; ++i) {
+                    uint32_t v = frontier[i];
+                    for (size_t e = g.offsets[v]; e < g.offsets[v+1]; ++e) {
+                        uint32_t u = g.edges[e];
+                        if (graph_claim(visited, u)) {
+                            depth[u] = level + 1;
+                            next.push_back(u);
+                            nextEdges += g.degree(u);
+                        }
+                    }
+                }
+            }, threads);
+        }
+
+        // concatenate the per thread buffers into the next frontier
+        std::vector<size_t> offsets(threads + 1, 0);
+        frontierEdges = 0;
+        for (int t = 0; t < threads; ++t) {
+            offsets[t+1] = offsets[t] + threadNext[t].size();
+            frontierEdges += threadNextEdges[t];
+            threadNextEdges[t] = 0;
+        }
+        frontier.resize(offsets[threads]);
+        parallel_for(threads, [&](int t) {
+            std::copy(threadNext[t].begin(), threadNext[t].end(), frontier.begin() + offsets[t]);
+            threadNext[t].clear();
+        }, threads);
+        unexploredEdges -= std::min(unexploredEdges, frontierEdges);
+    }
+}
+
+//-------------------------------------------------------------------------
+// connected components
+
+// root of v, halving the path on the way.  Only non-roots are rewritten, and
+// always to one of their ancestors, so racing with other finds and links is safe.
+inline uint32_t graph_find(std::vector<std::atomic<uint32_t>> &parent, uint32_t v) {
+    uint32_t p = parent[v].load(std::memory_order_relaxed);
+    while (p != v) {
+        uint32_t gp = parent[p].load(std::memory_order_relaxed);
+        if (gp != p) parent[v].store(gp, std::memory_order_relaxed);
+        v = p;
+        p = gp;
+    }
+    return v;
+}
+
+// joins the sets of a and b, always hanging the larger root under the smaller
+inline void graph_link(std::vector<std::atomic<uint32_t>> &parent, uint32_t a, uint32_t b) {
+    for (;;) {
+        uint32_t ra = graph_find(parent, a);
+        uint32_t rb = graph_find(parent, b);
+        if (ra == rb) return;
+        if (ra < rb) std::swap(ra, rb);
+        uint32_t expected = ra;     // only succeeds if ra is still a root
+        if (parent[ra].compare_exchange_weak(expected, rb, std::memory_order_relaxed)) return;
+    }
+}
+
+// label[v] = the smallest vertex id in v's connected component.
+// Edges are treated as undirected.  Returns the number of components.
+inline uint32_t parallel_connected_components(const csr_graph &g, std::vector<uint32_t> &label, int threadCount=0) {
+    const uint32_t n = g.vertex_count();
+    std::vector<std::atomic<uint32_t>> parent(n);
+    int tiles = graph_vertex_tiles(n);
+
+    parallel_for(tiles, [&](int t) {
+        uint32_t last = (uint32_t)std::min((size_t)(t+1) * GRAPH_VERTEX_TILE, (size_t)n);
+        for (uint32_t v = t * GRAPH_VERTEX_TILE; v < last; ++v) parent[v].store(v, std::memory_order_relaxed);
+    }, threadCount);
+
+    parallel_for(tiles, [&](int t) {
+        uint32_t last = (uint32_t)std::min((size_t)(t+1) * GRAPH_VERTEX_TILE, (size_t)n);
+        for (uint32_t v = t * GRAPH_VERTEX_TILE; v < last; ++v) {
+            for (size_t e = g.offsets[v]; e < g.offsets[v+1]; ++e) {
+                // on a symmetric graph each edge shows up twice, only link it once
+                if (!g.symmetric || v < g.edges[e]) graph_link(parent, v, g.edges[e]);
+            }
+        }
+    }, threadCount);
+
+    // every link has finished, so roots are final; flatten and count them
+    label.resize(n);
+    std::vector<uint32_t> roots(tiles, 0);
+    parallel_for(tiles, [&](int t) {
+        uint32_t last = (uint32_t)std::min((size_t)(t+1) * GRAPH_VERTEX_TILE, (size_t)n);
+        for (uint32_t v = t * GRAPH_VERTEX_TILE; v < last; ++v) {
+            label[v] = graph_find(parent, v);
+            if (label[v] == v) ++roots[t];
+        }
+    }, threadCount);
+
+    uint32_t components = 0;
+    for (uint32_t r : roots) components += r;
+    return components;
+}
+
+#endif /* graph_h */
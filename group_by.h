@@ -0,0 +1,310 @@
+//
+//  group_by.h
+//  Parallel histogram / group-by on the scheduler:  bucket N rows into K bins
+//  by a key column, and reduce one or more value columns per bin with sum,
+//  min, max or count.  Input is struct-of-arrays, one array per column.
+//
+//  Two strategies, picked by how big the bins are:
+//  small K - every pool thread accumulates into its own private copy of the
+//            bins (found with scheduler::thread_index()), then the copies are
+//            combined, a range of bins per work item.
+//  large K - private copies would not fit in cache, so the rows (each key
+//            with all its columns' values side by side) are first partitioned
+//            by key range (per tile histograms, prefix sum, scatter), then
+//            each partition is one work item that reads its rows in order and
+//            reduces them straight into its own, cache sized, range of bins.
+//            A scatter writes to at most GROUP_BY_MAX_PARTITIONS places;
+//            ranges still too big for cache are split again inside the item.
+//            On one thread this is about as fast as the serial loop, but it
+//            streams memory and scales with threads, where the loop's random
+//            updates to bins far bigger than cache can't be shared out.
+//
+
+#ifndef group_by_h
+#define group_by_h
+
+#include "scheduler.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <vector>
+
+// rows per work item in the accumulate and partition passes
+#define GROUP_BY_TILE   (1 << 16)
+
+// bytes of bins (all columns) one thread can keep hot.  Below this every
+// thread gets private bins, above it the partitioned strategy is used, with
+// partitions of this size (of one column's bins).
+#define GROUP_BY_CACHE_BYTES    (256 * 1024)
+
+// the most partitions one scatter pass writes to;  bigger key ranges get another pass
+#define GROUP_BY_MAX_PARTITIONS 1024
+
+// rows staged per partition before the partitioned strategy's scatter writes them out
+#define GROUP_BY_WC_COUNT       16
+
+// the most tiles the partitioned strategy cuts the rows into, which caps its
+// per tile histograms at GROUP_BY_MAX_TILES * GROUP_BY_MAX_PARTITIONS counts
+#define GROUP_BY_MAX_TILES      1024
+
+enum group_by_op {
+    GROUP_SUM,
+    GROUP_MIN,
+    GROUP_MAX,
+    GROUP_COUNT     // number of rows in the bin, values is not read and may be null
+};
+
+// one value column to reduce, and where its per bin results go
+template <typename V>
+struct group_by_column {
+    const V *values;    // one per row
+    group_by_op op;
+    V *out;             // one per bin.  Empty bins get group_by_identity(op).
+};
+
+// what an empty bin holds, and what accumulation starts from
+template <typename V>
+V group_by_identity(group_by_op op) {
+    switch (op) {
+        case GROUP_MIN: return std::numeric_limits<V>::max();
+        case GROUP_MAX: return std::numeric_limits<V>::lowest();
+        default:        return V(0);
+    }
+}
+
+// merges the partial result b into a
+template <typename V>
+void group_by_combine(group_by_op op, V &a, V b) {
+    switch (op) {
+        case GROUP_MIN: if (b < a) a = b; break;
+        case GROUP_MAX: if (a < b) a = b; break;
+        default:        a += b; break;
+    }
+}
+
+// reduces the rows named by rows[0..count) of one column into bins.
+// bins is already offset so that bins[key - firstBin] is the row's bin.
+// rows == nullptr means the rows are first .. first+count-1.
+// The op switch is hoisted out of the loop so each case is a tight loop.
+template <typename V>
+void group_by_accumulate(const uint32_t *keys, const group_by_column<V> &column, V *bins, uint32_t firstBin,
+                         size_t first, size_t count, const size_t *rows) {
+#define GROUP_BY_LOOP(expr) \
+    for (size_t i = 0; i < count; ++i) { \
+        size_t r = rows ? rows[i] : first + i; \
+        V &bin = bins[keys[r] - firstBin]; \
+        expr; \
+    }
+    switch (column.op) {
+        case GROUP_SUM:     GROUP_BY_LOOP(bin += column.values[r]) break;
+        case GROUP_MIN:     GROUP_BY_LOOP(if (column.values[r] < bin) bin = column.values[r]) break;
+        case GROUP_MAX:     GROUP_BY_LOOP(if (bin < column.values[r]) bin = column.values[r]) break;
+        case GROUP_COUNT:   GROUP_BY_LOOP(bin += V(1)) break;
+    }
+#undef GROUP_BY_LOOP
+}
+
+//-------------------------------------------------------------------------
+
+// small K:  private bins per thread, then combine
+template <typename V>
+void group_by_private(const uint32_t *keys, size_t n, uint32_t binCount, std::vector<group_by_column<V>> &columns, int threadCount) {
+    int threads = scheduler::resolve_thread_count(threadCount);
+    size_t stride = (size_t)binCount * columns.size();     // one thread's bins, all columns
+    std::vector<V> bins(stride * threads);
+    for (int t = 0; t < threads; ++t) {
+        for (size_t c = 0; c < columns.size(); ++c) {
+            std::fill(bins.begin() + t*stride + c*binCount, bins.begin() + t*stride + (c+1)*binCount,
+                      group_by_identity<V>(columns[c].op));
+        }
+    }
+
+    int tiles = (int)((n + GROUP_BY_TILE - 1) / GROUP_BY_TILE);
+    parallel_for(tiles, [&](int tile) {
+        V *mine = &bins[stride * scheduler::thread_index()];
+        size_t first = (size_t)tile * GROUP_BY_TILE;
+        size_t count = std::min((size_t)GROUP_BY_TILE, n - first);
+        for (size_t c = 0; c < columns.size(); ++c) {
+            group_by_accumulate(keys, columns[c], mine + c*binCount, 0, first, count, (const size_t *)nullptr);
+        }
+    }, threads);
+
+    // combine the threads' copies, a range of bins at a time
+    const size_t binsPerItem = 4096;
+    int items = (int)(((size_t)binCount + binsPerItem - 1) / binsPerItem);
+    parallel_for(items, [&](int item) {
+        size_t first = (size_t)item * binsPerItem;
+        size_t last = std::min(first + binsPerItem, (size_t)binCount);
+        for (size_t c = 0; c < columns.size(); ++c) {
+            for (size_t b = first; b < last; ++b) {
+                V result = bins[c*binCount + b];
+                for (int t = 1; t < threads; ++t) {
+                    group_by_combine(columns[c].op, result, bins[t*stride + c*binCount + b]);
+                }
+                columns[c].out[b] = result;
+            }
+        }
+    }, threads);
+}
+
+// folds the rows of one partition into out[key], for one column.  values holds stride values
+// per row, this column's first.  The op switch is hoisted out of the loop.
+template <typename V>
+void group_by_accumulate_partition(group_by_op op, const uint32_t *keys, const V *values, size_t stride, size_t count, V *out) {
+    switch (op) {
+        case GROUP_MIN:
+            for (size_t i = 0; i < count; ++i) if (values[i * stride] < out[keys[i]]) out[keys[i]] = values[i * stride];
+            break;
+        case GROUP_MAX:
+            for (size_t i = 0; i < count; ++i) if (out[keys[i]] < values[i * stride]) out[keys[i]] = values[i * stride];
+            break;
+        case GROUP_COUNT:
+            for (size_t i = 0; i < count; ++i) out[keys[i]] += V(1);
+            break;
+        default:
+            for (size_t i = 0; i < count; ++i) out[keys[i]] += values[i * stride];
+            break;
+    }
+}
+
+// reduces rows [first, first+count) of the partitioned keys and values, whose keys are all in
+// [firstBin, firstBin + 2^bits), into the columns' bins.  A range bigger than 2^cacheBits bins is
+// first split on its next key bits by a counting sort into the scratch arrays, at most
+// 2^maxFanoutBits ways, and each piece recursed on.
+template <typename V>
+void group_by_reduce_range(std::vector<group_by_column<V>> &columns, uint32_t *keys, V *values, uint32_t *scratchKeys, V *scratchValues,
+                           size_t count, size_t firstBin, int bits, int cacheBits, int maxFanoutBits) {
+    size_t stride = columns.size();
+    if (bits <= cacheBits || count < 2) {
+        for (size_t c = 0; c < stride; ++c) group_by_accumulate_partition(columns[c].op, keys, values + c, stride, count, columns[c].out);
+        return;
+    }
+    int subBits = std::max(cacheBits, bits - maxFanoutBits);
+    size_t pieces = (size_t)1 << (bits - subBits);
+    std::vector<size_t> start(pieces + 1, 0);
+    for (size_t i = 0; i < count; ++i) ++start[((keys[i] - firstBin) >> subBits) + 1];
+    for (size_t p = 0; p < pieces; ++p) start[p + 1] += start[p];
+    std::vector<size_t> dest(start.begin(), start.end() - 1);
+    for (size_t i = 0; i < count; ++i) {
+        size_t d = dest[(keys[i] - firstBin) >> subBits]++;
+        scratchKeys[d] = keys[i];
+        std::copy(values + i * stride, values + (i + 1) * stride, scratchValues + d * stride);
+    }
+    for (size_t p = 0; p < pieces; ++p) {
+        group_by_reduce_range(columns, scratchKeys + start[p], scratchValues + start[p] * stride, keys + start[p], values + start[p] * stride,
+                              start[p + 1] - start[p], firstBin + (p << subBits), subBits, cacheBits, maxFanoutBits);
+    }
+}
+
+// large K:  partition the rows - each key with its row's values, all columns side by side - by key
+// range, then reduce each partition into its own, cache sized, range of bins.  One scatter pass
+// writes to at most maxPartitions places;  when that leaves partitions bigger than cache, each is
+// split again inside its work item.
+template <typename V>
+void group_by_partitioned(const uint32_t *keys, size_t n, uint32_t binCount, std::vector<group_by_column<V>> &columns, int threadCount,
+                          int maxPartitions=GROUP_BY_MAX_PARTITIONS) {
+    const size_t stride = columns.size();
+    // bins (all columns) that fit in cache, and bins per partition:  powers of two so a row's partition is a shift
+    int cacheBits = 0;
+    while (((size_t)2 << cacheBits) * stride * sizeof(V) <= GROUP_BY_CACHE_BYTES) ++cacheBits;
+    int fanoutBits = 0;
+    while (((size_t)2 << fanoutBits) <= (size_t)std::max(maxPartitions, 1)) ++fanoutBits;
+    int shift = cacheBits;
+    while ((((size_t)binCount - 1) >> shift) + 1 > ((size_t)1 << fanoutBits)) ++shift;
+    const int partitions = (int)((((size_t)binCount - 1) >> shift) + 1);
+
+    // phase one:  count, prefix sum, scatter.  At most GROUP_BY_MAX_TILES tiles, so the tiles x
+    // partitions offsets stay small however big n is.
+    size_t tileRows = std::max((size_t)GROUP_BY_TILE, (n + GROUP_BY_MAX_TILES - 1) / GROUP_BY_MAX_TILES);
+    int tiles = (int)((n + tileRows - 1) / tileRows);
+    std::vector<size_t> offsets((size_t)tiles * partitions, 0);
+    parallel_for(tiles, [&](int tile) {
+        size_t *hist = &offsets[(size_t)tile * partitions];
+        size_t last = std::min((size_t)(tile+1) * tileRows, n);
+        for (size_t r = (size_t)tile * tileRows; r < last; ++r) ++hist[keys[r] >> shift];
+    }, threadCount);
+
+    std::vector<size_t> partitionStart(partitions + 1);
+    size_t running = 0;
+    for (int p = 0; p < partitions; ++p) {
+        partitionStart[p] = running;
+        for (int tile = 0; tile < tiles; ++tile) {
+            size_t count = offsets[(size_t)tile * partitions + p];
+            offsets[(size_t)tile * partitions + p] = running;
+            running += count;
+        }
+    }
+    partitionStart[partitions] = running;
+
+    // each row's key, and its values row major, so a partition is read front to back.  Rows are
+    // staged per partition and written out GROUP_BY_WC_COUNT at a time, as in parallel_sort.h,
+    // so the stores to many partitions stay in a few cache lines each.  Left uninitialized:
+    // every element is written.
+    std::unique_ptr<uint32_t[]> partKeys(new uint32_t[n]);
+    std::unique_ptr<V[]> partValues(new V[n * stride]);
+    parallel_for(tiles, [&](int tile) {
+        size_t *dest = &offsets[(size_t)tile * partitions];
+        std::vector<uint32_t> keyBuffer((size_t)partitions * GROUP_BY_WC_COUNT);
+        std::vector<V> valueBuffer((size_t)partitions * GROUP_BY_WC_COUNT * stride);
+        std::vector<int> fill(partitions, 0);
+
+        auto flush = [&](int p) {
+            std::copy(&keyBuffer[(size_t)p * GROUP_BY_WC_COUNT], &keyBuffer[(size_t)p * GROUP_BY_WC_COUNT] + fill[p], &partKeys[dest[p]]);
+            std::copy(&valueBuffer[(size_t)p * GROUP_BY_WC_COUNT * stride], &valueBuffer[(size_t)p * GROUP_BY_WC_COUNT * stride] + fill[p] * stride,
+                      &partValues[dest[p] * stride]);
+            dest[p] += fill[p];
+            fill[p] = 0;
+        };
+
+        size_t last = std::min((size_t)(tile+1) * tileRows, n);
+        for (size_t r = (size_t)tile * tileRows; r < last; ++r) {
+            int p = (int)(keys[r] >> shift);
+            size_t slot = (size_t)p * GROUP_BY_WC_COUNT + fill[p];
+            keyBuffer[slot] = keys[r];
+            V *v = &valueBuffer[slot * stride];
+            for (size_t c = 0; c < stride; ++c) v[c] = columns[c].values ? columns[c].values[r] : V(0);
+            if (++fill[p] == GROUP_BY_WC_COUNT) flush(p);
+        }
+        for (int p = 0; p < partitions; ++p) {
+            if (fill[p]) flush(p);
+        }
+    }, threadCount);
+
+    // phase two:  each partition owns its range of bins outright, no combining needed
+    std::vector<uint32_t> scratchKeys(shift > cacheBits ? n : 0);      // only for a second split
+    std::vector<V> scratchValues(shift > cacheBits ? n * stride : 0);
+    parallel_for(partitions, [&](int p) {
+        size_t firstBin = (size_t)p << shift;
+        size_t lastBin = std::min(firstBin + ((size_t)1 << shift), (size_t)binCount);
+        for (size_t c = 0; c < stride; ++c) std::fill(columns[c].out + firstBin, columns[c].out + lastBin, group_by_identity<V>(columns[c].op));
+        size_t begin = partitionStart[p];
+        group_by_reduce_range(columns, partKeys.get() + begin, partValues.get() + begin * stride,
+                              scratchKeys.data() + begin, scratchValues.data() + begin * stride,
+                              partitionStart[p+1] - begin, firstBin, shift, cacheBits, fanoutBits);
+    }, threadCount);
+}
+
+//-------------------------------------------------------------------------
+
+// reduces each column into binCount bins, row r going to bin keys[r].
+// Every key must be less than binCount.
+template <typename V>
+void parallel_group_by(const uint32_t *keys, size_t n, uint32_t binCount, std::vector<group_by_column<V>> columns, int threadCount=0) {
+    if (binCount == 0 || columns.empty()) return;
+    size_t binBytes = (size_t)binCount * columns.size() * sizeof(V);
+    if (binBytes <= GROUP_BY_CACHE_BYTES) {
+        group_by_private(keys, n, binCount, columns, threadCount);
+    } else {
+        group_by_partitioned(keys, n, binCount, columns, threadCount);
+    }
+}
+
+// counts[k] = number of rows with keys[r] == k.  Every key must be less than binCount.
+inline void parallel_histogram(const uint32_t *keys, size_t n, uint32_t binCount, size_t *counts, int threadCount=0) {
+    group_by_column<size_t> column = {nullptr, GROUP_COUNT, counts};
+    parallel_group_by(keys, n, binCount, std::vector<group_by_column<size_t>>(1, column), threadCount);
+}
+
+#endif /* group_by_h */
@@ -0,0 +1,154 @@
+//
+//  hash_join.h
+//  Radix partitioned parallel hash join of two in-memory tables on the scheduler.
+//  Both sides are partitioned on the low bits of the key's hash, picking
+//  enough bits that one partition of the build side fits in cache.  Then each
+//  partition is one work item:  build an open addressed table from the build
+//  side's partition, probe it with the probe side's matching partition.
+//  Matches go to a buffer per pool thread (scheduler::thread_index()) and are
+//  gathered into one result after the scheduler's join().
+//
+
+#ifndef hash_join_h
+#define hash_join_h
+
+#include "scheduler.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <vector>
+
+// rows per work item in the partitioning passes
+#define JOIN_TILE   (1 << 16)
+
+// target bytes of build side (entries + hash table) per partition
+#define JOIN_PARTITION_BYTES    (256 * 1024)
+
+// one output row:  build side row number, probe side row number
+struct join_match {
+    size_t build;
+    size_t probe;
+};
+
+// 64 bit finalizer from MurmurHash3, mixes every key bit into every hash bit
+inline uint64_t join_hash(uint64_t key) {
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+    key *= 0xc4ceb9fe1a85ec53ULL;
+    key ^= key >> 33;
+    return key;
+}
+
+// a key and the row it came from, what partitioning produces
+template <typename K>
+struct join_entry {
+    K key;
+    size_t row;
+};
+
+// scatters keys[0..n) into entries, grouped by the low `bits` bits of their hash.
+// partition p is entries[start[p] .. start[p+1]).  Order within a partition is the row order.
+template <typename K>
+void join_partition(const K *keys, size_t n, int bits, std::vector<join_entry<K>> &entries, std::vector<size_t> &start, int threadCount) {
+    const int partitions = 1 << bits;
+    const uint64_t mask = partitions - 1;
+    int tiles = (int)((n + JOIN_TILE - 1) / JOIN_TILE);
+
+    std::vector<size_t> offsets((size_t)tiles * partitions, 0);
+    parallel_for(tiles, [&](int t) {
+        size_t *hist = &offsets[(size_t)t * partitions];
+        size_t last = std::min((size_t)(t+1) * JOIN_TILE, n);
+        for (size_t r = (size_t)t * JOIN_TILE; r < last; ++r) ++hist[join_hash((uint64_t)keys[r]) & mask];
+    }, threadCount);
+
+    start.assign(partitions + 1, 0);
+    size_t running = 0;
+    for (int p = 0; p < partitions; ++p) {
+        start[p] = running;
+        for (int t = 0; t < tiles; ++t) {
+            size_t count = offsets[(size_t)t * partitions + p];
+            offsets[(size_t)t * partitions + p] = running;
+            running += count;
+        }
+    }
+    start[partitions] = running;
+
+    entries.resize(n);
+    parallel_for(tiles, [&](int t) {
+        size_t *dest = &offsets[(size_t)t * partitions];
+        size_t last = std::min((size_t)(t+1) * JOIN_TILE, n);
+        for (size_t r = (size_t)t * JOIN_TILE; r < last; ++r) {
+            join_entry<K> &e = entries[dest[join_hash((uint64_t)keys[r]) & mask]++];
+            e.key = keys[r];
+            e.row = r;
+        }
+    }, threadCount);
+}
+
+// inner join on buildKeys[i] == probeKeys[j].  Every matching (i, j) pair is
+// appended to matches, in no particular order.  Duplicate keys on either side
+// are fine.  Build the smaller table for the best cache behavior.
+template <typename K>
+void parallel_hash_join(const K *buildKeys, size_t buildRows, const K *probeKeys, size_t probeRows,
+                        std::vector<join_match> &matches, int threadCount=0) {
+    static_assert(std::is_integral<K>::value, "hash join keys must be integers");
+    int threads = scheduler::resolve_thread_count(threadCount);
+
+    // enough partitions that a build partition's entries and its table (2 slots per entry) fit in cache
+    const size_t bytesPerRow = sizeof(join_entry<K>) + 2 * sizeof(uint32_t);
+    int bits = 0;
+    while (bits < 16 && (buildRows >> bits) * bytesPerRow > JOIN_PARTITION_BYTES) ++bits;
+
+    std::vector<join_entry<K>> build, probe;
+    std::vector<size_t> buildStart, probeStart;
+    join_partition(buildKeys, buildRows, bits, build, buildStart, threads);
+    join_partition(probeKeys, probeRows, bits, probe, probeStart, threads);
+
+    // per thread output and hash table, reused across the partitions a thread runs
+    std::vector<std::vector<join_match>> threadMatches(threads);
+    std::vector<std::vector<uint32_t>> threadTables(threads);
+
+    parallel_for(1 << bits, [&](int p) {
+        const join_entry<K> *b = build.data() + buildStart[p];
+        const uint32_t buildCount = (uint32_t)(buildStart[p+1] - buildStart[p]);
+        const join_entry<K> *pr = probe.data() + probeStart[p];
+        const size_t probeCount = probeStart[p+1] - probeStart[p];
+        if (buildCount == 0 || probeCount == 0) return;
+
+        // open addressing, linear probing.  Slots hold entry number + 1, 0 is empty.
+        // The low bits of the hash picked the partition, so the slot uses the high bits.
+        int slotBits = 1;
+        while (((size_t)1 << slotBits) < 2 * (size_t)buildCount) ++slotBits;
+        const uint32_t slotMask = ((uint32_t)1 << slotBits) - 1;
+        std::vector<uint32_t> &table = threadTables[scheduler::thread_index()];
+        table.assign((size_t)1 << slotBits, 0);
+
+        for (uint32_t i = 0; i < buildCount; ++i) {
+            uint32_t slot = (uint32_t)(join_hash((uint64_t)b[i].key) >> 32) & slotMask;
+            while (table[slot]) slot = (slot + 1) & slotMask;
+            table[slot] = i + 1;
+        }
+
+        std::vector<join_match> &out = threadMatches[scheduler::thread_index()];
+        for (size_t j = 0; j < probeCount; ++j) {
+            uint32_t slot = (uint32_t)(join_hash((uint64_t)pr[j].key) >> 32) & slotMask;
+            while (table[slot]) {
+                const join_entry<K> &e = b[table[slot] - 1];
+                if (e.key == pr[j].key) out.push_back({e.row, pr[j].row});
+                slot = (slot + 1) & slotMask;
+            }
+        }
+    }, threads);
+
+    // gather the per thread buffers, each thread's copy being a work item
+    std::vector<size_t> offsets(threads + 1, matches.size());
+    for (int t = 0; t < threads; ++t) offsets[t+1] = offsets[t] + threadMatches[t].size();
+    matches.resize(offsets[threads]);
+    parallel_for(threads, [&](int t) {
+        std::copy(threadMatches[t].begin(), threadMatches[t].end(), matches.begin() + offsets[t]);
+    }, threads);
+}
+
+#endif /* hash_join_h */
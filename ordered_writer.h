@@ -0,0 +1,187 @@
+//
+//  ordered_writer.h
+//  Writes the output chunks of a parallel job into one file, in index order,
+//  while the job is still running.  Chunk i's offset is the sum of the sizes
+//  of chunks 0..i-1, so it is known once every earlier chunk has been handed
+//  in;  a running prefix sum advances over the chunks as they arrive.  A chunk
+//  whose offset is already known is pwrite()n by the thread handing it in.
+//  One handed in early is parked, and once its offset is known it joins a
+//  queue of writes that every thread with nothing else to do takes from
+//  (write_resolved()), so when chunk 0 is the slow one the chunks it unblocks
+//  are written by many threads, not by the one that finished it.  Writes
+//  happen outside the lock, and a chunk's buffer is moved in, never copied.
+//
+//  POSIX only (pwrite).
+//
+
+#ifndef ordered_writer_h
+#define ordered_writer_h
+
+#include "scheduler.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+struct ordered_writer {
+    ordered_writer() : _fd(-1), _count(0), _next(0), _offset(0), _failed(false), _writing(0), _peakWriting(0) {}
+    ~ordered_writer() {close();}
+
+    // creates (or truncates) path, for chunkCount chunks.  false if it can't be opened.
+    bool open(const char *path, int chunkCount) {
+        close();
+        _fd = ::open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (_fd < 0) return false;
+        _count = chunkCount;
+        _next = 0;
+        _offset = 0;
+        _failed = false;
+        _pending.assign(chunkCount, std::string());
+        _arrived.assign(chunkCount, 0);
+        _offsets.assign(chunkCount, 0);
+        _ready.clear();
+        _writing = 0;
+        _peakWriting = 0;
+        return true;
+    }
+
+    // hands in chunk index, from any thread, once per index.  If every earlier chunk is
+    // already in, this writes it, queues the parked chunks it unblocked, and helps write them.
+    void write_chunk(int index, std::string &&data) {
+        uint64_t offset;
+        bool queued;
+        {
+            std::lock_guard<std::mutex> lk(_mutex);
+            if (index != _next) {
+                // an earlier chunk is still being computed, park this one
+                _pending[index] = std::move(data);
+                _arrived[index] = 1;
+                return;
+            }
+            offset = _offset;
+            _offset += data.size();
+            ++_next;
+            queued = _next == _count;   // write_resolved() callers can stop waiting
+            while (_next < _count && _arrived[_next]) {
+                _offsets[_next] = _offset;
+                _offset += _pending[_next].size();
+                _ready.push_back(_next);
+                ++_next;
+                queued = true;
+            }
+        }
+        if (queued) _cv.notify_all();
+        write_at(offset, data);
+        while (write_one_resolved()) {}
+    }
+
+    // for threads with no other work:  writes parked chunks as their offsets become known,
+    // returning once every chunk has been handed in and written or taken by another thread.
+    // Call it from every idle thread to spread the writes.  Waits for all chunks to arrive.
+    void write_resolved() {
+        for (;;) {
+            {
+                std::unique_lock<std::mutex> lk(_mutex);
+                _cv.wait(lk, [this] {return !_ready.empty() || _next == _count;});
+                if (_ready.empty()) return;
+            }
+            write_one_resolved();
+        }
+    }
+
+    // bytes written once every chunk is in
+    uint64_t size() {
+        std::lock_guard<std::mutex> lk(_mutex);
+        return _offset;
+    }
+
+    // the most pwrite()s that were in progress at once, since open()
+    int peak_concurrent_writes() const {return _peakWriting;}
+
+    // closes the file.  false if a write failed or a chunk never arrived.
+    bool close() {
+        if (_fd < 0) return !_failed;
+        bool ok = !_failed && _next == _count;
+        if (::close(_fd) != 0) ok = false;
+        _fd = -1;
+        _failed = !ok;
+        std::vector<std::string>().swap(_pending);
+        return ok;
+    }
+
+private:
+    int _fd;
+    int _count;
+    std::vector<std::string> _pending;      // chunks handed in before their offset was known
+    std::vector<unsigned char> _arrived;
+    std::vector<uint64_t> _offsets;         // of parked chunks, once known
+    std::deque<int> _ready;     // parked chunks whose offsets are known, waiting to be written
+    int _next;                  // the first chunk whose offset isn't known yet
+    uint64_t _offset;           // chunk _next's offset
+    std::mutex _mutex;          // guards everything above
+    std::condition_variable _cv;    // write_resolved() waits here for _ready or the last chunk
+    std::atomic<bool> _failed;
+    std::atomic<int> _writing;
+    std::atomic<int> _peakWriting;
+
+    // takes one chunk off _ready and writes it.  false if there was none.
+    bool write_one_resolved() {
+        int index;
+        {
+            std::lock_guard<std::mutex> lk(_mutex);
+            if (_ready.empty()) return false;
+            index = _ready.front();
+            _ready.pop_front();
+        }
+        write_at(_offsets[index], _pending[index]);
+        std::string().swap(_pending[index]);    // give the memory back now, not at close()
+        return true;
+    }
+
+    void write_at(uint64_t offset, const std::string &data) {
+        int writing = ++_writing;
+        int peak = _peakWriting;
+        while (writing > peak && !_peakWriting.compare_exchange_weak(peak, writing)) {}
+        size_t done = 0;
+        while (done < data.size()) {
+            ssize_t r = pwrite(_fd, data.data() + done, data.size() - done, (off_t)(offset + done));
+            if (r < 0 && errno == EINTR) continue;
+            if (r <= 0) {
+                _failed = true;
+                break;
+            }
+            done += (size_t)r;
+        }
+        --_writing;
+    }
+};
+
+// runs f(int index, std::string &out) for chunkCount indices across threadCount threads,
+// writing each out to path in index order as soon as its offset is known.  After the
+// chunks come a work item per thread that helps write parked chunks, so a thread that runs
+// out of chunks to compute writes instead of exiting.  returns false if the file couldn't be written.
+template <typename F>
+bool write_ordered_chunks(const char *path, int chunkCount, F f, int threadCount=0) {
+    ordered_writer writer;
+    if (!writer.open(path, chunkCount)) return false;
+    threadCount = scheduler::resolve_thread_count(threadCount);
+    parallel_for(chunkCount + threadCount, [&](int index) {
+        if (index >= chunkCount) {
+            writer.write_resolved();
+            return;
+        }
+        std::string out;
+        f(index, out);
+        writer.write_chunk(index, std::move(out));
+    }, threadCount);
+    return writer.close();
+}
+
+#endif /* ordered_writer_h */
@@ -0,0 +1,209 @@
+//
+//  parallel_reduce.h
+//  Reductions (sums, min, max, ...) of an array built on the scheduler, in
+//  two flavours.
+//  parallel_reduce is the fast one:  each pool thread folds the blocks it
+//  happens to take into its own accumulator.  Which thread takes which block
+//  depends on timing, and floating point addition isn't associative, so a
+//  float sum can differ in its last bits from run to run and with the thread
+//  count.
+//  deterministic_reduce and reproducible_sum fix the shape of the whole
+//  computation instead:  the input is cut into REDUCE_BLOCK sized blocks
+//  (whatever the thread count), each block is reduced in a fixed order into
+//  its own slot, and the block results are combined by a fixed pairwise tree
+//  on the calling thread.  The threads only decide when a block is done, not
+//  what is added to what, so the result is bit for bit the same for any
+//  thread count and any schedule - for golden file tests.  reproducible_sum
+//  can also compensate for rounding (pairwise or Kahan summation).
+//  Reproducible across builds too, as long as the compiler isn't allowed to
+//  reassociate or contract float math (no -ffast-math, -ffp-contract=off).
+//
+
+#ifndef parallel_reduce_h
+#define parallel_reduce_h
+
+#include "scheduler.h"
+#include <algorithm>
+#include <cstddef>
+#include <functional>
+#include <vector>
+
+// elements per block, and so per work item.  Part of the result's definition for the
+// deterministic reductions:  change it and their results change (once).
+#define REDUCE_BLOCK    (1 << 14)
+
+// pairwise summation adds runs of this many elements straight through
+#define REDUCE_PAIRWISE_BASE    32
+
+// reproducible_sum's rounding control
+enum reduce_summation {
+    SUM_PLAIN,      // eight interleaved accumulators per block, then the tree.  Fastest.
+    SUM_PAIRWISE,   // pairwise within blocks too:  error grows with log n, not n
+    SUM_KAHAN       // compensated in each lane (Kahan) and up the tree (Neumaier):  error independent of n
+};
+
+// number of blocks covering n elements
+inline int reduce_block_count(size_t n) {
+    return (int)((n + REDUCE_BLOCK - 1) / REDUCE_BLOCK);
+}
+
+// combines values[0..) in place by a fixed pairwise tree - neighbours, then neighbours of
+// those, and so on - and returns the root.  values must not be empty.
+template <typename T, typename Op>
+T reduce_tree(std::vector<T> &values, Op op) {
+    size_t count = values.size();
+    while (count > 1) {
+        size_t half = count / 2;
+        for (size_t i = 0; i < half; ++i) values[i] = op(values[2 * i], values[2 * i + 1]);
+        if (count & 1) values[half] = values[count - 1];
+        count = half + (count & 1);
+    }
+    return values[0];
+}
+
+//-------------------------------------------------------------------------
+
+// init op in[0] op ... op in[n-1], in no particular grouping.  op must be associative and
+// commutative, and for floating point the last bits of the result depend on scheduling.
+template <typename T, typename Op = std::plus<T>>
+T parallel_reduce(const T *in, size_t n, T init, Op op = Op(), int threadCount=0) {
+    int blocks = reduce_block_count(n);
+    threadCount = scheduler::resolve_thread_count(threadCount);
+    std::vector<T> partial(threadCount);
+    std::vector<char> used(threadCount, 0);
+    parallel_for(blocks, [&](int b) {
+        size_t first = (size_t)b * REDUCE_BLOCK;
+        size_t count = std::min((size_t)REDUCE_BLOCK, n - first);
+        T total = in[first];
+        for (size_t i = 1; i < count; ++i) total = op(total, in[first + i]);
+        int t = scheduler::thread_index();
+        partial[t] = used[t] ? op(partial[t], total) : total;
+        used[t] = 1;
+    }, threadCount);
+    for (int t = 0; t < threadCount; ++t) {
+        if (used[t]) init = op(init, partial[t]);
+    }
+    return init;
+}
+
+// init op (in[0] op ... op in[n-1]), grouped by REDUCE_BLOCK blocks and a fixed tree, so the
+// result doesn't depend on the thread count or scheduling.  op must be associative (up to rounding).
+template <typename T, typename Op = std::plus<T>>
+T deterministic_reduce(const T *in, size_t n, T init, Op op = Op(), int threadCount=0) {
+    if (n == 0) return init;
+    std::vector<T> partial(reduce_block_count(n));
+    parallel_for((int)partial.size(), [&](int b) {
+        size_t first = (size_t)b * REDUCE_BLOCK;
+        size_t count = std::min((size_t)REDUCE_BLOCK, n - first);
+        T total = in[first];
+        for (size_t i = 1; i < count; ++i) total = op(total, in[first + i]);
+        partial[b] = total;
+    }, threadCount);
+    return op(init, reduce_tree(partial, op));
+}
+
+//-------------------------------------------------------------------------
+// reproducible floating point sums
+
+// a sum and the rounding error it has lost so far, for Kahan (Neumaier) summation
+template <typename T>
+struct compensated_sum {
+    T sum;
+    T error;
+
+    compensated_sum(T s=T(), T e=T()) : sum(s), error(e) {}
+
+    void add(T x) {
+        T t = sum + x;
+        // the low bits lost from whichever operand was smaller
+        if ((sum >= 0 ? sum : -sum) >= (x >= 0 ? x : -x)) error += (sum - t) + x;
+        else error += (x - t) + sum;
+        sum = t;
+    }
+
+    compensated_sum operator+(const compensated_sum &other) const {
+        compensated_sum r(sum, error + other.error);
+        r.add(other.sum);
+        return r;
+    }
+
+    T value() const {return sum + error;}
+};
+
+// sum of in[0..count) by recursive halving, down to REDUCE_PAIRWISE_BASE runs
+template <typename T>
+T pairwise_sum(const T *in, size_t count) {
+    if (count <= REDUCE_PAIRWISE_BASE) {
+        T total = T();
+        for (size_t i = 0; i < count; ++i) total += in[i];
+        return total;
+    }
+    size_t half = count / 2;
+    return pairwise_sum(in, half) + pairwise_sum(in + half, count - half);
+}
+
+// sum of in[0..count) in eight interleaved accumulators, combined by a fixed tree.
+// No loop carried dependency across lanes, so it vectorizes without reassociating anything.
+template <typename T>
+T lanes_sum(const T *in, size_t count) {
+    T lane[8] = {};
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        for (int l = 0; l < 8; ++l) lane[l] += in[i + l];
+    }
+    for (int l = 0; i < count; ++i, ++l) lane[l] += in[i];
+    return ((lane[0] + lane[1]) + (lane[2] + lane[3])) + ((lane[4] + lane[5]) + (lane[6] + lane[7]));
+}
+
+// lanes_sum with classic Kahan summation in each lane (branch free, so it still vectorizes),
+// the lanes then combined as compensated sums
+template <typename T>
+compensated_sum<T> lanes_kahan_sum(const T *in, size_t count) {
+    T sum[8] = {};
+    T carry[8] = {};    // minus the low bits lost so far
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        for (int l = 0; l < 8; ++l) {
+            T y = in[i + l] - carry[l];
+            T t = sum[l] + y;
+            carry[l] = (t - sum[l]) - y;
+            sum[l] = t;
+        }
+    }
+    for (int l = 0; i < count; ++i, ++l) {
+        T y = in[i] - carry[l];
+        T t = sum[l] + y;
+        carry[l] = (t - sum[l]) - y;
+        sum[l] = t;
+    }
+    compensated_sum<T> lane[8];
+    for (int l = 0; l < 8; ++l) lane[l] = compensated_sum<T>(sum[l], -carry[l]);
+    return ((lane[0] + lane[1]) + (lane[2] + lane[3])) + ((lane[4] + lane[5]) + (lane[6] + lane[7]));
+}
+
+// in[0] + ... + in[n-1], the same bits for any thread count and schedule, with the chosen
+// rounding control.  T is float, double or long double.
+template <typename T>
+T reproducible_sum(const T *in, size_t n, reduce_summation summation=SUM_PLAIN, int threadCount=0) {
+    if (n == 0) return T();
+    int blocks = reduce_block_count(n);
+    if (summation == SUM_KAHAN) {
+        std::vector<compensated_sum<T>> partial(blocks);
+        parallel_for(blocks, [&](int b) {
+            size_t first = (size_t)b * REDUCE_BLOCK;
+            size_t count = std::min((size_t)REDUCE_BLOCK, n - first);
+            partial[b] = lanes_kahan_sum(in + first, count);
+        }, threadCount);
+        return reduce_tree(partial, std::plus<compensated_sum<T>>()).value();
+    }
+
+    std::vector<T> partial(blocks);
+    parallel_for(blocks, [&](int b) {
+        size_t first = (size_t)b * REDUCE_BLOCK;
+        size_t count = std::min((size_t)REDUCE_BLOCK, n - first);
+        partial[b] = summation == SUM_PAIRWISE ? pairwise_sum(in + first, count) : lanes_sum(in + first, count);
+    }, threadCount);
+    return reduce_tree(partial, std::plus<T>());
+}
+
+#endif /* parallel_reduce_h */
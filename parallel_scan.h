@@ -0,0 +1,227 @@
+//
+//  parallel_scan.h
+//  Prefix sums (scans) and stream compaction built on the scheduler.
+//  Work-efficient two pass design:  pass one reduces each tile of the input
+//  to a single value, those tile totals are scanned, then pass two scans each
+//  tile again seeded with the total of everything before it.
+//  Each tile is one work item for the scheduler, so tiles are balanced across
+//  threads at runtime just like any other workload.
+//
+
+#ifndef parallel_scan_h
+#define parallel_scan_h
+
+#include "scheduler.h"
+#include <algorithm>
+#include <cstddef>
+#include <functional>
+#include <vector>
+
+// number of elements handled by one work item.  Large enough that the
+// scheduler's lock is noise, small enough that a tile stays in L2.
+#define SCAN_TILE   (1 << 14)
+
+// number of tiles (work items) needed to cover n elements
+inline int scan_tile_count(size_t n) {
+    return (int)((n + SCAN_TILE - 1) / SCAN_TILE);
+}
+
+//-------------------------------------------------------------------------
+// inner loops, one tile at a time.
+// The reduce loop has no loop carried dependency other than the accumulator,
+// so with -O2 and a simple op (plus, min, max) the compiler vectorizes it.
+
+template <typename T, typename Op>
+T scan_tile_reduce(const T *in, size_t count, Op op) {
+    T total = in[0];
+    for (size_t i = 1; i < count; ++i) {
+        total = op(total, in[i]);
+    }
+    return total;
+}
+
+// inclusive scan of one tile, seeded with everything before it (if hasCarry)
+template <typename T, typename Op>
+void scan_tile_inclusive(const T *in, T *out, size_t count, Op op, bool hasCarry, T carry) {
+    T running = hasCarry ? op(carry, in[0]) : in[0];
+    out[0] = running;
+    for (size_t i = 1; i < count; ++i) {
+        running = op(running, in[i]);
+        out[i] = running;
+    }
+}
+
+// exclusive scan of one tile, carry is the value written to out[0]
+template <typename T, typename Op>
+void scan_tile_exclusive(const T *in, T *out, size_t count, Op op, T carry) {
+    T running = carry;
+    for (size_t i = 0; i < count; ++i) {
+        T value = in[i];    // read before write, so in == out is allowed
+        out[i] = running;
+        running = op(running, value);
+    }
+}
+
+//-------------------------------------------------------------------------
+
+// out[i] = in[0] op in[1] op ... op in[i]
+// op must be associative.  in and out may be the same array.
+template <typename T, typename Op = std::plus<T>>
+void parallel_scan(const T *in, T *out, size_t n, Op op = Op(), int threadCount=0) {
+    if (n == 0) return;
+    int tiles = scan_tile_count(n);
+    if (tiles == 1) {
+        scan_tile_inclusive(in, out, n, op, false, T());
+        return;
+    }
+
+    // pass one:  total of each tile
+    std::vector<T> totals(tiles);
+    parallel_for(tiles, [&](int t) {
+        size_t first = (size_t)t * SCAN_TILE;
+        size_t count = std::min((size_t)SCAN_TILE, n - first);
+        totals[t] = scan_tile_reduce(in + first, count, op);
+    }, threadCount);
+
+    // the tile totals are few, scan them in place on this thread
+    for (int t = 1; t < tiles; ++t) {
+        totals[t] = op(totals[t-1], totals[t]);
+    }
+
+    // pass two:  scan each tile, seeded by the totals of the tiles before it
+    parallel_for(tiles, [&](int t) {
+        size_t first = (size_t)t * SCAN_TILE;
+        size_t count = std::min((size_t)SCAN_TILE, n - first);
+        scan_tile_inclusive(in + first, out + first, count, op, t > 0, t > 0 ? totals[t-1] : T());
+    }, threadCount);
+}
+
+// out[0] = init, out[i] = init op in[0] op ... op in[i-1]
+// op must be associative.  in and out may be the same array.
+template <typename T, typename Op = std::plus<T>>
+void parallel_exclusive_scan(const T *in, T *out, size_t n, T init, Op op = Op(), int threadCount=0) {
+    if (n == 0) return;
+    int tiles = scan_tile_count(n);
+    if (tiles == 1) {
+        scan_tile_exclusive(in, out, n, op, init);
+        return;
+    }
+
+    std::vector<T> carries(tiles);
+    parallel_for(tiles, [&](int t) {
+        size_t first = (size_t)t * SCAN_TILE;
+        size_t count = std::min((size_t)SCAN_TILE, n - first);
+        carries[t] = scan_tile_reduce(in + first, count, op);
+    }, threadCount);
+
+    // turn the tile totals into each tile's starting value
+    T running = init;
+    for (int t = 0; t < tiles; ++t) {
+        T total = carries[t];
+        carries[t] = running;
+        running = op(running, total);
+    }
+
+    parallel_for(tiles, [&](int t) {
+        size_t first = (size_t)t * SCAN_TILE;
+        size_t count = std::min((size_t)SCAN_TILE, n - first);
+        scan_tile_exclusive(in + first, out + first, count, op, carries[t]);
+    }, threadCount);
+}
+
+//-------------------------------------------------------------------------
+// stream compaction.  All of these evaluate pred exactly once per element,
+// keep the relative order of the elements (stable), and use the same tiling
+// as the scans:  count per tile, exclusive scan of the counts, then scatter.
+
+// flags[i] = pred(in[i]), returns the number of true flags in each tile
+template <typename T, typename Pred>
+std::vector<size_t> compact_count(const T *in, size_t n, Pred pred, std::vector<unsigned char> &flags, int threadCount) {
+    int tiles = scan_tile_count(n);
+    flags.resize(n);
+    std::vector<size_t> counts(tiles);
+    parallel_for(tiles, [&](int t) {
+        size_t first = (size_t)t * SCAN_TILE;
+        size_t last = std::min(first + SCAN_TILE, n);
+        size_t count = 0;
+        for (size_t i = first; i < last; ++i) {
+            unsigned char keep = pred(in[i]) ? 1 : 0;
+            flags[i] = keep;
+            count += keep;
+        }
+        counts[t] = count;
+    }, threadCount);
+    return counts;
+}
+
+// copies the elements of in for which pred is true to out, in order.
+// returns the number of elements copied.  out must not overlap in.
+template <typename T, typename Pred>
+size_t parallel_copy_if(const T *in, size_t n, T *out, Pred pred, int threadCount=0) {
+    if (n == 0) return 0;
+    std::vector<unsigned char> flags;
+    std::vector<size_t> offsets = compact_count(in, n, pred, flags, threadCount);
+    int tiles = (int)offsets.size();
+    size_t total = offsets[tiles-1];
+    parallel_exclusive_scan(offsets.data(), offsets.data(), offsets.size(), (size_t)0, std::plus<size_t>(), threadCount);
+    total += offsets[tiles-1];
+
+    parallel_for(tiles, [&](int t) {
+        size_t first = (size_t)t * SCAN_TILE;
+        size_t last = std::min(first + SCAN_TILE, n);
+        T *dst = out + offsets[t];
+        for (size_t i = first; i < last; ++i) {
+            if (flags[i]) *dst++ = in[i];
+        }
+    }, threadCount);
+    return total;
+}
+
+// stable partition of in into out:  elements where pred is true first, then
+// the rest, both in their original order.  returns the number of true elements.
+// out must not overlap in.
+template <typename T, typename Pred>
+size_t parallel_partition(const T *in, size_t n, T *out, Pred pred, int threadCount=0) {
+    if (n == 0) return 0;
+    std::vector<unsigned char> flags;
+    std::vector<size_t> trues = compact_count(in, n, pred, flags, threadCount);
+    int tiles = (int)trues.size();
+    size_t total = trues[tiles-1];
+    parallel_exclusive_scan(trues.data(), trues.data(), trues.size(), (size_t)0, std::plus<size_t>(), threadCount);
+    total += trues[tiles-1];
+
+    parallel_for(tiles, [&](int t) {
+        size_t first = (size_t)t * SCAN_TILE;
+        size_t last = std::min(first + SCAN_TILE, n);
+        // everything before this tile that was false lands after all of the trues
+        T *dstTrue = out + trues[t];
+        T *dstFalse = out + total + (first - trues[t]);
+        for (size_t i = first; i < last; ++i) {
+            if (flags[i]) {
+                *dstTrue++ = in[i];
+            } else {
+                *dstFalse++ = in[i];
+            }
+        }
+    }, threadCount);
+    return total;
+}
+
+// removes the elements of data for which pred is true, keeping the order of
+// the rest.  returns the new size, elements past it are left unspecified.
+// Tiles can't compact in place in parallel (a tile would overwrite the one in
+// front of it), so the survivors go through a scratch buffer.
+template <typename T, typename Pred>
+size_t parallel_remove_if(T *data, size_t n, Pred pred, int threadCount=0) {
+    if (n == 0) return 0;
+    std::vector<T> scratch(n);
+    size_t kept = parallel_copy_if(data, n, scratch.data(), [&](const T &v) {return !pred(v);}, threadCount);
+    parallel_for(scan_tile_count(kept), [&](int t) {
+        size_t first = (size_t)t * SCAN_TILE;
+        size_t last = std::min(first + SCAN_TILE, kept);
+        std::copy(scratch.begin() + first, scratch.begin() + last, data + first);
+    }, threadCount);
+    return kept;
+}
+
+#endif /* parallel_scan_h */
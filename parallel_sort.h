@@ -0,0 +1,211 @@
+//
+//  parallel_sort.h
+//  Sorting on the scheduler.
+//  parallel_sort is a comparison sort:  tiles are std::sort'ed as work items,
+//  then merged pairwise, each merge of a round being a work item.
+//  parallel_radix_sort is an LSD radix sort for integer and IEEE float keys,
+//  optionally carrying a value array along with the keys.  Each 8 bit digit is
+//  one pass of:  per tile histograms, a prefix sum of those into per tile
+//  output offsets, then a stable scatter through small write-combining buffers.
+//
+
+#ifndef parallel_sort_h
+#define parallel_sort_h
+
+#include "scheduler.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <type_traits>
+#include <vector>
+
+// elements per work item, for both sorts
+#define SORT_TILE   (1 << 16)
+
+// radix sort digit size, and how many elements per digit each tile buffers
+// before writing them out.  64 bytes of 32 bit keys, so a flush is a whole cache line.
+#define RADIX_BITS      8
+#define RADIX_BUCKETS   (1 << RADIX_BITS)
+#define RADIX_WC_COUNT  16
+
+inline int sort_tile_count(size_t n) {
+    return (int)((n + SORT_TILE - 1) / SORT_TILE);
+}
+
+//-------------------------------------------------------------------------
+// comparison sort
+
+// sorts data[0..n) with comp.  Not stable.  Uses a scratch buffer of n elements.
+template <typename T, typename Compare = std::less<T>>
+void parallel_sort(T *data, size_t n, Compare comp = Compare(), int threadCount=0) {
+    int tiles = sort_tile_count(n);
+    if (tiles < 2) {
+        std::sort(data, data + n, comp);
+        return;
+    }
+
+    parallel_for(tiles, [&](int t) {
+        size_t first = (size_t)t * SORT_TILE;
+        std::sort(data + first, data + std::min(first + SORT_TILE, n), comp);
+    }, threadCount);
+
+    // merge rounds, each doubling the sorted run length, ping-ponging between buffers
+    std::vector<T> scratch(n);
+    T *src = data;
+    T *dst = scratch.data();
+    for (size_t run = SORT_TILE; run < n; run *= 2) {
+        int merges = (int)((n + 2*run - 1) / (2*run));
+        parallel_for(merges, [&](int m) {
+            size_t first = (size_t)m * 2 * run;
+            size_t middle = std::min(first + run, n);
+            size_t last = std::min(first + 2*run, n);
+            std::merge(src + first, src + middle, src + middle, src + last, dst + first, comp);
+        }, threadCount);
+        std::swap(src, dst);
+    }
+    if (src != data) {
+        parallel_for(tiles, [&](int t) {
+            size_t first = (size_t)t * SORT_TILE;
+            std::copy(src + first, src + std::min(first + SORT_TILE, n), data + first);
+        }, threadCount);
+    }
+}
+
+//-------------------------------------------------------------------------
+// radix sort
+
+// maps a key to an unsigned integer with the same ordering
+template <typename T, typename Enable = void>
+struct radix_key_traits;
+
+template <typename T>
+struct radix_key_traits<T, typename std::enable_if<std::is_integral<T>::value && std::is_unsigned<T>::value>::type> {
+    typedef T bits_type;
+    static bits_type to_bits(T key) {return key;}
+};
+
+// signed integers:  flip the sign bit so negatives come first
+template <typename T>
+struct radix_key_traits<T, typename std::enable_if<std::is_integral<T>::value && std::is_signed<T>::value>::type> {
+    typedef typename std::make_unsigned<T>::type bits_type;
+    static bits_type to_bits(T key) {
+        return (bits_type)key ^ ((bits_type)1 << (sizeof(T)*8 - 1));
+    }
+};
+
+// IEEE floats:  negatives have every bit flipped (so larger magnitude sorts
+// first), positives just have the sign bit set.  -0.0 sorts before +0.0.
+// float and double only:  long double isn't a plain 64 bit pattern.
+template <typename T>
+struct radix_key_traits<T, typename std::enable_if<std::is_floating_point<T>::value && (sizeof(T) == 4 || sizeof(T) == 8)>::type> {
+    typedef typename std::conditional<sizeof(T) == 4, uint32_t, uint64_t>::type bits_type;
+    static bits_type to_bits(T key) {
+        bits_type bits;
+        std::memcpy(&bits, &key, sizeof(bits));
+        const bits_type sign = (bits_type)1 << (sizeof(T)*8 - 1);
+        return (bits & sign) ? ~bits : (bits | sign);
+    }
+};
+
+// one digit pass of the LSD sort.  Returns false if every key has the same
+// digit, in which case nothing was moved and the pass can be skipped.
+template <typename K, typename V>
+bool radix_pass(const K *keysIn, K *keysOut, const V *valuesIn, V *valuesOut, size_t n, int shift, int threadCount) {
+    typedef radix_key_traits<K> traits;
+    int tiles = sort_tile_count(n);
+
+    // per tile histograms of this digit
+    std::vector<size_t> offsets((size_t)tiles * RADIX_BUCKETS, 0);
+    parallel_for(tiles, [&](int t) {
+        size_t *hist = &offsets[(size_t)t * RADIX_BUCKETS];
+        size_t last = std::min((size_t)(t+1) * SORT_TILE, n);
+        for (size_t i = (size_t)t * SORT_TILE; i < last; ++i) {
+            ++hist[(traits::to_bits(keysIn[i]) >> shift) & (RADIX_BUCKETS - 1)];
+        }
+    }, threadCount);
+
+    // exclusive prefix sum in digit major, tile minor order gives each tile
+    // the place in the output where its first key of each digit goes
+    size_t running = 0;
+    for (int d = 0; d < RADIX_BUCKETS; ++d) {
+        size_t digitTotal = 0;
+        for (int t = 0; t < tiles; ++t) {
+            size_t count = offsets[(size_t)t * RADIX_BUCKETS + d];
+            offsets[(size_t)t * RADIX_BUCKETS + d] = running;
+            running += count;
+            digitTotal += count;
+        }
+        if (digitTotal == n) return false;
+    }
+
+    // stable scatter.  Keys (and values) are staged per digit and written out a
+    // buffer at a time, so the stores to 256 different places stay in cache lines.
+    parallel_for(tiles, [&](int t) {
+        size_t *dest = &offsets[(size_t)t * RADIX_BUCKETS];
+        std::vector<K> keyBuffer(RADIX_BUCKETS * RADIX_WC_COUNT);
+        std::vector<V> valueBuffer(valuesIn ? RADIX_BUCKETS * RADIX_WC_COUNT : 0);
+        int fill[RADIX_BUCKETS] = {0};
+
+        auto flush = [&](int d) {
+            std::copy(&keyBuffer[d * RADIX_WC_COUNT], &keyBuffer[d * RADIX_WC_COUNT] + fill[d], keysOut + dest[d]);
+            if (valuesIn) {
+                std::copy(&valueBuffer[d * RADIX_WC_COUNT], &valueBuffer[d * RADIX_WC_COUNT] + fill[d], valuesOut + dest[d]);
+            }
+            dest[d] += fill[d];
+            fill[d] = 0;
+        };
+
+        size_t last = std::min((size_t)(t+1) * SORT_TILE, n);
+        for (size_t i = (size_t)t * SORT_TILE; i < last; ++i) {
+            int d = (int)((traits::to_bits(keysIn[i]) >> shift) & (RADIX_BUCKETS - 1));
+            keyBuffer[d * RADIX_WC_COUNT + fill[d]] = keysIn[i];
+            if (valuesIn) valueBuffer[d * RADIX_WC_COUNT + fill[d]] = valuesIn[i];
+            if (++fill[d] == RADIX_WC_COUNT) flush(d);
+        }
+        for (int d = 0; d < RADIX_BUCKETS; ++d) {
+            if (fill[d]) flush(d);
+        }
+    }, threadCount);
+    return true;
+}
+
+// sorts keys[0..n) ascending, moving values[i] with keys[i] if values is not null.
+// Stable.  Uses scratch buffers the size of the input.
+template <typename K, typename V>
+void parallel_radix_sort(K *keys, V *values, size_t n, int threadCount=0) {
+    static_assert(std::is_arithmetic<K>::value, "radix sort keys must be integers or floats");
+    static_assert(sizeof(K) <= 8, "radix sort keys must be at most 64 bits (not long double)");
+    if (n < 2) return;
+
+    std::vector<K> keyScratch(n);
+    std::vector<V> valueScratch(values ? n : 0);
+    K *keysIn = keys, *keysOut = keyScratch.data();
+    V *valuesIn = values, *valuesOut = values ? valueScratch.data() : nullptr;
+
+    for (int shift = 0; shift < (int)sizeof(K) * 8; shift += RADIX_BITS) {
+        if (radix_pass(keysIn, keysOut, valuesIn, valuesOut, n, shift, threadCount)) {
+            std::swap(keysIn, keysOut);
+            std::swap(valuesIn, valuesOut);
+        }
+    }
+
+    // an odd number of passes leaves the result in the scratch buffers
+    if (keysIn != keys) {
+        parallel_for(sort_tile_count(n), [&](int t) {
+            size_t first = (size_t)t * SORT_TILE;
+            size_t last = std::min(first + SORT_TILE, n);
+            std::copy(keysIn + first, keysIn + last, keys + first);
+            if (values) std::copy(valuesIn + first, valuesIn + last, values + first);
+        }, threadCount);
+    }
+}
+
+// keys only
+template <typename K>
+void parallel_radix_sort(K *keys, size_t n, int threadCount=0) {
+    parallel_radix_sort(keys, (char *)nullptr, n, threadCount);
+}
+
+#endif /* parallel_sort_h */
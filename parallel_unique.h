@@ -0,0 +1,115 @@
+//
+//  parallel_unique.h
+//  Removes duplicates from unsorted data without sorting it, on the scheduler.
+//  Every element is hashed, the elements are partitioned on their hash (the
+//  same radix partitioning the hash join uses), and each partition is a work
+//  item that dedups itself with an open addressed set kept per pool thread.
+//  The surviving counts are turned into output offsets with a parallel scan.
+//
+
+#ifndef parallel_unique_h
+#define parallel_unique_h
+
+#include "scheduler.h"
+#include "parallel_scan.h"
+#include "hash_join.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+// rows per work item when hashing
+#define UNIQUE_TILE     (1 << 16)
+
+// target bytes of entries + set per partition
+#define UNIQUE_PARTITION_BYTES  (256 * 1024)
+
+// copies one of each distinct element of in[0..n) to out, returns how many.
+// With keepFirstOrder false the output is grouped by hash partition, in no
+// useful order.  With it true the output holds the first occurrence of each
+// element in input order, like std::unique on sorted data would, at the cost
+// of a flag per element and an extra compaction pass.
+// out must have room for n elements and must not overlap in.
+template <typename T, typename Hash = std::hash<T>, typename Equal = std::equal_to<T>>
+size_t parallel_unique_unordered(const T *in, size_t n, T *out, bool keepFirstOrder=false, int threadCount=0,
+                                 Hash hash = Hash(), Equal equal = Equal()) {
+    if (n == 0) return 0;
+    int threads = scheduler::resolve_thread_count(threadCount);
+
+    std::vector<uint64_t> hashes(n);
+    parallel_for((int)((n + UNIQUE_TILE - 1) / UNIQUE_TILE), [&](int t) {
+        size_t last = std::min((size_t)(t+1) * UNIQUE_TILE, n);
+        for (size_t i = (size_t)t * UNIQUE_TILE; i < last; ++i) hashes[i] = (uint64_t)hash(in[i]);
+    }, threads);
+
+    // enough partitions to balance the threads, and for each to fit in cache
+    const size_t bytesPerRow = sizeof(join_entry<uint64_t>) + 2 * sizeof(uint32_t) + 1;
+    int bits = 0;
+    while (bits < 16 && (((1 << bits) < 4 * threads) || (n >> bits) * bytesPerRow > UNIQUE_PARTITION_BYTES)) ++bits;
+    const int partitions = 1 << bits;
+
+    // partitioning is stable, so within a partition entries are in input order
+    // and the first one of each value seen is its first occurrence
+    std::vector<join_entry<uint64_t>> entries;
+    std::vector<size_t> start;
+    join_partition(hashes.data(), n, bits, entries, start, threads);
+
+    std::vector<unsigned char> keep(n, 0);     // by entry, or by input row when keepFirstOrder
+    std::vector<size_t> counts(partitions);
+    std::vector<std::vector<uint32_t>> threadSets(threads);
+
+    parallel_for(partitions, [&](int p) {
+        const join_entry<uint64_t> *e = entries.data() + start[p];
+        const uint32_t count = (uint32_t)(start[p+1] - start[p]);
+        counts[p] = 0;
+        if (count == 0) return;
+
+        // slots hold entry number + 1, 0 is empty.  Low hash bits picked the partition, high bits pick the slot.
+        int slotBits = 1;
+        while (((size_t)1 << slotBits) < 2 * (size_t)count) ++slotBits;
+        const uint32_t slotMask = ((uint32_t)1 << slotBits) - 1;
+        std::vector<uint32_t> &set = threadSets[scheduler::thread_index()];
+        set.assign((size_t)1 << slotBits, 0);
+
+        size_t unique = 0;
+        for (uint32_t i = 0; i < count; ++i) {
+            uint32_t slot = (uint32_t)(join_hash(e[i].key) >> 32) & slotMask;
+            bool seen = false;
+            while (set[slot]) {
+                const join_entry<uint64_t> &other = e[set[slot] - 1];
+                if (other.key == e[i].key && equal(in[other.row], in[e[i].row])) {
+                    seen = true;
+                    break;
+                }
+                slot = (slot + 1) & slotMask;
+            }
+            if (!seen) {
+                set[slot] = i + 1;
+                keep[keepFirstOrder ? e[i].row : start[p] + i] = 1;
+                ++unique;
+            }
+        }
+        counts[p] = unique;
+    }, threads);
+
+    if (keepFirstOrder) {
+        // the predicate gets a reference into in, so its row is its address less in
+        return parallel_copy_if(in, n, out, [&](const T &v) {return keep[&v - in] != 0;}, threads);
+    }
+
+    // concatenate the partitions:  scan the counts into offsets, then each partition copies its survivors
+    size_t total = counts[partitions-1];
+    parallel_exclusive_scan(counts.data(), counts.data(), counts.size(), (size_t)0, std::plus<size_t>(), threads);
+    total += counts[partitions-1];
+
+    parallel_for(partitions, [&](int p) {
+        T *dst = out + counts[p];
+        for (size_t i = start[p]; i < start[p+1]; ++i) {
+            if (keep[i]) *dst++ = in[entries[i].row];
+        }
+    }, threads);
+    return total;
+}
+
+#endif /* parallel_unique_h */
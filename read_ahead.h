@@ -0,0 +1,385 @@
+//
+//  read_ahead.h
+//  For jobs where do_work(i) would read file i:  an I/O stage reads the files
+//  ahead of the workers, and index i only reaches a pool thread once its
+//  contents are in memory, so the pool's threads never block in read().
+//  Reads are submitted through io_uring (raw syscalls, no liburing needed),
+//  keeping up to queueDepth files read or being read ahead of what the
+//  workers have finished.  Where io_uring isn't available (old kernel,
+//  seccomp) a few plain reader threads do the same job with pread().
+//  Files are handed to the scheduler as they complete, through add_work(), so
+//  a slow file doesn't hold up the ones behind it.
+//
+//  Linux only.
+//
+
+#ifndef read_ahead_h
+#define read_ahead_h
+
+#include "scheduler.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <linux/io_uring.h>
+
+// files read ahead of the workers by default
+#define READ_AHEAD_DEPTH    16
+
+// reader threads used when io_uring isn't available
+#define READ_AHEAD_FALLBACK_THREADS 4
+
+// a minimal io_uring:  set up the rings, queue READV requests, reap completions
+struct io_ring {
+    io_ring() : _fd(-1) {}
+    ~io_ring() {close();}
+
+    bool open(unsigned entries) {
+        io_uring_params p;
+        memset(&p, 0, sizeof(p));
+        _fd = (int)syscall(__NR_io_uring_setup, entries, &p);
+        if (_fd < 0) return false;
+
+        _sqSize = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+        _cqSize = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+        if (p.features & IORING_FEAT_SINGLE_MMAP) _sqSize = _cqSize = std::max(_sqSize, _cqSize);
+        _sq = mmap(nullptr, _sqSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _fd, IORING_OFF_SQ_RING);
+        _cq = (p.features & IORING_FEAT_SINGLE_MMAP) ? _sq
+            : mmap(nullptr, _cqSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _fd, IORING_OFF_CQ_RING);
+        _sqesSize = p.sq_entries * sizeof(io_uring_sqe);
+        _sqes = (io_uring_sqe *)mmap(nullptr, _sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _fd, IORING_OFF_SQES);
+        if (_sq == MAP_FAILED || _cq == MAP_FAILED || _sqes == MAP_FAILED) {
+            // unmap whichever did succeed
+            if (_sqes != MAP_FAILED) munmap(_sqes, _sqesSize);
+            if (_cq != MAP_FAILED && _cq != _sq) munmap(_cq, _cqSize);
+            if (_sq != MAP_FAILED) munmap(_sq, _sqSize);
+            ::close(_fd);
+            _fd = -1;
+            return false;
+        }
+
+        char *sq = (char *)_sq, *cq = (char *)_cq;
+        _sqHead = (unsigned *)(sq + p.sq_off.head);
+        _sqTail = (unsigned *)(sq + p.sq_off.tail);
+        _sqMask = *(unsigned *)(sq + p.sq_off.ring_mask);
+        _sqEntries = p.sq_entries;
+        _sqArray = (unsigned *)(sq + p.sq_off.array);
+        _cqHead = (unsigned *)(cq + p.cq_off.head);
+        _cqTail = (unsigned *)(cq + p.cq_off.tail);
+        _cqMask = *(unsigned *)(cq + p.cq_off.ring_mask);
+        _cqes = (io_uring_cqe *)(cq + p.cq_off.cqes);
+        _toSubmit = 0;
+        _pending = 0;
+        return true;
+    }
+
+    void close() {
+        if (_fd < 0) return;
+        munmap(_sqes, _sqesSize);
+        if (_cq != _sq) munmap(_cq, _cqSize);
+        munmap(_sq, _sqSize);
+        ::close(_fd);
+        _fd = -1;
+    }
+
+    // queues a readv of iov (which must stay valid until it completes).  false if the queue is full.
+    bool queue_readv(int fd, const iovec *iov, uint64_t offset, uint64_t userData) {
+        unsigned tail = *_sqTail;
+        if (tail - __atomic_load_n(_sqHead, __ATOMIC_ACQUIRE) >= _sqEntries) return false;
+        unsigned index = tail & _sqMask;
+        io_uring_sqe *sqe = &_sqes[index];
+        memset(sqe, 0, sizeof(*sqe));
+        sqe->opcode = IORING_OP_READV;
+        sqe->fd = fd;
+        sqe->addr = (uint64_t)(uintptr_t)iov;
+        sqe->len = 1;
+        sqe->off = offset;
+        sqe->user_data = userData;
+        _sqArray[index] = index;
+        __atomic_store_n(_sqTail, tail + 1, __ATOMIC_RELEASE);
+        ++_toSubmit;
+        ++_pending;
+        return true;
+    }
+
+    // submits what is queued, and waits for at least minComplete completions
+    bool enter(unsigned minComplete) {
+        int r = (int)syscall(__NR_io_uring_enter, _fd, _toSubmit, minComplete, minComplete ? IORING_ENTER_GETEVENTS : 0, nullptr, 0);
+        if (r < 0) return errno == EINTR;
+        _toSubmit -= std::min(_toSubmit, (unsigned)r);
+        return true;
+    }
+
+    // takes one completion, false if there are none
+    bool reap(uint64_t &userData, int &result) {
+        unsigned head = *_cqHead;
+        if (head == __atomic_load_n(_cqTail, __ATOMIC_ACQUIRE)) return false;
+        const io_uring_cqe &cqe = _cqes[head & _cqMask];
+        userData = cqe.user_data;
+        result = cqe.res;
+        __atomic_store_n(_cqHead, head + 1, __ATOMIC_RELEASE);
+        --_pending;
+        return true;
+    }
+
+    // after enter() fails:  waits for the reads the kernel has already taken, discarding their
+    // completions, so the buffers they read into can be released.  Queued reads it hasn't taken never run.
+    void drain() {
+        uint64_t userData;
+        int result;
+        for (;;) {
+            while (reap(userData, result)) {}
+            unsigned untaken = *_sqTail - __atomic_load_n(_sqHead, __ATOMIC_ACQUIRE);
+            if (_pending <= untaken) return;
+            if (syscall(__NR_io_uring_enter, _fd, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0) < 0 && errno != EINTR) {
+                // can't wait in the kernel (EBUSY, ENOMEM, ...):  poll for the completions instead
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        }
+    }
+
+private:
+    int _fd;
+    void *_sq, *_cq;
+    io_uring_sqe *_sqes;
+    size_t _sqSize, _cqSize, _sqesSize;
+    unsigned *_sqHead, *_sqTail, *_sqArray, *_cqHead, *_cqTail;
+    unsigned _sqMask, _sqEntries, _cqMask;
+    io_uring_cqe *_cqes;
+    unsigned _toSubmit;     // queued but not yet passed to io_uring_enter
+    unsigned _pending;      // queued and not yet reaped
+};
+
+//-------------------------------------------------------------------------
+
+// inherit from this, override file_path() and do_buffer() with your own methods.
+// Then run() it, like a worker with a scheduler.
+struct read_ahead : worker {
+    read_ahead() : _usingRing(false), _forceThreads(false) {}
+
+    // the path of file `index`, called from the I/O thread
+    virtual std::string file_path(int index) =0;
+
+    // called once per file, from the pool's threads, with the whole file in memory.
+    // A file that couldn't be read gets data == nullptr.
+    virtual void do_buffer(int index, const char *data, size_t size) =0;
+
+    // reads fileCount files and runs do_buffer over each, across threadCount threads,
+    // keeping up to queueDepth files read ahead.  returns when every file has been processed.
+    void run(int fileCount, int threadCount=0, int queueDepth=READ_AHEAD_DEPTH) {
+        _count = fileCount;
+        _depth = std::max(queueDepth, 1);
+        _buffers.assign(fileCount, std::vector<char>());
+        _failed.assign(fileCount, 0);
+        _ready.assign(fileCount, 0);
+        _readyCount = 0;
+        _issued = 0;
+        _processed = 0;
+
+        scheduler s(this, 0, threadCount);
+        _scheduler = &s;
+        s.run();    // its threads wait for add_work() from the I/O stage
+
+        io_ring ring;
+        _usingRing = !_forceThreads && ring.open((unsigned)_depth);
+        if (_usingRing) {
+            ring_reader(ring);
+        } else {
+            std::vector<std::thread> readers;
+            for (int i = 0; i < std::min(READ_AHEAD_FALLBACK_THREADS, _depth); ++i) readers.push_back(std::thread(&read_ahead::thread_reader, this));
+            for (auto &r : readers) r.join();
+        }
+        s.join();
+        _scheduler = nullptr;
+    }
+
+    // whether the last run() used io_uring, rather than the reader threads
+    bool using_io_uring() const {return _usingRing;}
+
+    // makes run() use the reader threads even when io_uring is available
+    void force_reader_threads(bool force) {_forceThreads = force;}
+
+    // the scheduler's work item:  work counts files in the order they finished reading
+    void do_work(int work) {
+        int index;
+        {
+            std::lock_guard<std::mutex> lk(_mutex);
+            index = _ready[work];
+        }
+        std::vector<char> &buffer = _buffers[index];
+        const char *data = buffer.empty() ? "" : buffer.data();    // an empty file still gets a pointer
+        do_buffer(index, _failed[index] ? nullptr : data, buffer.size());
+        std::vector<char>().swap(buffer);   // give the memory back now, not at the end
+        {
+            std::lock_guard<std::mutex> lk(_mutex);
+            ++_processed;
+        }
+        _room.notify_all();
+    }
+
+private:
+    scheduler *_scheduler;
+    int _count;
+    int _depth;
+    std::vector<std::vector<char>> _buffers;    // file contents, by file index
+    std::vector<unsigned char> _failed;         // by file index
+    std::vector<int> _ready;        // work item k is file _ready[k]
+    int _readyCount;
+    int _issued;                    // files whose read has been started
+    int _processed;                 // files whose do_buffer has returned
+    std::mutex _mutex;              // guards _ready, _readyCount, _issued and _processed
+    std::condition_variable _room;  // signalled when a file is processed, so there's room to read another
+    bool _usingRing;
+    bool _forceThreads;
+
+    // hands a file to the scheduler
+    void dispatch(int index, bool failed) {
+        _failed[index] = failed;
+        {
+            std::lock_guard<std::mutex> lk(_mutex);
+            _ready[_readyCount++] = index;
+        }
+        _scheduler->add_work();
+    }
+
+    // claims the next file to read if there's room ahead of the workers, waiting
+    // for room if wait is set.  -1 when there is no file, or no room and !wait.
+    int claim(bool wait) {
+        std::unique_lock<std::mutex> lk(_mutex);
+        if (wait) _room.wait(lk, [this] {return _issued >= _count || _issued - _processed < _depth;});
+        if (_issued >= _count || _issued - _processed >= _depth) return -1;
+        return _issued++;
+    }
+
+    // opens file index and sizes its buffer.  returns the fd, or -1 (after dispatching it as failed or empty).
+    int open_file(int index) {
+        std::string path = file_path(index);
+        int fd = ::open(path.c_str(), O_RDONLY);
+        struct stat st;
+        if (fd < 0 || fstat(fd, &st) != 0) {
+            if (fd >= 0) ::close(fd);
+            dispatch(index, true);
+            return -1;
+        }
+        _buffers[index].resize((size_t)st.st_size);
+        if (st.st_size == 0) {
+            ::close(fd);
+            dispatch(index, false);
+            return -1;
+        }
+        return fd;
+    }
+
+    //-------------------------------------------------------------------------
+    // io_uring:  one thread keeps the ring topped up and dispatches completions
+
+    struct ring_request {
+        int index;
+        int fd;
+        size_t done;    // bytes read so far
+        iovec iov;
+    };
+
+    void ring_reader(io_ring &ring) {
+        std::vector<ring_request> requests(_depth);
+        std::vector<int> freeSlots;
+        for (int i = _depth - 1; i >= 0; --i) freeSlots.push_back(i);
+        int inFlight = 0;
+        int finished = 0;   // files dispatched
+
+        auto queue = [&](int slot) {
+            ring_request &r = requests[slot];
+            std::vector<char> &buffer = _buffers[r.index];
+            r.iov.iov_base = buffer.data() + r.done;
+            r.iov.iov_len = buffer.size() - r.done;
+            ring.queue_readv(r.fd, &r.iov, r.done, (uint64_t)slot);
+        };
+
+        while (finished < _count) {
+            // top up:  start reads while there's room ahead of the workers
+            int index;
+            while (!freeSlots.empty() && (index = claim(inFlight == 0)) >= 0) {
+                int fd = open_file(index);
+                if (fd < 0) {
+                    ++finished;
+                    continue;
+                }
+                int slot = freeSlots.back();
+                freeSlots.pop_back();
+                requests[slot] = {index, fd, 0, iovec()};
+                queue(slot);
+                ++inFlight;
+            }
+            if (inFlight == 0) continue;    // claim() waited, or everything left failed to open
+
+            if (!ring.enter(1)) {
+                // the ring is broken.  The kernel may still be reading into buffers it has taken, so wait
+                // for those, then report what's in flight as failed, and read the rest with a thread
+                ring.drain();
+                for (int slot = 0; slot < _depth; ++slot) {
+                    if (std::find(freeSlots.begin(), freeSlots.end(), slot) != freeSlots.end()) continue;
+                    ::close(requests[slot].fd);
+                    dispatch(requests[slot].index, true);
+                }
+                thread_reader();
+                return;
+            }
+            uint64_t slot;
+            int result;
+            while (ring.reap(slot, result)) {
+                ring_request &r = requests[slot];
+                if (result > 0) r.done += result;
+                if (result > 0 && r.done < _buffers[r.index].size()) {
+                    queue((int)slot);   // a short read, go again for the rest
+                    continue;
+                }
+                ::close(r.fd);
+                if (result >= 0) _buffers[r.index].resize(r.done);  // the file may have shrunk
+                dispatch(r.index, result < 0);
+                freeSlots.push_back((int)slot);
+                --inFlight;
+                ++finished;
+            }
+        }
+    }
+
+    //-------------------------------------------------------------------------
+    // fallback:  each reader thread claims a file, preads all of it, dispatches it
+
+    void thread_reader() {
+        int index;
+        while ((index = claim(true)) >= 0) {
+            int fd = open_file(index);
+            if (fd < 0) continue;
+            std::vector<char> &buffer = _buffers[index];
+            size_t done = 0;
+            bool failed = false;
+            while (done < buffer.size()) {
+                ssize_t r = pread(fd, buffer.data() + done, buffer.size() - done, (off_t)done);
+                if (r < 0 && errno == EINTR) continue;
+                if (r <= 0) {
+                    failed = r < 0;
+                    break;
+                }
+                done += (size_t)r;
+            }
+            ::close(fd);
+            buffer.resize(done);
+            dispatch(index, failed);
+        }
+    }
+};
+
+#endif /* read_ahead_h */
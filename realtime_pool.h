@@ -0,0 +1,230 @@
+//
+//  realtime_pool.h
+//  A low jitter pool for control loops that run a small batch of work every
+//  cycle and care about the worst cycle, not the average.  scheduler makes
+//  new threads for every run(), and its threads share the CPU with everything
+//  else under CFS;  here the threads are made once and, where the system
+//  permits, given a real-time policy (SCHED_FIFO or SCHED_RR), pinned to
+//  chosen CPUs, with their stacks and malloc arenas touched up front and,
+//  if asked, the process's memory locked, so a cycle doesn't stop for a page
+//  fault.  lockMemory and keepHeap change the whole process, not just the
+//  pool, and last after it is gone, so they are off by default.
+//
+//  run() allocates nothing and takes no lock unless a thread has to sleep:
+//  a batch's worker and size go in one of two slots picked by its
+//  generation, the generation is then published atomically, indices are
+//  claimed with a compare and swap on a word holding the generation and the
+//  next index (so a thread still leaving the last batch, or one that read a
+//  slot since reused, can't claim from this one), and idle threads spin a
+//  little before blocking so back to back cycles don't pay for a wake up.
+//
+//  Each setting is best effort:  what was actually granted is reported, and
+//  the pool works (with more jitter) without any of it.  Linux only.
+//
+
+#ifndef realtime_pool_h
+#define realtime_pool_h
+
+#include "scheduler.h"
+#include <alloca.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <malloc.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+
+struct realtime_options {
+    int policy = SCHED_FIFO;            // SCHED_FIFO, SCHED_RR, or SCHED_OTHER to leave the policy alone
+    int priority = 10;                  // 1 (low) .. 99 for the real-time policies
+    std::vector<int> cpus;              // pool thread i is pinned to cpus[i % cpus.size()], empty to not pin
+    size_t prefaultStackBytes = 256 * 1024;     // stack each thread touches before its first batch
+    size_t prefaultHeapBytes = 1 << 20;         // malloc arena each thread touches
+    // process wide, and not undone when the pool is destroyed:
+    bool keepHeap = false;              // mallopt so malloc never trims or mmaps, keeping what was touched touched
+    bool lockMemory = false;            // mlockall, so nothing is paged out later.  Under RLIMIT_MEMLOCK,
+                                        // later allocations anywhere in the process can fail.
+    int spinMicroseconds = 50;          // how long an idle thread spins for the next batch before sleeping.
+                                        // Only spent when there are more CPUs than pool threads.
+};
+
+// what make_thread_realtime managed
+#define REALTIME_POLICY_GRANTED 1
+#define REALTIME_PINNED         2
+
+// applies policy, priority and a cpu (or -1) to the calling thread.  returns the bits of
+// REALTIME_POLICY_GRANTED and REALTIME_PINNED that took.
+inline int make_thread_realtime(const realtime_options &options, int cpu) {
+    int granted = 0;
+    if (options.policy != SCHED_OTHER) {
+        sched_param param;
+        memset(&param, 0, sizeof(param));
+        param.sched_priority = options.priority;
+        if (pthread_setschedparam(pthread_self(), options.policy, &param) == 0) granted |= REALTIME_POLICY_GRANTED;
+    }
+    if (cpu >= 0) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0) granted |= REALTIME_PINNED;
+    }
+    return granted;
+}
+
+// touches bytes of the calling thread's stack, so later calls that deep don't fault
+inline void prefault_stack(size_t bytes) {
+    volatile char *stack = (volatile char *)alloca(bytes);
+    for (size_t i = 0; i < bytes; i += 4096) stack[i] = 0;
+}
+
+// touches bytes of the calling thread's malloc arena and gives them back to it, not to the system
+inline void prefault_heap(size_t bytes) {
+    if (bytes == 0) return;
+    char *p = (char *)malloc(bytes);
+    if (!p) return;
+    for (size_t i = 0; i < bytes; i += 4096) p[i] = 0;
+    free(p);
+}
+
+struct realtime_pool {
+    realtime_pool(int threadCount=0, const realtime_options &options=realtime_options())
+        : _options(options), _threadCount(scheduler::resolve_thread_count(threadCount)),
+          _generation(0), _claim(0), _done(0), _sleepers(0), _stopping(false), _ready(0), _granted(0), _memoryLocked(false) {
+        if (options.keepHeap) {
+            // keep freed memory in the arenas, and don't mmap big blocks, so what is touched now stays touched
+            mallopt(M_TRIM_THRESHOLD, -1);
+            mallopt(M_MMAP_MAX, 0);
+        }
+        if (options.lockMemory) _memoryLocked = mlockall(MCL_CURRENT | MCL_FUTURE) == 0;
+        // spinning on a CPU the batch's publisher needs only delays the next batch
+        if ((int)std::thread::hardware_concurrency() <= _threadCount) _options.spinMicroseconds = 0;
+        _grantedPerThread.assign(_threadCount, 0);
+        for (int i = 0; i < _threadCount; ++i) _threads.push_back(std::thread(&realtime_pool::thread_main, this, i));
+        // wait for every thread to be set up, so the first run() doesn't pay for it
+        std::unique_lock<std::mutex> lk(_mutex);
+        _readyCv.wait(lk, [this] {return _ready == _threadCount;});
+        _granted = REALTIME_POLICY_GRANTED | REALTIME_PINNED;
+        for (int g : _grantedPerThread) _granted &= g;
+    }
+
+    ~realtime_pool() {
+        {
+            std::lock_guard<std::mutex> lk(_mutex);
+            _stopping = true;
+        }
+        _cv.notify_all();
+        for (auto &th : _threads) th.join();
+    }
+
+    // runs w->do_work(0 .. maxWork-1) across the pool, returns when they are all done.
+    // The calling thread waits;  one run at a time.
+    void run(worker *w, int maxWork) {
+        if (maxWork < 1) return;
+        unsigned generation = _generation.load() + 1;
+        // the slot the batch before last used:  any thread that still reads it for that batch
+        // fails its claim, because the claim word has moved on two generations
+        realtime_batch &batch = _batches[generation & 1];
+        batch.w.store(w);
+        batch.maxWork.store(maxWork);
+        _done.store(0, std::memory_order_relaxed);
+        _claim.store((uint64_t)generation << 32);
+        _generation.store(generation);      // publishes the batch
+        if (_sleepers.load() > 0) {
+            std::lock_guard<std::mutex> lk(_mutex);
+            _cv.notify_all();
+        }
+        // the batch is short:  spin for it, then sleep
+        auto spinEnd = std::chrono::steady_clock::now() + std::chrono::microseconds(_options.spinMicroseconds);
+        while (_done.load(std::memory_order_acquire) < maxWork) {
+            if (std::chrono::steady_clock::now() < spinEnd) continue;
+            std::unique_lock<std::mutex> lk(_mutex);
+            _doneCv.wait(lk, [this, maxWork] {return _done.load() >= maxWork;});
+        }
+    }
+
+    int number_of_threads_used() const {return _threadCount;}
+
+    // whether every thread got the real-time policy
+    bool realtime_granted() const {return (_granted & REALTIME_POLICY_GRANTED) != 0;}
+
+    // whether every thread was pinned (false if options.cpus was empty)
+    bool pinned() const {return (_granted & REALTIME_PINNED) != 0;}
+
+    bool memory_locked() const {return _memoryLocked;}
+
+private:
+    realtime_options _options;
+    int _threadCount;
+    struct realtime_batch {
+        std::atomic<worker *> w{nullptr};
+        std::atomic<int> maxWork{0};
+    };
+    realtime_batch _batches[2];     // batch g is in _batches[g & 1], written before g is published
+    std::atomic<unsigned> _generation;  // bumped to publish a batch
+    std::atomic<uint64_t> _claim;   // the batch's generation above the next index to claim
+    std::atomic<int> _done;         // indices finished
+    std::atomic<int> _sleepers;     // threads blocked on _cv
+    bool _stopping;
+    std::mutex _mutex;              // only for sleeping:  guards _stopping and _ready
+    std::condition_variable _cv;    // pool threads sleep here between batches
+    std::condition_variable _doneCv;    // run() sleeps here if a batch runs long
+    std::condition_variable _readyCv;
+    int _ready;
+    std::vector<int> _grantedPerThread;
+    int _granted;
+    bool _memoryLocked;
+    std::vector<std::thread> _threads;
+
+    void thread_main(int index) {
+        int cpu = _options.cpus.empty() ? -1 : _options.cpus[index % _options.cpus.size()];
+        int granted = make_thread_realtime(_options, cpu);
+        prefault_stack(_options.prefaultStackBytes);
+        prefault_heap(_options.prefaultHeapBytes);
+        {
+            std::lock_guard<std::mutex> lk(_mutex);
+            _grantedPerThread[index] = granted;
+            ++_ready;
+        }
+        _readyCv.notify_all();
+
+        unsigned seen = 0;
+        for (;;) {
+            // wait for a new generation:  spin, then sleep
+            auto spinEnd = std::chrono::steady_clock::now() + std::chrono::microseconds(_options.spinMicroseconds);
+            while (_generation.load(std::memory_order_acquire) == seen && std::chrono::steady_clock::now() < spinEnd) {}
+            if (_generation.load(std::memory_order_acquire) == seen) {
+                std::unique_lock<std::mutex> lk(_mutex);
+                ++_sleepers;
+                _cv.wait(lk, [this, seen] {return _stopping || _generation.load() != seen;});
+                --_sleepers;
+                if (_generation.load() == seen) return;     // stopping
+            }
+            seen = _generation.load(std::memory_order_acquire);
+
+            // only trusted once a claim in generation seen succeeds:  that proves the slot
+            // still held batch seen when it was read
+            realtime_batch &batch = _batches[seen & 1];
+            worker *w = batch.w.load();
+            int maxWork = batch.maxWork.load();
+            for (;;) {
+                uint64_t claim = _claim.load();
+                if ((unsigned)(claim >> 32) != seen || (int)(uint32_t)claim >= maxWork) break;
+                if (!_claim.compare_exchange_weak(claim, claim + 1)) continue;
+                w->do_work((int)(uint32_t)claim);
+                if (_done.fetch_add(1, std::memory_order_acq_rel) + 1 == maxWork) {
+                    std::lock_guard<std::mutex> lk(_mutex);
+                    _doneCv.notify_one();
+                }
+            }
+        }
+    }
+};
+
+#endif /* realtime_pool_h */
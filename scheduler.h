@@ -16,11 +16,17 @@
 #include <thread>
 #include <mutex>
 #include <vector>
+#include <deque>
+#include <atomic>
+#include <chrono>
 #include <condition_variable>
 #ifdef __DEBUG__
 #include <iostream>
 #endif
 
+// what get_work returns, instead of an index, when priority work is waiting
+#define SCHEDULER_PRIORITY_WORK -2
+
 // inherit from this, override do_work() with your own method
 struct worker {
     virtual void do_work(int work) =0;
@@ -29,12 +35,21 @@ struct worker {
 
 struct scheduler {
 
-    scheduler(worker *w, int maxWork, int threadCount=0) : _maxWork(maxWork), _nextWork(0), _threadCount(threadCount), _w(w) {
-        if (_threadCount < 1) {
-            // initialize with the number of threads hardware says we have
-            _threadCount = std::thread::hardware_concurrency();
-        }
+    scheduler(worker *w, int maxWork, int threadCount=0) : _maxWork(maxWork), _nextWork(0), _threadCount(threadCount), _w(w), _priorityPending(0) {
+        _threadCount = resolve_thread_count(_threadCount);
         _doneAddingWork = false;  // used by wait
+        _expired = false;
+        _running = false;
+    }
+
+    // the number of threads a scheduler constructed with threadCount will use.
+    // Less than 1 means use the number of threads hardware says we have.
+    static int resolve_thread_count(int threadCount) {
+        if (threadCount < 1) {
+            threadCount = std::thread::hardware_concurrency();
+            if (threadCount < 1) threadCount = 1;  // hardware_concurrency may not know
+        }
+        return threadCount;
     }
 
     void add_work(int new_work=1) {
@@ -45,10 +60,38 @@ struct scheduler {
         _cv.notify_one();
     }
 
+    // queues w->do_work(work) ahead of all other work.  A free thread takes it before its next
+    // index, and a busy one runs it at its next yield_point().  Work queued after the pool's
+    // threads have finished is run by join() (or run_for()) on the calling thread, so anything
+    // added before join() returns runs;  add none after.
+    void add_priority_work(worker *w, int work) {
+        {
+            std::lock_guard<std::mutex> lk(_workMutex);
+            _priority.push_back({w, work});
+            ++_priorityPending;
+        }
+        _cv.notify_one();
+    }
+
+    // for long running do_work() calls to make now and then:  runs any priority work queued on
+    // this thread's scheduler right here, on this thread, before returning.  returns whether it
+    // ran any.  Costs one atomic load when there is none, and does nothing off a pool thread.
+    static bool yield_point() {
+        scheduler *s = current_ref();
+        if (!s || s->_priorityPending.load(std::memory_order_relaxed) == 0) return false;
+        bool ran = false;
+        while (s->run_priority_work()) ran = true;
+        return ran;
+    }
+
     // resets the starting work load index.  Then creates a number of threads to do work.
     void run() {
         _threads.clear();   // clear away any old threads stored from possible previous invocations
         _nextWork = 0;   // reset so we can have multiple, sequential runs per object
+        {
+            std::lock_guard<std::mutex> lk(_workMutex);
+            _running = true;
+        }
         for (int i = 0; i<_threadCount; ++i) {
             _threads.push_back(std::thread(code_block, i, this, _w));
         }
@@ -63,11 +106,56 @@ struct scheduler {
         _cv.notify_all();
         for (auto& th : _threads) th.join();
         _threads.clear();   // clear away the threads now that we are done with them
+        while (run_priority_work()) {}  // queued too late for the pool's threads
+        std::lock_guard<std::mutex> lk(_workMutex);
+        _running = false;
+    }
+
+    // a time budgeted run:  like run() then join(), but no more work is handed out once budget has
+    // passed, and the items already started finish.  returns which work indices completed.
+    // Work is handed out in index order, so that is always a prefix - order the work coarse to fine
+    // (see progressive_order) and any prefix is a usable partial result.  Not for use with add_work().
+    std::vector<bool> run_for(std::chrono::microseconds budget) {
+        auto deadline = std::chrono::steady_clock::now() + budget;
+        {
+            std::lock_guard<std::mutex> lk(_workMutex);
+            _doneAddingWork = true;     // all of the work is known up front
+            _expired = false;
+        }
+        run();
+        {
+            std::unique_lock<std::mutex> lk(_workMutex);
+            _claimedCv.wait_until(lk, deadline, [this] {return _nextWork >= _maxWork;});
+            _expired = true;
+        }
+        for (auto& th : _threads) th.join();
+        _threads.clear();
+        while (run_priority_work()) {}
+        std::vector<bool> completed(_maxWork > 0 ? _maxWork : 0, false);
+        for (int i = 0; i < _nextWork && i < _maxWork; ++i) completed[i] = true;
+        std::lock_guard<std::mutex> lk(_workMutex);
+        _expired = false;
+        _running = false;
+        return completed;
+    }
+
+    // work indices added but not yet handed out to a thread.  A snapshot, for code that
+    // wants to stay out of this scheduler's way (see background_lane.h).  0 when no thread
+    // will hand them out:  before run(), after join(), and once run_for's budget has passed.
+    int pending_work() {
+        std::lock_guard<std::mutex> lk(_workMutex);
+        if (!_running || _expired) return 0;
+        return _maxWork > _nextWork ? _maxWork - _nextWork : 0;
     }
 
     // total number of threads, either passed in or by hardware query, set in initializer
     int number_of_threads_used() const {return _threadCount;}
 
+    // the threadID (0 .. number_of_threads_used()-1) of the pool thread calling this,
+    // like CUDA's threadIdx.  -1 when called from a thread the scheduler didn't create.
+    // Lets do_work index per thread scratch space without any locking.
+    static int thread_index() {return thread_index_ref();}
+
 private:
 
     // internal private variables
@@ -79,25 +167,63 @@ private:
     std::mutex _workMutex;  // a shared mutex to lock access to _nextWork between threads
     std::condition_variable _cv;    // allows for the addition of workloads to the queue, works with _workMutex and _doneAddingWork to make that happen
     bool _doneAddingWork;   // tells scheduler that the client is done adding work, just wait out the queue now
+    bool _expired;  // run_for's budget has passed, hand out no more work
+    bool _running;  // between run() and the end of join() or run_for(), guarded by _workMutex
+    std::condition_variable _claimedCv;     // run_for waits on this for the last index to be handed out, works with _workMutex
+    struct priority_task {
+        worker *w;
+        int work;
+    };
+    std::deque<priority_task> _priority;    // add_priority_work's queue, guarded by _workMutex
+    std::atomic<int> _priorityPending;      // _priority.size(), readable without the lock for yield_point
 #ifdef __DEBUG__
     std::mutex _printMutex;  // a shared mutex for std::cout usage
     static thread_local int _callCount;     // per thread, number of times this thread was used
 #endif
 
 
+    // storage for thread_index(), a function local so the header needs no out of line definition
+    static int &thread_index_ref() {
+        static thread_local int threadIndex = -1;
+        return threadIndex;
+    }
+
+    // the scheduler whose pool the calling thread belongs to, for yield_point()
+    static scheduler *&current_ref() {
+        static thread_local scheduler *current = nullptr;
+        return current;
+    }
+
+    // takes one priority task off the queue and runs it.  false if there was none.
+    bool run_priority_work() {
+        if (_priorityPending.load(std::memory_order_relaxed) == 0) return false;
+        priority_task task;
+        {
+            std::lock_guard<std::mutex> lk(_workMutex);
+            if (_priority.empty()) return false;
+            task = _priority.front();
+            _priority.pop_front();
+            --_priorityPending;
+        }
+        task.w->do_work(task.work);
+        return true;
+    }
+
     // this function has a lock around a work index counter.  As a thread
     // requests more work, update the index and return it to the code_block to
     // pass to the actual worker method.
-    // returns -1 when there are no more indexes of work.
+    // returns -1 when there are no more indexes of work, and SCHEDULER_PRIORITY_WORK when priority work is waiting.
     // is called by multiple threads of code_block.
     // _cv.wait - if the client is done adding work, or there is already work in the queue, then grab the lock and let this thread claim some of the workload
     int get_work() {
         std::unique_lock<std::mutex> lk(_workMutex);
-        _cv.wait(lk, [this] {return _doneAddingWork || (_nextWork < _maxWork);});
-        if (_nextWork < _maxWork) {
+        _cv.wait(lk, [this] {return _doneAddingWork || (_nextWork < _maxWork) || !_priority.empty();});
+        if (!_priority.empty()) return SCHEDULER_PRIORITY_WORK;
+        if (_nextWork < _maxWork && !_expired) {
 #ifdef __DEBUG__
             ++_callCount;
 #endif
+            if (_nextWork + 1 == _maxWork) _claimedCv.notify_all();
             return _nextWork++;
         }
         return -1;
@@ -107,11 +233,14 @@ private:
     // it gets the next index of work, if it is -1 then this thread is done.
     // Otherwise, it invokes the do_work method with that work index.
     // Repeat until this thread has no more work to do from the pool.
-    // threadID is used for debugging.
+    // threadID is used for debugging, and is what thread_index() returns.
     static void code_block(int threadID, scheduler *t, worker *w) {
+        thread_index_ref() = threadID;
+        current_ref() = t;
         int work = t->get_work();
         while (work != -1) {
-            w->do_work(work);
+            if (work == SCHEDULER_PRIORITY_WORK) t->run_priority_work();
+            else w->do_work(work);
             work = t->get_work();
         }
         #ifdef __DEBUG__
@@ -125,4 +254,46 @@ private:
 thread_local int scheduler::_callCount = 0;
 #endif
 
+
+// wraps any callable taking an int, so library algorithms (and clients) can
+// hand a lambda to the scheduler without writing a worker subclass each time
+template <typename F>
+struct function_worker : worker {
+    function_worker(F f) : _f(f) {}
+    void do_work(int work) {_f(work);}
+private:
+    F _f;
+};
+
+// runs maxWork items of w on a fresh scheduler, returns when they are all done
+inline void run_work(worker *w, int maxWork, int threadCount=0) {
+    if (maxWork < 1) return;
+    scheduler s(w, maxWork, threadCount);
+    s.run();
+    s.join();
+}
+
+// calls f(0) .. f(maxWork-1) across the thread pool, returns when all are done
+template <typename F>
+void parallel_for(int maxWork, F f, int threadCount=0) {
+    function_worker<F> w(f);
+    run_work(&w, maxWork, threadCount);
+}
+
+// a coarse to fine order of n items, for run_for:  0, then n/2, then n/4 and 3n/4, and so on
+// (halving the stride each level), so any prefix of it samples the whole range evenly.
+// work index i should do item order[i].
+inline std::vector<int> progressive_order(int n) {
+    std::vector<int> order;
+    if (n < 1) return order;
+    order.reserve(n);
+    order.push_back(0);
+    int step = 1;
+    while (step < n) step <<= 1;
+    for (; step > 1; step >>= 1) {
+        for (int i = step / 2; i < n; i += step) order.push_back(i);
+    }
+    return order;
+}
+
 #endif /* scheduler_h */
@@ -0,0 +1,155 @@
+//
+//  selection.h
+//  Selection without a full sort, on the scheduler.
+//  parallel_top_k - each pool thread keeps a bounded heap of the best k it has
+//                   seen across the tiles it ran, the heaps are merged at the end.
+//  parallel_nth_element - picks two pivots from a sample so the target rank
+//                   very likely lands between them, partitions the range three
+//                   ways in parallel, and repeats on the part holding the target
+//                   until it is small enough for std::nth_element.
+//
+
+#ifndef selection_h
+#define selection_h
+
+#include "scheduler.h"
+#include <algorithm>
+#include <cstddef>
+#include <functional>
+#include <random>
+#include <vector>
+
+// elements per work item
+#define SELECT_TILE     (1 << 16)
+
+// ranges at or below this size are finished with std::nth_element on the calling thread
+#define SELECT_SERIAL_SIZE  (1 << 16)
+
+// elements sampled to choose the pivots for each parallel partitioning round
+#define SELECT_SAMPLE   1024
+
+inline int select_tile_count(size_t n) {
+    return (int)((n + SELECT_TILE - 1) / SELECT_TILE);
+}
+
+//-------------------------------------------------------------------------
+
+// copies the k largest elements of data[0..n), by comp, into out, largest first.
+// returns how many were copied, min(k, n).  Ties are broken arbitrarily.
+template <typename T, typename Compare = std::less<T>>
+size_t parallel_top_k(const T *data, size_t n, size_t k, T *out, Compare comp = Compare(), int threadCount=0) {
+    k = std::min(k, n);
+    if (k == 0) return 0;
+    int threads = scheduler::resolve_thread_count(threadCount);
+
+    // "greater" puts the smallest kept element at the front of each heap, the one to evict
+    auto greater = [&](const T &a, const T &b) {return comp(b, a);};
+    std::vector<std::vector<T>> heaps(threads);
+    for (auto &h : heaps) h.reserve(k);
+
+    parallel_for(select_tile_count(n), [&](int t) {
+        std::vector<T> &heap = heaps[scheduler::thread_index()];
+        size_t last = std::min((size_t)(t+1) * SELECT_TILE, n);
+        for (size_t i = (size_t)t * SELECT_TILE; i < last; ++i) {
+            if (heap.size() < k) {
+                heap.push_back(data[i]);
+                std::push_heap(heap.begin(), heap.end(), greater);
+            } else if (comp(heap.front(), data[i])) {
+                std::pop_heap(heap.begin(), heap.end(), greater);
+                heap.back() = data[i];
+                std::push_heap(heap.begin(), heap.end(), greater);
+            }
+        }
+    }, threads);
+
+    // at most threads * k candidates left, pick the best k of them
+    std::vector<T> candidates;
+    candidates.reserve((size_t)threads * k);
+    for (auto &h : heaps) candidates.insert(candidates.end(), h.begin(), h.end());
+    std::partial_sort(candidates.begin(), candidates.begin() + k, candidates.end(), greater);
+    std::copy(candidates.begin(), candidates.begin() + k, out);
+    return k;
+}
+
+//-------------------------------------------------------------------------
+
+// stable three way partition of data[0..n) through scratch:  elements less
+// than lo, then those from lo to hi, then those greater than hi.
+// counts gets the size of each of the three parts.
+template <typename T, typename Compare>
+void select_partition3(T *data, size_t n, T *scratch, const T &lo, const T &hi, Compare comp, size_t counts[3], int threadCount) {
+    auto part = [&](const T &v) {return comp(v, lo) ? 0 : (comp(hi, v) ? 2 : 1);};
+    int tiles = select_tile_count(n);
+    std::vector<size_t> offsets((size_t)tiles * 3, 0);
+
+    parallel_for(tiles, [&](int t) {
+        size_t last = std::min((size_t)(t+1) * SELECT_TILE, n);
+        for (size_t i = (size_t)t * SELECT_TILE; i < last; ++i) ++offsets[(size_t)t*3 + part(data[i])];
+    }, threadCount);
+
+    size_t running = 0;
+    for (int p = 0; p < 3; ++p) {
+        size_t start = running;
+        for (int t = 0; t < tiles; ++t) {
+            size_t count = offsets[(size_t)t*3 + p];
+            offsets[(size_t)t*3 + p] = running;
+            running += count;
+        }
+        counts[p] = running - start;
+    }
+
+    parallel_for(tiles, [&](int t) {
+        size_t *dest = &offsets[(size_t)t*3];
+        size_t last = std::min((size_t)(t+1) * SELECT_TILE, n);
+        for (size_t i = (size_t)t * SELECT_TILE; i < last; ++i) scratch[dest[part(data[i])]++] = data[i];
+    }, threadCount);
+
+    parallel_for(tiles, [&](int t) {
+        size_t first = (size_t)t * SELECT_TILE;
+        std::copy(scratch + first, scratch + std::min(first + SELECT_TILE, n), data + first);
+    }, threadCount);
+}
+
+// same contract as std::nth_element:  afterwards data[nth] is the element a
+// full sort would put there, nothing before it is greater and nothing after it is less.
+template <typename T, typename Compare = std::less<T>>
+void parallel_nth_element(T *data, size_t n, size_t nth, Compare comp = Compare(), int threadCount=0) {
+    if (nth >= n) return;
+    std::vector<T> scratch;
+    std::minstd_rand rng(12345);    // fixed seed, so runs are repeatable
+    size_t first = 0;   // the range [first, first+count) holds position nth
+    size_t count = n;
+
+    while (count > SELECT_SERIAL_SIZE) {
+        // the sample's rank of the target, and pivots a few standard deviations either side of it
+        std::vector<T> sample(SELECT_SAMPLE);
+        for (auto &s : sample) s = data[first + rng() % count];
+        std::sort(sample.begin(), sample.end(), comp);
+        const size_t rank = (size_t)((double)(nth - first) / count * SELECT_SAMPLE);
+        const size_t spread = 3 * 16;   // ~3 sigma of sqrt(SELECT_SAMPLE)/2
+        const T lo = sample[rank > spread ? rank - spread : 0];
+        const T hi = sample[std::min(rank + spread, (size_t)SELECT_SAMPLE - 1)];
+
+        if (scratch.empty()) scratch.resize(n);
+        size_t counts[3];
+        select_partition3(data + first, count, scratch.data(), lo, hi, comp, counts, threadCount);
+
+        size_t middle = first + counts[0];
+        size_t upper = middle + counts[1];
+        if (nth < middle) {
+            count = counts[0];
+        } else if (nth >= upper) {
+            first = upper;
+            count = counts[2];
+        } else {
+            first = middle;
+            count = counts[1];
+            // lo and hi equal means every element in the middle is the same, all done
+            if (!comp(lo, hi)) return;
+        }
+        if (count == counts[0] + counts[1] + counts[2]) break;  // no progress, let the serial code have it
+    }
+    std::nth_element(data + first, data + nth, data + first + count, comp);
+}
+
+#endif /* selection_h */
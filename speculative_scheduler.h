@@ -0,0 +1,198 @@
+//
+//  speculative_scheduler.h
+//  Speculative re-execution of stragglers, for idempotent workers.  One item
+//  that hits a slow moment - a page storm, a preempted thread - can set the
+//  makespan of the whole run.  Once every index has been handed out, threads
+//  that would otherwise go idle look at the items still running, and if one
+//  has run far longer than the items that finished (slowFactor times their
+//  median), start a duplicate of it.  Whichever attempt finishes first wins;
+//  the other is told to stop through speculative_scheduler::cancelled(),
+//  which long items should poll.
+//
+//  An item's attempts can run at the same time, so do_work must be safe to
+//  run twice concurrently:  write identical results, or write per attempt
+//  (speculative_scheduler::attempt()) and keep the winner's.  A duplicate
+//  can't be forced off its thread, so join() still waits for a losing
+//  attempt that doesn't poll cancelled().
+//
+//  Used like a scheduler:  run(), then join().  Each pool thread is one long
+//  running work item of a scheduler, as in event_loop.h.
+//
+
+#ifndef speculative_scheduler_h
+#define speculative_scheduler_h
+
+#include "scheduler.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// how often an idle thread looks for stragglers
+#define SPECULATION_POLL_US     1000
+
+struct speculation_options {
+    double slowFactor = 4;      // an item is a straggler once it has run this many times the median item
+    int minSamples = 8;         // items that must have finished before the median is trusted
+    int64_t minMicroseconds = 1000;     // and never before it has run this long
+};
+
+struct speculative_scheduler : worker {
+    typedef std::chrono::steady_clock clock;
+
+    speculative_scheduler(worker *w, int maxWork, int threadCount=0, const speculation_options &options=speculation_options())
+        : _w(w), _maxWork(maxWork > 0 ? maxWork : 0), _threadCount(scheduler::resolve_thread_count(threadCount)), _options(options),
+          _items(new item_state[_maxWork > 0 ? _maxWork : 1]), _nextWork(0), _doneCount(0), _launched(0), _won(0), _median(0), _medianSamples(0) {}
+    ~speculative_scheduler() {join();}
+
+    void run() {
+        _nextWork = _doneCount = _launched = _won = 0;
+        _durations.clear();
+        _running.clear();
+        _median = 0;
+        _medianSamples = 0;
+        for (int i = 0; i < _maxWork; ++i) {
+            _items[i].attempts = 0;
+            _items[i].winner = -1;
+            _items[i].cancel = false;
+        }
+        _pool.reset(new scheduler(this, _threadCount, _threadCount));     // a work item per thread, each one a dispatch loop
+        _pool->run();
+    }
+
+    // waits for every item to finish, and for losing attempts to return
+    void join() {
+        if (!_pool) return;
+        _pool->join();
+        _pool.reset();
+    }
+
+    // for do_work to poll:  true once another attempt at the running item has won
+    static bool cancelled() {
+        std::atomic<bool> *cancel = current_cancel_ref();
+        return cancel && cancel->load(std::memory_order_relaxed);
+    }
+
+    // which attempt the running item is:  0 for the original, 1 for a duplicate
+    static int attempt() {return current_attempt_ref();}
+
+    // which attempt at work finished first, after join()
+    int winner(int work) const {return _items[work].winner;}
+
+    // duplicates started, and how many of them finished before the original, in the last run
+    int duplicates_launched() const {return _launched;}
+    int duplicates_won() const {return _won;}
+
+    int number_of_threads_used() const {return _threadCount;}
+
+    // the pool's work item:  take indices, then duplicate stragglers, until every item is done
+    void do_work(int thread) {
+        for (;;) {
+            int work = -1;
+            int attempt = 0;
+            {
+                std::unique_lock<std::mutex> lk(_mutex);
+                while (work < 0) {
+                    if (_nextWork < _maxWork) {
+                        work = _nextWork++;
+                        _items[work].start = clock::now();
+                        _items[work].attempts = 1;
+                        _running.push_back(work);
+                    } else if (_doneCount == _maxWork) {
+                        return;
+                    } else if ((work = find_straggler()) >= 0) {
+                        _items[work].attempts = 2;
+                        attempt = 1;
+                        ++_launched;
+                    } else {
+                        _cv.wait_for(lk, std::chrono::microseconds(SPECULATION_POLL_US));
+                    }
+                }
+            }
+
+            item_state &item = _items[work];
+            current_cancel_ref() = &item.cancel;
+            current_attempt_ref() = attempt;
+            auto start = clock::now();
+            _w->do_work(work);
+            auto end = clock::now();
+            current_cancel_ref() = nullptr;
+
+            std::lock_guard<std::mutex> lk(_mutex);
+            if (item.winner >= 0) continue;     // the other attempt won
+            item.winner = attempt;
+            item.cancel = true;                 // tell the other attempt, if there is one
+            if (attempt == 1) ++_won;
+            _running.erase(std::find(_running.begin(), _running.end(), work));
+            _durations.push_back(std::chrono::duration<double, std::micro>(end - start).count());
+            if (++_doneCount == _maxWork) _cv.notify_all();
+        }
+    }
+
+private:
+    struct item_state {
+        clock::time_point start;    // of the original attempt
+        int attempts;
+        int winner;                 // -1 until an attempt finishes
+        std::atomic<bool> cancel;
+    };
+
+    worker *_w;
+    int _maxWork;
+    int _threadCount;
+    speculation_options _options;
+    std::unique_ptr<item_state[]> _items;
+    int _nextWork;
+    int _doneCount;
+    int _launched;
+    int _won;
+    std::vector<double> _durations;     // microseconds, of each finished item's winning attempt
+    std::vector<int> _running;          // items whose original attempt is running, at most one per thread
+    double _median;                     // of the first _medianSamples of _durations
+    size_t _medianSamples;
+    std::mutex _mutex;                  // guards everything above but the cancel flags
+    std::condition_variable _cv;        // idle threads wait here
+    std::unique_ptr<scheduler> _pool;
+
+    // the item running longest past the straggler threshold with no duplicate yet, or -1.  called with _mutex held.
+    int find_straggler() {
+        if ((int)_durations.size() < _options.minSamples || _durations.empty()) return -1;
+        // idle threads call this every poll:  only find the median again once a quarter more items have finished
+        if (_medianSamples == 0 || _durations.size() >= _medianSamples + _medianSamples / 4 + 1) {
+            std::vector<double> d(_durations);
+            std::nth_element(d.begin(), d.begin() + d.size() / 2, d.end());
+            _median = d[d.size() / 2];
+            _medianSamples = d.size();
+        }
+        double threshold = std::max(_options.slowFactor * _median, (double)_options.minMicroseconds);
+        auto now = clock::now();
+        int slowest = -1;
+        double slowestUs = threshold;
+        for (int i : _running) {
+            item_state &item = _items[i];
+            if (item.attempts != 1 || item.winner >= 0) continue;
+            double running = std::chrono::duration<double, std::micro>(now - item.start).count();
+            if (running > slowestUs) {
+                slowest = i;
+                slowestUs = running;
+            }
+        }
+        return slowest;
+    }
+
+    static std::atomic<bool> *&current_cancel_ref() {
+        static thread_local std::atomic<bool> *cancel = nullptr;
+        return cancel;
+    }
+
+    static int &current_attempt_ref() {
+        static thread_local int attempt = 0;
+        return attempt;
+    }
+};
+
+#endif /* speculative_scheduler_h */
@@ -0,0 +1,188 @@
+//
+//  test_background.cpp
+//  Test for background_lane.h.  Checks no background task starts while a
+//  watched scheduler has unclaimed work, that wait_for_idle_foreground()
+//  holds a running task while it does, that a watched scheduler that isn't
+//  running (never run, or past its run_for budget) holds nothing back, and
+//  that everything submitted finishes afterwards.
+//  Then times a foreground job alone, next to the same background load on
+//  ordinary threads, and next to it on a background_lane.
+//
+
+/*
+build this example code from the command line with:
+g++ test_background.cpp -std=c++14 -O2
+*/
+
+#include "../background_lane.h"
+#include "../ext_timer.h"
+#include <iostream>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+
+#define FOREGROUND_ITEMS    400
+#define BACKGROUND_TASKS    200
+#define WORK_US             1000    // per item, foreground and background
+#define CHECKPOINT_US       100     // background work between checkpoints
+#define CHECK_THREADS       4
+#define THREADS             4
+
+//-------------------------------------------------------------------------
+
+void spin(int microseconds) {
+    auto end = std::chrono::steady_clock::now() + std::chrono::microseconds(microseconds);
+    while (std::chrono::steady_clock::now() < end) {}
+}
+
+struct spin_worker : worker {
+    std::atomic<int> _count{0};
+    void do_work(int work) {
+        spin(WORK_US);
+        ++_count;
+    }
+};
+
+// foreground work that holds its thread until let go, so the rest of its scheduler's work stays unclaimed
+struct gated_worker : worker {
+    std::atomic<bool> _open{false};
+    std::atomic<int> _count{0};
+    void do_work(int work) {
+        while (!_open) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        ++_count;
+    }
+};
+
+// background work in slices, calling wait_for_idle_foreground() between them
+struct warming_worker : worker {
+    background_lane *_lane = nullptr;
+    std::atomic<int> _slices{0};
+    std::atomic<int> _count{0};
+    void do_work(int work) {
+        for (int t = 0; t < WORK_US; t += CHECKPOINT_US) {
+            spin(CHECKPOINT_US);
+            ++_slices;
+            if (_lane) _lane->wait_for_idle_foreground();
+        }
+        ++_count;
+    }
+};
+
+bool check() {
+    background_lane lane(CHECK_THREADS);
+    lane.run();
+
+    // a foreground scheduler with work nobody has claimed yet holds the lane back
+    gated_worker fg;
+    scheduler s(&fg, 10, 1);
+    lane.watch(&s);
+    s.run();
+    warming_worker bg;
+    bg._lane = &lane;
+    for (int i = 0; i < 20; ++i) lane.submit(&bg, i);
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    if (bg._slices != 0) {
+        std::cout << "background_lane FAILED, a task started while the foreground had work" << std::endl;
+        return false;
+    }
+    fg._open = true;
+    s.join();
+    lane.unwatch(&s);
+
+    // a long task parks at its yield points while new foreground work waits
+    while (bg._slices == 0) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    fg._open = false;
+    scheduler t(&fg, 10, 1);
+    lane.watch(&t);
+    t.run();
+    std::this_thread::sleep_for(std::chrono::milliseconds(2));     // let running slices reach a checkpoint
+    int before = bg._slices;
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    int after = bg._slices;
+    fg._open = true;
+    t.join();
+    lane.unwatch(&t);
+    if (after != before) {
+        std::cout << "background_lane FAILED, " << after - before << " slices ran past a checkpoint" << std::endl;
+        return false;
+    }
+
+    // a scheduler whose run_for budget ran out, and one never run, leave work unclaimed that no
+    // thread will hand out:  neither may hold the lane back
+    spin_worker slow;
+    scheduler u(&slow, 1000, 1);
+    lane.watch(&u);
+    u.run_for(std::chrono::milliseconds(5));
+    scheduler v(&slow, 10, 1);
+    lane.watch(&v);
+    if (u.pending_work() != 0 || v.pending_work() != 0) {
+        std::cout << "background_lane FAILED, a scheduler that isn't running reports pending work" << std::endl;
+        return false;
+    }
+    for (int i = 0; i < 5; ++i) lane.submit(&bg, i);
+    auto giveUp = std::chrono::steady_clock::now() + std::chrono::seconds(2);
+    while (bg._count < 25 && std::chrono::steady_clock::now() < giveUp) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    lane.unwatch(&u);
+    lane.unwatch(&v);
+    lane.join();
+    if (bg._count != 25 || fg._count != 20) {
+        std::cout << "background_lane FAILED, " << bg._count << " background tasks finished" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+//-------------------------------------------------------------------------
+
+// the foreground job:  FOREGROUND_ITEMS on a scheduler
+double foreground(background_lane *lane) {
+    spin_worker fg;
+    scheduler s(&fg, FOREGROUND_ITEMS, THREADS);
+    if (lane) lane->watch(&s);
+    double wall0 = get_wall_time();
+    s.run();
+    s.join();
+    double wall1 = get_wall_time();
+    if (lane) lane->unwatch(&s);
+    return wall1 - wall0;
+}
+
+int main(int argc, char **argv) {
+    if (!check()) return 1;
+    std::cout << "Correctness checks passed." << std::endl << std::endl;
+
+    std::cout << "---  foreground alone  ---" << std::endl;
+    std::cout << "Wall Time = " << foreground(nullptr) << std::endl << std::endl;
+
+    {
+        warming_worker bg;
+        scheduler b(&bg, BACKGROUND_TASKS, THREADS);
+        b.run();
+        double wall = foreground(nullptr);
+        int doneDuring = bg._count;
+        b.join();
+        std::cout << "---  foreground next to background work on ordinary threads  ---" << std::endl;
+        std::cout << "Wall Time = " << wall << "  background tasks finished meanwhile = " << doneDuring << std::endl << std::endl;
+    }
+
+    {
+        background_lane lane(THREADS);
+        warming_worker bg;
+        bg._lane = &lane;
+        lane.run();
+        for (int i = 0; i < BACKGROUND_TASKS; ++i) lane.submit(&bg, i);
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));     // so the lane is mid task when the foreground arrives
+        double wall = foreground(&lane);
+        int doneDuring = bg._count;
+        lane.join();
+        std::cout << "---  foreground next to a background_lane (" << (lane.idle_priority_granted() ? "SCHED_IDLE" : "nice 19") << ")  ---" << std::endl;
+        std::cout << "Wall Time = " << wall << "  background tasks finished meanwhile = " << doneDuring << std::endl;
+    }
+    return 0;
+}
+
+//-------------------------------------------------------------------------
+//-------------------------------------------------------------------------
+//-------------------------------------------------------------------------
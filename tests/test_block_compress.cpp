@@ -0,0 +1,156 @@
+//
+//  test_block_compress.cpp
+//  Test for block_compress.h.  Builds 64 MB of log-like text with runs and
+//  some random (incompressible) stretches, checks the codec and frames round
+//  trip, that the frame doesn't depend on the thread count, that random
+//  access reads match, and that corrupt frames are rejected.  Then times
+//  compression and decompression on one thread against the pool.
+//
+
+/*
+build this example code from the command line with:
+g++ test_block_compress.cpp -std=c++14 -O2
+*/
+
+#include "../block_compress.h"
+#include "../ext_timer.h"
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+
+#define CHECK_BYTES (8 << 20)
+#define BENCH_BYTES (64 << 20)
+#define CHECK_THREADS   4
+
+//-------------------------------------------------------------------------
+
+std::string make_data(size_t size) {
+    std::mt19937 rng(0);
+    const char *words[] = {"GET", "POST", "/index.html", "/api/v1/items", "200", "404", "user=", "session", "ok", "timeout"};
+    std::string data;
+    data.reserve(size + 256);
+    while (data.size() < size) {
+        switch (rng() % 16) {
+            case 0:     // random bytes, which don't compress
+                for (int i = 0; i < 200; ++i) data += (char)rng();
+                break;
+            case 1:     // a run
+                data.append(rng() % 300, (char)('a' + rng() % 26));
+                break;
+            default:
+                data += std::to_string(1600000000 + data.size() / 97) + ' ';
+                for (int w = 0; w < 6; ++w) {
+                    data += words[rng() % 10];
+                    data += ' ';
+                }
+                data += std::to_string(rng() % 1000) + '\n';
+                break;
+        }
+    }
+    data.resize(size);
+    return data;
+}
+
+bool check() {
+    // the codec alone, on edge cases
+    std::vector<std::string> cases = {"", "a", "abcd", std::string(100000, 'z'), "abcabcabcabcabcabcabcabcabcabc", make_data(100000)};
+    for (auto &c : cases) {
+        std::vector<char> packed(lz_bound(c.size()));
+        size_t size = lz_compress(c.data(), c.size(), packed.data(), packed.size());
+        std::vector<char> back(c.size() + 1);
+        if (size == 0 || lz_decompress(packed.data(), size, back.data(), back.size()) != (long long)c.size()
+            || std::string(back.data(), c.size()) != c) {
+            std::cout << "lz codec FAILED on " << c.size() << " bytes" << std::endl;
+            return false;
+        }
+    }
+
+    std::string data = make_data(CHECK_BYTES);
+    std::vector<char> frame = parallel_compress(data.data(), data.size(), 100000, CHECK_THREADS);
+    std::vector<char> serial = parallel_compress(data.data(), data.size(), 100000, 1);
+    std::vector<char> out;
+    if (frame != serial || !parallel_decompress(frame.data(), frame.size(), out, CHECK_THREADS)
+        || std::string(out.data(), out.size()) != data) {
+        std::cout << "parallel_compress round trip FAILED" << std::endl;
+        return false;
+    }
+
+    compressed_frame f;
+    f.open(frame.data(), frame.size());
+    std::mt19937 rng(1);
+    for (int i = 0; i < 200; ++i) {
+        size_t offset = rng() % data.size();
+        size_t count = rng() % std::min((size_t)400000, data.size() - offset);
+        std::vector<char> part(count);
+        if (!f.read(offset, count, part.data(), CHECK_THREADS) || std::string(part.data(), count) != data.substr(offset, count)) {
+            std::cout << "compressed_frame::read FAILED at " << offset << std::endl;
+            return false;
+        }
+    }
+
+    // corruption:  a bad header, a truncated frame, a damaged block
+    std::vector<char> bad = frame;
+    bad[0] ^= 1;
+    if (parallel_decompress(bad.data(), bad.size(), out)) {std::cout << "bad magic not rejected" << std::endl; return false;}
+    if (parallel_decompress(frame.data(), frame.size() / 2, out)) {std::cout << "truncated frame not rejected" << std::endl; return false;}
+    bad = frame;
+    for (size_t i = frame.size() / 2; i < frame.size() / 2 + 64; ++i) bad[i] = (char)0xff;
+    if (parallel_decompress(bad.data(), bad.size(), out)) {std::cout << "damaged block not rejected" << std::endl; return false;}
+
+    std::vector<char> empty = parallel_compress(nullptr, 0);
+    if (!parallel_decompress(empty.data(), empty.size(), out) || !out.empty()) {std::cout << "empty frame FAILED" << std::endl; return false;}
+    return true;
+}
+
+//-------------------------------------------------------------------------
+
+void report(const char *name, size_t bytes, double wall, double cpu) {
+    std::cout << name << "  Wall Time = " << wall << "  CPU Time = " << cpu << "  MB/s = " << bytes / wall / 1e6 << std::endl;
+}
+
+int main(int argc, char **argv) {
+    double wall0, cpu0, wall1, cpu1;
+
+    if (!check()) return 1;
+    std::cout << "Correctness checks passed." << std::endl << std::endl;
+
+    std::string data = make_data(BENCH_BYTES);
+    std::vector<char> frame, out;
+
+    wall0 = get_wall_time();
+    cpu0 = get_cpu_time();
+    frame = parallel_compress(data.data(), data.size(), BLOCK_COMPRESS_DEFAULT, 1);
+    wall1 = get_wall_time();
+    cpu1 = get_cpu_time();
+    std::cout << "---  " << data.size() / 1e6 << " MB compressed to " << frame.size() / 1e6 << " MB  ---" << std::endl;
+    report("compress, 1 thread  ", data.size(), wall1 - wall0, cpu1 - cpu0);
+
+    wall0 = get_wall_time();
+    cpu0 = get_cpu_time();
+    frame = parallel_compress(data.data(), data.size());
+    wall1 = get_wall_time();
+    cpu1 = get_cpu_time();
+    report("compress, pool      ", data.size(), wall1 - wall0, cpu1 - cpu0);
+
+    wall0 = get_wall_time();
+    cpu0 = get_cpu_time();
+    parallel_decompress(frame.data(), frame.size(), out, 1);
+    wall1 = get_wall_time();
+    cpu1 = get_cpu_time();
+    report("decompress, 1 thread", data.size(), wall1 - wall0, cpu1 - cpu0);
+
+    wall0 = get_wall_time();
+    cpu0 = get_cpu_time();
+    parallel_decompress(frame.data(), frame.size(), out);
+    wall1 = get_wall_time();
+    cpu1 = get_cpu_time();
+    report("decompress, pool    ", data.size(), wall1 - wall0, cpu1 - cpu0);
+
+    return 0;
+}
+
+//-------------------------------------------------------------------------
+//-------------------------------------------------------------------------
+//-------------------------------------------------------------------------
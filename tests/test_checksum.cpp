@@ -0,0 +1,142 @@
+//
+//  test_checksum.cpp
+//  Test for checksum.h.  Checks crc32c and xxhash64 against published test
+//  vectors and a bit at a time CRC, checks crc32c_combine on random splits,
+//  and that parallel_crc32c equals the serial crc for sizes around the block
+//  boundaries.  Then reports GB/s over 256 MB, serial against the pool.
+//
+
+/*
+build this example code from the command line with:
+g++ test_checksum.cpp -std=c++14 -O2 -march=native
+*/
+
+#include "../checksum.h"
+#include "../ext_timer.h"
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+
+#define BENCH_BYTES ((size_t)256 << 20)
+#define CHECK_THREADS   4
+
+//-------------------------------------------------------------------------
+
+// the reference:  one bit at a time
+uint32_t bitwise_crc32c(const unsigned char *p, size_t size) {
+    uint32_t c = ~0u;
+    for (size_t i = 0; i < size; ++i) {
+        c ^= p[i];
+        for (int k = 0; k < 8; ++k) c = (c & 1) ? (c >> 1) ^ CRC32C_POLY : c >> 1;
+    }
+    return ~c;
+}
+
+bool check() {
+    if (crc32c(0, "123456789", 9) != 0xe3069283u || crc32c(0, "", 0) != 0) {
+        std::cout << "crc32c FAILED on the test vector" << std::endl;
+        return false;
+    }
+    if (xxhash64("", 0) != 0xef46db3751d8e999ull || xxhash64("a", 1) != 0xd24ec4f1a98c6e5bull
+        || xxhash64("abc", 3) != 0x44bc2cf5ad770999ull) {
+        std::cout << "xxhash64 FAILED on the test vectors" << std::endl;
+        return false;
+    }
+
+    std::mt19937_64 rng(0);
+    std::vector<unsigned char> data(3 * CHECKSUM_BLOCK + 12345);
+    for (auto &b : data) b = (unsigned char)rng();
+
+    for (size_t size : {0, 1, 7, 8, 9, 63, 100000}) {
+        if (crc32c(0, data.data(), size) != bitwise_crc32c(data.data(), size)) {
+            std::cout << "crc32c FAILED on " << size << " bytes" << std::endl;
+            return false;
+        }
+    }
+    for (int i = 0; i < 1000; ++i) {
+        size_t size = rng() % 100000, split = size ? rng() % size : 0;
+        uint32_t whole = crc32c(0, data.data(), size);
+        uint32_t a = crc32c(0, data.data(), split), b = crc32c(0, data.data() + split, size - split);
+        if (crc32c_combine(a, b, size - split) != whole || crc32c(a, data.data() + split, size - split) != whole) {
+            std::cout << "crc32c_combine FAILED at " << split << " of " << size << std::endl;
+            return false;
+        }
+    }
+
+    // sizes around the block boundaries
+    for (size_t size : {(size_t)CHECKSUM_BLOCK - 1, (size_t)CHECKSUM_BLOCK, (size_t)CHECKSUM_BLOCK + 1, 2 * (size_t)CHECKSUM_BLOCK, data.size()}) {
+        if (parallel_crc32c(data.data(), size, CHECK_THREADS) != crc32c(0, data.data(), size)) {
+            std::cout << "parallel_crc32c FAILED on " << size << " bytes" << std::endl;
+            return false;
+        }
+        if (parallel_hash64(data.data(), size, 7, CHECK_THREADS) != parallel_hash64(data.data(), size, 7, 1)) {
+            std::cout << "parallel_hash64 FAILED, depends on the thread count" << std::endl;
+            return false;
+        }
+    }
+    if (parallel_hash64(data.data(), CHECKSUM_BLOCK, 7) != xxhash64(data.data(), CHECKSUM_BLOCK, 7)
+        || parallel_hash64(data.data(), data.size()) == parallel_hash64(data.data(), data.size() - 1)) {
+        std::cout << "parallel_hash64 FAILED" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+//-------------------------------------------------------------------------
+
+void report(const char *name, size_t bytes, double wall, double cpu) {
+    std::cout << name << "  Wall Time = " << wall << "  CPU Time = " << cpu << "  GB/s = " << bytes / wall / 1e9 << std::endl;
+}
+
+int main(int argc, char **argv) {
+    double wall0, cpu0, wall1, cpu1;
+
+    if (!check()) return 1;
+    std::cout << "Correctness checks passed." << std::endl << std::endl;
+#if defined(__SSE4_2__)
+    std::cout << "---  crc32c with the SSE4.2 instruction  ---" << std::endl;
+#else
+    std::cout << "---  crc32c with slicing-by-8 tables  ---" << std::endl;
+#endif
+
+    std::vector<unsigned char> data(BENCH_BYTES);
+    for (size_t i = 0; i < data.size(); ++i) data[i] = (unsigned char)(i * 2654435761u >> 13);
+    volatile uint64_t sink;
+
+    wall0 = get_wall_time();
+    cpu0 = get_cpu_time();
+    sink = crc32c(0, data.data(), data.size());
+    wall1 = get_wall_time();
+    cpu1 = get_cpu_time();
+    report("crc32c           ", data.size(), wall1 - wall0, cpu1 - cpu0);
+
+    wall0 = get_wall_time();
+    cpu0 = get_cpu_time();
+    sink = parallel_crc32c(data.data(), data.size());
+    wall1 = get_wall_time();
+    cpu1 = get_cpu_time();
+    report("parallel_crc32c  ", data.size(), wall1 - wall0, cpu1 - cpu0);
+
+    wall0 = get_wall_time();
+    cpu0 = get_cpu_time();
+    sink = xxhash64(data.data(), data.size());
+    wall1 = get_wall_time();
+    cpu1 = get_cpu_time();
+    report("xxhash64         ", data.size(), wall1 - wall0, cpu1 - cpu0);
+
+    wall0 = get_wall_time();
+    cpu0 = get_cpu_time();
+    sink = parallel_hash64(data.data(), data.size());
+    wall1 = get_wall_time();
+    cpu1 = get_cpu_time();
+    report("parallel_hash64  ", data.size(), wall1 - wall0, cpu1 - cpu0);
+    (void)sink;
+
+    return 0;
+}
+
+//-------------------------------------------------------------------------
+//-------------------------------------------------------------------------
+//-------------------------------------------------------------------------
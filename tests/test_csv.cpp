@@ -0,0 +1,218 @@
+//
+//  test_csv.cpp
+//  Test for csv_parser.h.  Generates CSV with quoted fields holding commas,
+//  escaped quotes and newlines, checks parse_csv against a serial character
+//  at a time parser, checks parse_jsonl on generated JSON-lines, then
+//  reports GB/s for both against a naive std::getline loop.
+//
+
+/*
+build this example code from the command line with:
+g++ test_csv.cpp -std=c++17 -O2 -march=native
+*/
+
+#include "../csv_parser.h"
+#include "../ext_timer.h"
+#include <iostream>
+#include <sstream>
+#include <random>
+#include <string>
+#include <vector>
+
+
+#define CHECK_ROWS  200000
+#define BENCH_ROWS  4000000
+#define CHECK_THREADS   4
+
+//-------------------------------------------------------------------------
+
+std::string make_csv(int rows) {
+    std::mt19937 rng(0);
+    std::string csv = "id,name,value,note\r\n";
+    for (int i = 0; i < rows; ++i) {
+        csv += std::to_string(i) + ',';
+        switch (rng() % 4) {
+            case 0:  csv += "\"Smith, John\","; break;
+            case 1:  csv += "\"say \"\"hi\"\"\","; break;
+            case 2:  csv += "\"two\nlines\","; break;
+            default: csv += "plain,"; break;
+        }
+        csv += std::to_string(rng() % 100000) + ',';
+        if (rng() % 8) csv += "note " + std::to_string(i);
+        csv += (rng() % 2) ? "\r\n" : "\n";
+    }
+    return csv;
+}
+
+// the reference:  one character at a time, the same field rules as parse_csv
+void serial_csv(std::string_view text, std::vector<std::vector<std::string_view>> &rows) {
+    std::vector<std::string_view> row;
+    size_t fieldStart = 0;
+    bool inQuotes = false;
+    for (size_t i = 0; i <= text.size(); ++i) {
+        bool atEnd = i == text.size();
+        if (!atEnd && text[i] == '"') {inQuotes = !inQuotes; continue;}
+        if (!atEnd && (inQuotes || (text[i] != ',' && text[i] != '\n'))) continue;
+        if (atEnd && fieldStart == i && row.empty()) break;
+        size_t end = i;
+        bool recordEnd = atEnd || text[i] == '\n';
+        if (recordEnd && end > fieldStart && text[end-1] == '\r') --end;
+        row.push_back(csv_field(text.data(), fieldStart, end));
+        fieldStart = i + 1;
+        if (recordEnd) {
+            rows.push_back(row);
+            row.clear();
+        }
+    }
+}
+
+bool check_csv() {
+    std::string csv = make_csv(CHECK_ROWS);
+    parsed_table table;
+    parse_csv(csv, table, true, ',', CHECK_THREADS);
+    std::vector<std::vector<std::string_view>> expected;
+    serial_csv(csv, expected);
+
+    if (table.names != std::vector<std::string>({"id", "name", "value", "note"}) || table.rows != expected.size() - 1) {
+        std::cout << "parse_csv FAILED, " << table.rows << " rows" << std::endl;
+        return false;
+    }
+    for (size_t r = 0; r < table.rows; ++r) {
+        for (size_t c = 0; c < table.columns.size(); ++c) {
+            if (table.columns[c][r] != expected[r+1][c]) {
+                std::cout << "parse_csv FAILED at row " << r << " column " << c << std::endl;
+                return false;
+            }
+        }
+    }
+    if (csv_unescape(csv_field("\"say \"\"hi\"\"\"", 0, 12)) != "say \"hi\"") {
+        std::cout << "csv_unescape FAILED" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+//-------------------------------------------------------------------------
+
+std::string make_jsonl(int rows) {
+    std::ostringstream out;
+    for (int i = 0; i < rows; ++i) {
+        out << "{\"id\": " << i << ", \"tags\": [\"a\", {\"x\": 1}], \"name\": \"row \\\"" << i
+            << "\\\", ok\", \"value\": " << i * 3 << "}\n";
+    }
+    return out.str();
+}
+
+bool check_jsonl() {
+    std::string jsonl = make_jsonl(CHECK_ROWS);
+    parsed_table table;
+    parse_jsonl(jsonl, {"value", "name", "id", "missing"}, table, CHECK_THREADS);
+    if (table.rows != CHECK_ROWS) {std::cout << "parse_jsonl FAILED, " << table.rows << " rows" << std::endl; return false;}
+    for (size_t r = 0; r < table.rows; ++r) {
+        if (table.columns[0][r] != std::to_string(r * 3) || table.columns[2][r] != std::to_string(r)
+            || table.columns[1][r] != "row \\\"" + std::to_string(r) + "\\\", ok" || !table.columns[3][r].empty()) {
+            std::cout << "parse_jsonl FAILED at row " << r << std::endl;
+            return false;
+        }
+    }
+
+    // malformed lines keep what parsed before the fault and leave the rest empty.  Each is
+    // the last line, with no newline, so nothing past it may be read.
+    struct malformed {
+        const char *line;
+        const char *id;
+        const char *name;
+    };
+    const malformed cases[] = {
+        {"{\"", "", ""},
+        {"{\"id", "", ""},
+        {"{\"id\":", "", ""},
+        {"{\"id\": ", "", ""},
+        {"{\"id\": 4, \"name\":\"", "4", ""},
+        {"{\"id\": 4, \"name\": \"ab\\\"", "4", ""},
+        {"{\"id\": , \"name\": \"x\"}", "", "x"},
+        {"{\"id\": 5 ,", "5", ""},
+        {"[1, 2]", "", ""},
+    };
+    for (const malformed &m : cases) {
+        std::string text = std::string("{\"id\": 1, \"name\": \"first\"}\n") + m.line;
+        parsed_table t;
+        parse_jsonl(text, {"id", "name"}, t, CHECK_THREADS);
+        if (t.rows != 2 || t.columns[0][0] != "1" || t.columns[1][0] != "first"
+            || t.columns[0][1] != m.id || t.columns[1][1] != m.name) {
+            std::cout << "parse_jsonl FAILED on malformed line " << m.line << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+//-------------------------------------------------------------------------
+
+// the naive baseline:  getline per record, split on commas (it doesn't even handle the quotes)
+size_t getline_fields(const std::string &text) {
+    std::istringstream in(text);
+    std::string line;
+    size_t fields = 0;
+    while (std::getline(in, line)) {
+        std::vector<std::string> row;
+        std::istringstream ls(line);
+        std::string field;
+        while (std::getline(ls, field, ',')) row.push_back(field);
+        fields += row.size();
+    }
+    return fields;
+}
+
+void report(const char *name, size_t bytes, double wall, double cpu) {
+    std::cout << name << "  Wall Time = " << wall << "  CPU Time = " << cpu << "  GB/s = " << bytes / wall / 1e9 << std::endl;
+}
+
+int main(int argc, char **argv) {
+    double wall0, cpu0, wall1, cpu1;
+
+    if (!check_csv() || !check_jsonl()) return 1;
+    std::cout << "Correctness checks passed." << std::endl << std::endl;
+
+    std::string csv = make_csv(BENCH_ROWS);
+    parsed_table table;
+    std::cout << "---  CSV, " << csv.size() / 1e6 << " MB  ---" << std::endl;
+
+    wall0 = get_wall_time();
+    cpu0 = get_cpu_time();
+    getline_fields(csv);
+    wall1 = get_wall_time();
+    cpu1 = get_cpu_time();
+    report("getline loop", csv.size(), wall1 - wall0, cpu1 - cpu0);
+
+    wall0 = get_wall_time();
+    cpu0 = get_cpu_time();
+    parse_csv(csv, table);
+    wall1 = get_wall_time();
+    cpu1 = get_cpu_time();
+    report("parse_csv   ", csv.size(), wall1 - wall0, cpu1 - cpu0);
+    std::cout << std::endl;
+
+    std::string jsonl = make_jsonl(BENCH_ROWS);
+    std::cout << "---  JSON-lines, " << jsonl.size() / 1e6 << " MB  ---" << std::endl;
+
+    wall0 = get_wall_time();
+    cpu0 = get_cpu_time();
+    getline_fields(jsonl);
+    wall1 = get_wall_time();
+    cpu1 = get_cpu_time();
+    report("getline loop", jsonl.size(), wall1 - wall0, cpu1 - cpu0);
+
+    wall0 = get_wall_time();
+    cpu0 = get_cpu_time();
+    parse_jsonl(jsonl, {"id", "name", "value"}, table);
+    wall1 = get_wall_time();
+    cpu1 = get_cpu_time();
+    report("parse_jsonl ", jsonl.size(), wall1 - wall0, cpu1 - cpu0);
+
+    return 0;
+}
+
+//-------------------------------------------------------------------------
+//-------------------------------------------------------------------------
+//-------------------------------------------------------------------------
@@ -0,0 +1,178 @@
+//
+//  test_deadline.cpp
+//  Test for deadline_scheduler.h.  Checks items run in deadline order (ties
+//  in submission order) and that misses and slack are counted.  Then a frame
+//  loop:  a 16 ms deadline frame task every 5 ms arrives behind a backlog of
+//  long background work.  A FIFO scheduler fed with add_work() runs the frames
+//  after the backlog, EDF runs them first;  both report misses and slack.
+//
+
+/*
+build this example code from the command line with:
+g++ test_deadline.cpp -std=c++14 -O2
+*/
+
+#include "../deadline_scheduler.h"
+#include "../ext_timer.h"
+#include <iostream>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+#define FRAMES          60
+#define FRAME_PERIOD_US 5000
+#define FRAME_DEADLINE_US   16000
+#define FRAME_WORK_US   300
+#define BACKGROUND_TASKS    150
+#define BACKGROUND_WORK_US  2000
+#define BACKGROUND_DEADLINE_US  2000000
+#define CHECK_THREADS   4
+#define THREADS         2
+
+//-------------------------------------------------------------------------
+
+void spin(int microseconds) {
+    auto end = std::chrono::steady_clock::now() + std::chrono::microseconds(microseconds);
+    while (std::chrono::steady_clock::now() < end) {}
+}
+
+struct order_recorder : worker {
+    std::vector<int> _order;
+    void do_work(int work) {_order.push_back(work);}
+};
+
+bool check() {
+    // one thread, everything submitted before run(), so the order is exactly EDF
+    deadline_scheduler s(1);
+    order_recorder r;
+    auto now = deadline_scheduler::clock::now();
+    int deadlines[] = {50, 10, 30, 10, 20, 40};     // ms
+    for (int i = 0; i < 6; ++i) s.submit(&r, i, now + std::chrono::milliseconds(deadlines[i]));
+    s.run();
+    s.join();
+    if (r._order != std::vector<int>({1, 3, 4, 2, 5, 0})) {
+        std::cout << "deadline_scheduler FAILED, not in deadline order" << std::endl;
+        return false;
+    }
+
+    // misses:  deadlines already past are all missed, distant ones aren't
+    struct sleeper : worker {
+        void do_work(int work) {spin(100);}
+    } w;
+    deadline_scheduler m(CHECK_THREADS);
+    m.run();
+    for (int i = 0; i < 100; ++i) m.submit(&w, i, deadline_scheduler::clock::now() - std::chrono::milliseconds(1));
+    for (int i = 0; i < 100; ++i) m.submit_within(&w, i, 10000000);
+    m.join();
+    deadline_stats st = m.stats();
+    if (st.completed != 200 || st.missed != 100 || st.slack_percentile(0) > -1000 || st.slack_percentile(100) < 9000000) {
+        std::cout << "deadline_scheduler FAILED, " << st.missed << " of " << st.completed << " missed" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+//-------------------------------------------------------------------------
+
+// the work:  frames are short, background items long.  records slack for the frames.
+struct frame_work : worker {
+    std::vector<deadline_scheduler::clock::time_point> _deadline;
+    std::vector<double> _slack;
+    frame_work() : _deadline(FRAMES + BACKGROUND_TASKS), _slack(FRAMES + BACKGROUND_TASKS) {}
+    void do_work(int work) {
+        spin(work < FRAMES ? FRAME_WORK_US : BACKGROUND_WORK_US);
+        _slack[work] = std::chrono::duration<double, std::micro>(_deadline[work] - deadline_scheduler::clock::now()).count();
+    }
+};
+
+// the FIFO baseline:  a scheduler fed with add_work(), claimed in arrival order
+struct fifo_work : worker {
+    frame_work *_frames;
+    std::deque<int> _items;
+    std::mutex _mutex;
+    void do_work(int work) {
+        int item;
+        {
+            std::lock_guard<std::mutex> lk(_mutex);
+            item = _items[work];
+        }
+        _frames->do_work(item);
+    }
+};
+
+void report(const char *name, const std::vector<double> &slack, double wall, double cpu) {
+    std::vector<double> frames(slack.begin(), slack.begin() + FRAMES);
+    std::sort(frames.begin(), frames.end());
+    int missed = (int)(std::lower_bound(frames.begin(), frames.end(), 0.0) - frames.begin());
+    std::cout << "---  " << name << "  ---" << std::endl;
+    std::cout << "frames missed = " << missed << " of " << FRAMES << "  slack min = " << frames[0] / 1000
+              << " ms  p50 = " << frames[FRAMES / 2] / 1000 << " ms" << std::endl;
+    std::cout << "Wall Time = " << wall << std::endl;
+    std::cout << "CPU Time  = " << cpu << std::endl << std::endl;
+}
+
+int main(int argc, char **argv) {
+    double wall0, cpu0, wall1, cpu1;
+
+    if (!check()) return 1;
+    std::cout << "Correctness checks passed." << std::endl << std::endl;
+
+    {
+        frame_work fw;
+        fifo_work ff;
+        ff._frames = &fw;
+        scheduler s(&ff, 0, THREADS);
+        s.run();
+        wall0 = get_wall_time();
+        cpu0 = get_cpu_time();
+        auto add = [&](int item, uint64_t deadlineUs) {
+            fw._deadline[item] = deadline_scheduler::clock::now() + std::chrono::microseconds(deadlineUs);
+            {
+                std::lock_guard<std::mutex> lk(ff._mutex);
+                ff._items.push_back(item);
+            }
+            s.add_work();
+        };
+        for (int i = 0; i < BACKGROUND_TASKS; ++i) add(FRAMES + i, BACKGROUND_DEADLINE_US);
+        for (int f = 0; f < FRAMES; ++f) {
+            add(f, FRAME_DEADLINE_US);
+            std::this_thread::sleep_for(std::chrono::microseconds(FRAME_PERIOD_US));
+        }
+        s.join();
+        wall1 = get_wall_time();
+        cpu1 = get_cpu_time();
+        report("FIFO scheduler", fw._slack, wall1 - wall0, cpu1 - cpu0);
+    }
+    {
+        frame_work fw;
+        deadline_scheduler s(THREADS);
+        s.run();
+        wall0 = get_wall_time();
+        cpu0 = get_cpu_time();
+        auto add = [&](int item, uint64_t deadlineUs) {
+            fw._deadline[item] = deadline_scheduler::clock::now() + std::chrono::microseconds(deadlineUs);
+            s.submit(&fw, item, fw._deadline[item]);
+        };
+        for (int i = 0; i < BACKGROUND_TASKS; ++i) add(FRAMES + i, BACKGROUND_DEADLINE_US);
+        for (int f = 0; f < FRAMES; ++f) {
+            add(f, FRAME_DEADLINE_US);
+            std::this_thread::sleep_for(std::chrono::microseconds(FRAME_PERIOD_US));
+        }
+        s.join();
+        wall1 = get_wall_time();
+        cpu1 = get_cpu_time();
+        report("deadline_scheduler", fw._slack, wall1 - wall0, cpu1 - cpu0);
+        deadline_stats st = s.stats();
+        std::cout << "all items:  missed = " << st.missed << " of " << st.completed << "  slack p1 = " << st.slack_percentile(1) / 1000
+                  << " ms  p50 = " << st.slack_percentile(50) / 1000 << " ms  p99 = " << st.slack_percentile(99) / 1000 << " ms" << std::endl;
+    }
+    return 0;
+}
+
+//-------------------------------------------------------------------------
+//-------------------------------------------------------------------------
+//-------------------------------------------------------------------------
@@ -0,0 +1,140 @@
+//
+//  test_dir_walker.cpp
+//  Test for dir_walker.h.  Builds a directory tree of 4000 small files, then
+//  processes them two ways:  walk the tree serially and then run a scheduler
+//  over the list, or stream them into the scheduler while dir_walker walks.
+//  Each file's processing is a read plus a 1 ms wait, so the overlap shows.
+//
+
+/*
+build this example code from the command line with:
+g++ test_dir_walker.cpp -std=c++14 -O2
+*/
+
+#include "../dir_walker.h"
+#include "../ext_timer.h"
+#include <iostream>
+#include <fstream>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+#include <dirent.h>
+#include <sys/stat.h>
+
+
+#define TEST_ROOT   "test_dir_walker.tmp"
+#define FANOUT      8       // subdirectories per directory
+#define DEPTH       3       // levels of subdirectories
+#define FILES_PER_DIR   7
+#define MILLISECONDS_PER_FILE   1
+#define THREADS     8
+
+//-------------------------------------------------------------------------
+
+// makes the tree, returns how many files it made and their total size
+int make_tree(const std::string &dir, int depth, size_t &bytes) {
+    mkdir(dir.c_str(), 0755);
+    int files = 0;
+    for (int f = 0; f < FILES_PER_DIR; ++f) {
+        std::ofstream out(dir + "/file" + std::to_string(f) + ".txt");
+        std::string contents(100 + files * 13 + depth, 'x');
+        out << contents;
+        bytes += contents.size();
+        ++files;
+    }
+    if (depth > 0) {
+        for (int d = 0; d < FANOUT; ++d) files += make_tree(dir + "/dir" + std::to_string(d), depth - 1, bytes);
+    }
+    return files;
+}
+
+size_t file_size(const std::string &path) {
+    std::ifstream in(path, std::ios::binary | std::ios::ate);
+    return (size_t)in.tellg();
+}
+
+// the per file work:  read its size, then pretend to do something with it
+struct size_summer : dir_walker {
+    std::atomic<size_t> _bytes{0};
+    std::atomic<int> _files{0};
+
+    void do_file(int index, const std::string &path) {
+        _bytes += file_size(path);
+        ++_files;
+        std::this_thread::sleep_for(std::chrono::milliseconds(MILLISECONDS_PER_FILE));
+    }
+};
+
+// the serial way:  build the list, then hand it to a scheduler
+void serial_list(const std::string &dir, std::vector<std::string> &files) {
+    if (DIR *d = opendir(dir.c_str())) {
+        while (struct dirent *entry = readdir(d)) {
+            std::string name = entry->d_name;
+            if (name == "." || name == "..") continue;
+            if (entry->d_type == DT_DIR) serial_list(dir + "/" + name, files);
+            else files.push_back(dir + "/" + name);
+        }
+        closedir(d);
+    }
+}
+
+struct list_worker : worker {
+    std::vector<std::string> _files;
+    std::atomic<size_t> _bytes{0};
+    void do_work(int work) {
+        _bytes += file_size(_files[work]);
+        std::this_thread::sleep_for(std::chrono::milliseconds(MILLISECONDS_PER_FILE));
+    }
+};
+
+//-------------------------------------------------------------------------
+
+int main(int argc, char **argv) {
+    double wall0, cpu0, wall1, cpu1;
+
+    size_t expectedBytes = 0;
+    int expectedFiles = make_tree(TEST_ROOT, DEPTH, expectedBytes);
+
+    size_summer check;
+    check.walk(TEST_ROOT, 4, 4);
+    std::vector<std::string> listed = list_files(TEST_ROOT, 4);
+    if (check._files != expectedFiles || check._bytes != expectedBytes || (int)listed.size() != expectedFiles) {
+        std::cout << "dir_walker FAILED, " << check._files << " of " << expectedFiles << " files" << std::endl;
+        return 1;
+    }
+    std::cout << "Correctness checks passed, " << expectedFiles << " files." << std::endl << std::endl;
+
+    wall0 = get_wall_time();
+    cpu0 = get_cpu_time();
+    list_worker lw;
+    serial_list(TEST_ROOT, lw._files);
+    scheduler s(&lw, (int)lw._files.size(), THREADS);
+    s.run();
+    s.join();
+    wall1 = get_wall_time();
+    cpu1 = get_cpu_time();
+    std::cout << "---  serial walk, then scheduler  ---" << std::endl;
+    std::cout << "Wall Time = " << wall1 - wall0 << std::endl;
+    std::cout << "CPU Time  = " << cpu1 - cpu0 << std::endl;
+    std::cout << std::endl;
+
+    wall0 = get_wall_time();
+    cpu0 = get_cpu_time();
+    size_summer walker;
+    walker.walk(TEST_ROOT, THREADS, 4);
+    wall1 = get_wall_time();
+    cpu1 = get_cpu_time();
+    std::cout << "---  dir_walker streaming into the scheduler  ---" << std::endl;
+    std::cout << "Wall Time = " << wall1 - wall0 << std::endl;
+    std::cout << "CPU Time  = " << cpu1 - cpu0 << std::endl;
+
+    std::system("rm -rf " TEST_ROOT);
+    return 0;
+}
+
+//-------------------------------------------------------------------------
+//-------------------------------------------------------------------------
+//-------------------------------------------------------------------------
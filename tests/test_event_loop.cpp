@@ -0,0 +1,283 @@
+//
+//  test_event_loop.cpp
+//  Test for event_loop.h.  Echo servers on socketpairs:  every server end is
+//  registered with an event_loop whose handler reads until EAGAIN and echoes
+//  back.  Checks every byte comes back in order, that a handler never runs on
+//  two threads at once, and that removing from the handler on hang up works.
+//  Then benchmarks ping-pong latency (p50/p99) and pipelined throughput
+//  against the old way:  a hand-built reactor that runs a new scheduler over
+//  each batch of ready sockets.
+//
+
+/*
+build this example code from the command line with:
+g++ test_event_loop.cpp -std=c++14 -O2
+*/
+
+#include "../event_loop.h"
+#include "../ext_timer.h"
+#include <iostream>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sys/socket.h>
+
+
+#define PAIRS       16
+#define CHECK_BYTES 200000
+#define PINGS       2000
+#define MESSAGES    20000   // per pair, in the throughput run
+#define WINDOW      16      // messages in flight per pair
+#define MESSAGE_BYTES   64
+#define CHECK_THREADS   4
+#define THREADS     4
+
+//-------------------------------------------------------------------------
+
+// reads until EAGAIN, writes everything back;  returns false on hang up
+bool echo(int fd) {
+    char buffer[4096];
+    for (;;) {
+        ssize_t n = recv(fd, buffer, sizeof(buffer), MSG_DONTWAIT);
+        if (n == 0) return false;
+        if (n < 0) return errno == EAGAIN || errno == EINTR;
+        for (ssize_t done = 0; done < n; ) {
+            ssize_t w = send(fd, buffer + done, n - done, 0);
+            if (w <= 0) return false;
+            done += w;
+        }
+    }
+}
+
+struct echo_handler : event_handler {
+    event_loop *_loop;
+    std::atomic<int> _running{0};
+    std::atomic<bool> _overlap{false};
+    std::atomic<int> _hangups{0};
+
+    void on_event(int id, int fd, uint32_t events) {
+        if (++_running != 1) _overlap = true;
+        bool open = echo(fd);
+        if (!open || (events & (EPOLLRDHUP | EPOLLHUP))) {
+            _loop->remove(id);
+            close(fd);
+            ++_hangups;
+        }
+        --_running;
+    }
+};
+
+bool read_exactly(int fd, char *buffer, size_t size) {
+    for (size_t done = 0; done < size; ) {
+        ssize_t n = recv(fd, buffer + done, size - done, 0);
+        if (n <= 0) return false;
+        done += n;
+    }
+    return true;
+}
+
+// the client end:  streams CHECK_BYTES in odd sized writes while reading the echo back
+bool check_client(int fd, int seed) {
+    std::string sent(CHECK_BYTES, 0);
+    for (size_t i = 0; i < sent.size(); ++i) sent[i] = (char)(i * 31 + seed);
+    std::string received(CHECK_BYTES, 0);
+    std::thread reader([&] {read_exactly(fd, &received[0], received.size());});
+    for (size_t done = 0; done < sent.size(); ) {
+        size_t n = std::min((size_t)(1 + (done * 7) % 3000), sent.size() - done);
+        send(fd, sent.data() + done, n, 0);
+        done += n;
+    }
+    reader.join();
+    return received == sent;
+}
+
+bool check() {
+    echo_handler handlers[PAIRS];
+    event_loop loop(PAIRS);
+    loop.start(CHECK_THREADS);
+    int clients[PAIRS];
+    for (int p = 0; p < PAIRS; ++p) {
+        int sv[2];
+        socketpair(AF_UNIX, SOCK_STREAM, 0, sv);
+        clients[p] = sv[0];
+        handlers[p]._loop = &loop;
+        if (loop.add(sv[1], &handlers[p]) < 0) {
+            std::cout << "event_loop::add FAILED" << std::endl;
+            return false;
+        }
+    }
+    int extra[2];
+    socketpair(AF_UNIX, SOCK_STREAM, 0, extra);
+    if (loop.add(extra[1], &handlers[0]) >= 0) {
+        std::cout << "event_loop::add FAILED, a full table was accepted" << std::endl;
+        return false;
+    }
+
+    std::vector<std::thread> threads;
+    std::atomic<bool> ok{true};
+    for (int p = 0; p < PAIRS; ++p) threads.push_back(std::thread([&, p] {if (!check_client(clients[p], p)) ok = false;}));
+    for (auto &t : threads) t.join();
+    for (int p = 0; p < PAIRS; ++p) close(clients[p]);
+
+    // every hang up removes its registration, which frees the slot for a new one
+    for (int wait = 0; wait < 1000; ++wait) {
+        int hangups = 0;
+        for (auto &h : handlers) hangups += h._hangups;
+        if (hangups == PAIRS) break;
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    int id = loop.add(extra[1], &handlers[0]);
+    loop.stop();
+    close(extra[0]);
+    close(extra[1]);
+
+    for (auto &h : handlers) {
+        if (h._overlap) {std::cout << "event_loop FAILED, a handler ran on two threads" << std::endl; return false;}
+    }
+    if (!ok) {std::cout << "event_loop FAILED, echoed bytes differ" << std::endl; return false;}
+    if (id < 0) {std::cout << "event_loop FAILED, removed slots weren't reused" << std::endl; return false;}
+    return true;
+}
+
+//-------------------------------------------------------------------------
+// the old way:  a reactor that hands each batch of ready sockets to a new scheduler
+
+struct batch_reactor : worker {
+    int _epoll;
+    std::atomic<bool> _stopping{false};
+    epoll_event _events[EVENT_LOOP_BATCH];
+    std::thread _thread;
+    int _threads;
+
+    void do_work(int work) {
+        if (!echo(_events[work].data.fd)) close(_events[work].data.fd);    // which also takes it out of epoll
+    }
+
+    void start(int threads) {
+        _threads = threads;
+        _epoll = epoll_create1(0);
+        _thread = std::thread([this] {
+            while (!_stopping) {
+                int n = epoll_wait(_epoll, _events, EVENT_LOOP_BATCH, 10);
+                if (n <= 0) continue;
+                scheduler s(this, n, _threads);
+                s.run();
+                s.join();
+            }
+        });
+    }
+    void add(int fd) {
+        epoll_event ev;
+        ev.events = EPOLLIN | EPOLLET;
+        ev.data.fd = fd;
+        epoll_ctl(_epoll, EPOLL_CTL_ADD, fd, &ev);
+    }
+    void stop() {
+        _stopping = true;
+        _thread.join();
+        close(_epoll);
+    }
+};
+
+// the server ends are added to the reactor, which closes them when the client end hangs up
+
+// ping-pong on each pair from its own client thread, returns the round trip times
+template <typename Add>
+std::vector<double> latency(Add add) {
+    int clients[PAIRS];
+    for (int p = 0; p < PAIRS; ++p) {
+        int sv[2];
+        socketpair(AF_UNIX, SOCK_STREAM, 0, sv);
+        clients[p] = sv[0];
+        add(sv[1]);
+    }
+    std::vector<std::vector<double>> times(PAIRS);
+    std::vector<std::thread> threads;
+    for (int p = 0; p < PAIRS; ++p) {
+        threads.push_back(std::thread([&, p] {
+            char message[MESSAGE_BYTES] = {1};
+            for (int i = 0; i < PINGS / PAIRS; ++i) {
+                auto t0 = std::chrono::steady_clock::now();
+                send(clients[p], message, sizeof(message), 0);
+                read_exactly(clients[p], message, sizeof(message));
+                times[p].push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - t0).count());
+            }
+        }));
+    }
+    for (auto &t : threads) t.join();
+    std::vector<double> all;
+    for (int p = 0; p < PAIRS; ++p) {
+        all.insert(all.end(), times[p].begin(), times[p].end());
+        close(clients[p]);
+    }
+    std::sort(all.begin(), all.end());
+    return all;
+}
+
+// each pair keeps WINDOW messages in flight, returns messages per second
+template <typename Add>
+double throughput(Add add) {
+    int clients[PAIRS];
+    for (int p = 0; p < PAIRS; ++p) {
+        int sv[2];
+        socketpair(AF_UNIX, SOCK_STREAM, 0, sv);
+        clients[p] = sv[0];
+        add(sv[1]);
+    }
+    double wall0 = get_wall_time();
+    std::vector<std::thread> threads;
+    for (int p = 0; p < PAIRS; ++p) {
+        threads.push_back(std::thread([&, p] {
+            char message[MESSAGE_BYTES] = {2};
+            for (int i = 0; i < WINDOW; ++i) send(clients[p], message, sizeof(message), 0);
+            for (int i = WINDOW; i < MESSAGES; ++i) {
+                read_exactly(clients[p], message, sizeof(message));
+                send(clients[p], message, sizeof(message), 0);
+            }
+            for (int i = 0; i < WINDOW; ++i) read_exactly(clients[p], message, sizeof(message));
+        }));
+    }
+    for (auto &t : threads) t.join();
+    double wall1 = get_wall_time();
+    for (int p = 0; p < PAIRS; ++p) close(clients[p]);
+    return (double)PAIRS * MESSAGES / (wall1 - wall0);
+}
+
+void report(const char *name, const std::vector<double> &times, double rate) {
+    std::cout << "---  " << name << "  ---" << std::endl;
+    std::cout << "round trip p50 = " << times[times.size() / 2] << " us  p99 = " << times[times.size() * 99 / 100] << " us" << std::endl;
+    std::cout << "throughput = " << rate << " messages/s" << std::endl << std::endl;
+}
+
+int main(int argc, char **argv) {
+    if (!check()) return 1;
+    std::cout << "Correctness checks passed." << std::endl << std::endl;
+
+    {
+        batch_reactor br;
+        br.start(THREADS);
+        std::vector<double> times = latency([&](int fd) {br.add(fd);});
+        double rate = throughput([&](int fd) {br.add(fd);});
+        br.stop();
+        report("reactor + a scheduler per batch", times, rate);
+    }
+    {
+        echo_handler handler;
+        event_loop loop(2 * PAIRS);
+        handler._loop = &loop;
+        loop.start(THREADS);
+        std::vector<double> times = latency([&](int fd) {loop.add(fd, &handler);});
+        double rate = throughput([&](int fd) {loop.add(fd, &handler);});
+        loop.stop();
+        report("event_loop", times, rate);
+    }
+    return 0;
+}
+
+//-------------------------------------------------------------------------
+//-------------------------------------------------------------------------
+//-------------------------------------------------------------------------
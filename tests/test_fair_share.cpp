@@ -0,0 +1,212 @@
+//
+//  test_fair_share.cpp
+//  Test for fair_share_scheduler.h.  Checks every item of several concurrent
+//  jobs runs exactly once, that waiting twice, or after join(), is harmless,
+//  and that two jobs with weights 1 and 3 share the pool about 1:3 while
+//  both have work.  Then runs a huge job with a stream
+//  of small jobs arriving next to it, on a plain FIFO scheduler fed with
+//  add_work() and on fair_share_scheduler, and reports how long the small
+//  jobs took.
+//
+
+/*
+build this example code from the command line with:
+g++ test_fair_share.cpp -std=c++14 -O2
+*/
+
+#include "../fair_share_scheduler.h"
+#include "../ext_timer.h"
+#include <iostream>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+#define CHECK_ITEMS     3000
+#define HUGE_ITEMS      16000   // the huge job
+#define SMALL_ITEMS     8       // per small job
+#define SMALL_JOBS      20
+#define SMALL_EVERY_MS  50      // a small job arrives this often
+#define WORK_US         200     // per item
+#define CHECK_THREADS   4
+#define THREADS         4
+
+//-------------------------------------------------------------------------
+
+void spin(int microseconds) {
+    auto end = std::chrono::steady_clock::now() + std::chrono::microseconds(microseconds);
+    while (std::chrono::steady_clock::now() < end) {}
+}
+
+struct count_worker : worker {
+    std::vector<std::atomic<int>> _runs;
+    std::atomic<int> _count{0};
+    double _finished = 0;       // wall time the last item finished
+    count_worker(int n) : _runs(n) {
+        for (auto &r : _runs) r = 0;
+    }
+    void do_work(int work) {
+        spin(WORK_US);
+        ++_runs[work];
+        if (++_count == (int)_runs.size()) _finished = get_wall_time();
+    }
+    bool each_once() {
+        for (auto &r : _runs) {
+            if (r != 1) return false;
+        }
+        return true;
+    }
+};
+
+bool check() {
+    {
+        fair_share_scheduler fs(CHECK_THREADS);
+        std::vector<std::unique_ptr<count_worker>> workers;
+        std::vector<int> ids;
+        fs.run();
+        for (int i = 0; i < 10; ++i) {
+            int n = 1 + i * 37;
+            workers.emplace_back(new count_worker(n));
+            ids.push_back(fs.add_job(workers.back().get(), n, 1 + i % 3));
+        }
+        int empty = fs.add_job(workers[0].get(), 0);
+        fs.wait(empty);
+        for (int i = 0; i < 10; ++i) {
+            fs.wait(ids[i]);
+            if (!workers[i]->each_once()) {
+                std::cout << "fair_share_scheduler FAILED, job " << i << " didn't run each item once" << std::endl;
+                return false;
+            }
+        }
+        // a second wait frees nothing:  two new jobs still get two different ids
+        fs.wait(ids[0]);
+        int a = fs.add_job(workers[0].get(), 0);
+        int b = fs.add_job(workers[0].get(), 0);
+        fs.wait(a);
+        fs.wait(b);
+        fs.join();
+        fs.wait(ids[1]);    // after join() it returns at once
+        if (a == b || !fs.finished(ids[1])) {
+            std::cout << "fair_share_scheduler FAILED, a repeated wait() freed an id twice" << std::endl;
+            return false;
+        }
+    }
+
+    // weights 1 and 3:  when the heavy job is done the light one has had about a third as much.
+    // Shares are of measured pool time, which is only the same per item when no thread waits for a CPU
+    fair_share_scheduler fs(std::max(1, std::min(CHECK_THREADS, (int)std::thread::hardware_concurrency())));
+    count_worker light(CHECK_ITEMS), heavy(CHECK_ITEMS);
+    int l = fs.add_job(&light, CHECK_ITEMS, 1);
+    int h = fs.add_job(&heavy, CHECK_ITEMS, 3);
+    fs.run();
+    fs.wait(h);
+    int lightDone = light._count;
+    fs.wait(l);
+    fs.join();
+    if (lightDone < CHECK_ITEMS / 3 / 2 || lightDone > CHECK_ITEMS / 3 * 3 / 2) {
+        std::cout << "fair_share_scheduler FAILED, weight 1 job did " << lightDone << " items while weight 3 did "
+                  << CHECK_ITEMS << std::endl;
+        return false;
+    }
+    if (!light.each_once() || !heavy.each_once()) {
+        std::cout << "fair_share_scheduler FAILED, weighted jobs didn't run each item once" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+//-------------------------------------------------------------------------
+
+// several jobs behind one FIFO scheduler:  global index i is item items[i] of job jobs[i]
+struct fifo_jobs : worker {
+    std::mutex _mutex;
+    std::vector<count_worker *> _jobs;
+    std::vector<int> _items;
+    std::unique_ptr<scheduler> _s;
+
+    fifo_jobs() : _s(new scheduler(this, 0, THREADS)) {}
+
+    void add_job(count_worker *w, int n) {
+        {
+            std::lock_guard<std::mutex> lk(_mutex);
+            for (int i = 0; i < n; ++i) {
+                _jobs.push_back(w);
+                _items.push_back(i);
+            }
+        }
+        _s->add_work(n);
+    }
+
+    void do_work(int work) {
+        count_worker *w;
+        int item;
+        {
+            std::lock_guard<std::mutex> lk(_mutex);
+            w = _jobs[work];
+            item = _items[work];
+        }
+        w->do_work(item);
+    }
+};
+
+void report(const char *name, std::vector<double> latency, double hugeWall) {
+    std::sort(latency.begin(), latency.end());
+    std::cout << "---  " << name << "  ---" << std::endl;
+    std::cout << "small job latency ms:  p50 = " << latency[latency.size() / 2] * 1000
+              << "  max = " << latency.back() * 1000 << std::endl;
+    std::cout << "huge job Wall Time = " << hugeWall << std::endl << std::endl;
+}
+
+int main(int argc, char **argv) {
+    if (!check()) return 1;
+    std::cout << "Correctness checks passed." << std::endl << std::endl;
+
+    {
+        fifo_jobs fifo;
+        count_worker huge(HUGE_ITEMS);
+        std::vector<std::unique_ptr<count_worker>> small;
+        std::vector<double> latency;
+        double wall0 = get_wall_time();
+        fifo._s->run();
+        fifo.add_job(&huge, HUGE_ITEMS);
+        std::vector<double> submitted;
+        for (int i = 0; i < SMALL_JOBS; ++i) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(SMALL_EVERY_MS));
+            small.emplace_back(new count_worker(SMALL_ITEMS));
+            submitted.push_back(get_wall_time());
+            fifo.add_job(small.back().get(), SMALL_ITEMS);
+        }
+        fifo._s->join();
+        for (int i = 0; i < SMALL_JOBS; ++i) latency.push_back(small[i]->_finished - submitted[i]);
+        report("FIFO scheduler with add_work", latency, huge._finished - wall0);
+    }
+
+    {
+        fair_share_scheduler fs(THREADS);
+        count_worker huge(HUGE_ITEMS);
+        std::vector<std::unique_ptr<count_worker>> small;
+        std::vector<double> latency;
+        double wall0 = get_wall_time();
+        fs.run();
+        fs.add_job(&huge, HUGE_ITEMS);
+        std::vector<double> submitted;
+        for (int i = 0; i < SMALL_JOBS; ++i) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(SMALL_EVERY_MS));
+            small.emplace_back(new count_worker(SMALL_ITEMS));
+            submitted.push_back(get_wall_time());
+            fs.add_job(small.back().get(), SMALL_ITEMS);
+        }
+        fs.join();
+        for (int i = 0; i < SMALL_JOBS; ++i) latency.push_back(small[i]->_finished - submitted[i]);
+        report("fair_share_scheduler, equal weights", latency, huge._finished - wall0);
+    }
+    return 0;
+}
+
+//-------------------------------------------------------------------------
+//-------------------------------------------------------------------------
+//-------------------------------------------------------------------------
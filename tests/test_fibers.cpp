@@ -0,0 +1,219 @@
+//
+//  test_fibers.cpp
+//  Test for fiber_scheduler.h.  Checks thousands of sleeping items overlap on
+//  a few threads, that fiber_mutex keeps a yielding critical section
+//  exclusive, fiber_condition_variable hands every value from producers to
+//  consumers exactly once, fiber_wait_fd resumes on pipe data, also with two
+//  readers on one pipe, and that no more than maxFibers are ever alive.  Then times items that block for 10 ms
+//  each on a scheduler with sleep_for, at 4 and at 256 threads, and on a
+//  fiber_scheduler with fiber_sleep, and the cost of a fiber_yield.
+//
+
+/*
+build this example code from the command line with:
+g++ test_fibers.cpp -std=c++14 -O2
+*/
+
+#include "../fiber_scheduler.h"
+#include "../ext_timer.h"
+#include <iostream>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+
+
+#define SLEEPERS        2000
+#define SLEEP_US        20000
+#define LOCKERS         1000
+#define LOCK_ROUNDS     100
+#define PIPES           200
+#define BLOCKING_ITEMS  1000    // for the timings
+#define BLOCK_US        10000
+#define YIELDS          100000
+#define CHECK_THREADS   4
+#define THREADS         4
+
+//-------------------------------------------------------------------------
+
+template <typename F>
+bool run_fibers(F f, int maxWork, int maxFibers=FIBER_MAX_LIVE, int *peak=nullptr) {
+    function_worker<F> w(f);
+    fiber_scheduler fs(&w, maxWork, CHECK_THREADS, maxFibers);
+    if (!fs.run()) return false;
+    fs.join();
+    if (peak) *peak = fs.peak_fibers();
+    return true;
+}
+
+bool check() {
+    // sleeping items overlap:  SLEEPERS * SLEEP_US of sleeping takes about SLEEP_US
+    std::vector<std::atomic<int>> runs(SLEEPERS);
+    for (auto &r : runs) r = 0;
+    double wall0 = get_wall_time();
+    if (!run_fibers([&](int work) {
+            fiber_sleep(SLEEP_US);
+            ++runs[work];
+        }, SLEEPERS)) {
+        std::cout << "fiber_scheduler FAILED, couldn't start" << std::endl;
+        return false;
+    }
+    double wall = get_wall_time() - wall0;
+    for (auto &r : runs) {
+        if (r != 1) {
+            std::cout << "fiber_sleep FAILED, an item didn't run exactly once" << std::endl;
+            return false;
+        }
+    }
+    if (wall > 20 * SLEEP_US / 1e6) {
+        std::cout << "fiber_sleep FAILED, sleeping items didn't overlap, took " << wall << " s" << std::endl;
+        return false;
+    }
+
+    // a critical section that yields is still exclusive
+    fiber_mutex m;
+    long counter = 0;
+    int inside = 0;
+    bool overlapped = false;
+    run_fibers([&](int work) {
+        for (int i = 0; i < LOCK_ROUNDS; ++i) {
+            std::lock_guard<fiber_mutex> lk(m);
+            if (++inside != 1) overlapped = true;
+            long c = counter;
+            fiber_yield();
+            counter = c + 1;
+            --inside;
+        }
+    }, LOCKERS);
+    if (overlapped || counter != (long)LOCKERS * LOCK_ROUNDS) {
+        std::cout << "fiber_mutex FAILED, counter " << counter << std::endl;
+        return false;
+    }
+
+    // producers and consumers through a condition variable
+    fiber_mutex qm;
+    fiber_condition_variable qcv;
+    std::deque<int> queue;
+    std::vector<int> consumed(LOCKERS, 0);
+    run_fibers([&](int work) {
+        if (work % 2 == 0) {
+            fiber_sleep(work % 7 * 100);
+            std::lock_guard<fiber_mutex> lk(qm);
+            queue.push_back(work / 2);
+            qcv.notify_one();
+        } else {
+            std::unique_lock<fiber_mutex> lk(qm);
+            qcv.wait(lk, [&] {return !queue.empty();});
+            ++consumed[queue.front()];
+            queue.pop_front();
+        }
+    }, LOCKERS * 2);
+    for (int c : consumed) {
+        if (c != 1) {
+            std::cout << "fiber_condition_variable FAILED, a value was consumed " << c << " times" << std::endl;
+            return false;
+        }
+    }
+
+    // readers park on pipes until writers, started later, fill them
+    std::vector<int> fds(PIPES * 2);
+    for (int i = 0; i < PIPES; ++i) {
+        if (pipe(&fds[i * 2]) != 0) return false;
+    }
+    std::vector<int> got(PIPES, -1);
+    run_fibers([&](int work) {
+        if (work < PIPES) {
+            uint32_t events = fiber_wait_fd(fds[work * 2], EPOLLIN);
+            char c = 0;
+            if ((events & EPOLLIN) && read(fds[work * 2], &c, 1) == 1) got[work] = c;
+        } else {
+            fiber_sleep(1000);
+            char c = (char)(work - PIPES);
+            ssize_t r = write(fds[(work - PIPES) * 2 + 1], &c, 1);
+            (void)r;
+        }
+    }, PIPES * 2);
+    for (int fd : fds) close(fd);
+    for (int i = 0; i < PIPES; ++i) {
+        if (got[i] != (char)i) {
+            std::cout << "fiber_wait_fd FAILED, pipe " << i << std::endl;
+            return false;
+        }
+    }
+
+    // two readers waiting on one pipe both get their byte
+    int shared[2];
+    if (pipe(shared) != 0) return false;
+    std::atomic<int> reads(0);
+    run_fibers([&](int work) {
+        if (work < 2) {
+            char c;
+            if ((fiber_wait_fd(shared[0], EPOLLIN) & EPOLLIN) && read(shared[0], &c, 1) == 1) ++reads;
+        } else {
+            fiber_sleep(5000);
+            ssize_t r = write(shared[1], "ab", 2);
+            (void)r;
+        }
+    }, 3);
+    close(shared[0]);
+    close(shared[1]);
+    if (reads != 2) {
+        std::cout << "fiber_wait_fd FAILED, " << reads << " of 2 readers on one pipe read" << std::endl;
+        return false;
+    }
+
+    // the live fiber limit holds
+    int peak = 0;
+    run_fibers([&](int work) {fiber_sleep(100);}, 1000, 16, &peak);
+    if (peak > 16 || peak < 1) {
+        std::cout << "fiber_scheduler FAILED, " << peak << " fibers alive with a limit of 16" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+//-------------------------------------------------------------------------
+
+int main(int argc, char **argv) {
+    if (!check()) return 1;
+    std::cout << "Correctness checks passed." << std::endl << std::endl;
+
+    std::cout << "---  " << BLOCKING_ITEMS << " items that block for " << BLOCK_US / 1000 << " ms  ---" << std::endl;
+    for (int threads : {THREADS, 256}) {
+        double wall0 = get_wall_time();
+        parallel_for(BLOCKING_ITEMS, [](int work) {std::this_thread::sleep_for(std::chrono::microseconds(BLOCK_US));}, threads);
+        double wall1 = get_wall_time();
+        std::cout << "scheduler, sleep_for, " << threads << " threads:  Wall Time = " << wall1 - wall0 << std::endl;
+    }
+    {
+        double wall0 = get_wall_time();
+        auto f = [](int work) {fiber_sleep(BLOCK_US);};
+        function_worker<decltype(f)> w(f);
+        fiber_scheduler fs(&w, BLOCKING_ITEMS, THREADS);
+        fs.run();
+        fs.join();
+        double wall1 = get_wall_time();
+        std::cout << "fiber_scheduler, fiber_sleep, " << THREADS << " threads:  Wall Time = " << wall1 - wall0 << std::endl << std::endl;
+    }
+
+    {
+        auto f = [](int work) {
+            for (int i = 0; i < YIELDS; ++i) fiber_yield();
+        };
+        function_worker<decltype(f)> w(f);
+        fiber_scheduler fs(&w, 1, 1);
+        double wall0 = get_wall_time();
+        fs.run();
+        fs.join();
+        double wall1 = get_wall_time();
+        std::cout << "fiber_yield:  " << (wall1 - wall0) / YIELDS * 1e9 << " ns per park and resume" << std::endl;
+    }
+    return 0;
+}
+
+//-------------------------------------------------------------------------
+//-------------------------------------------------------------------------
+//-------------------------------------------------------------------------
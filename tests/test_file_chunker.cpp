@@ -0,0 +1,115 @@
+//
+//  test_file_chunker.cpp
+//  Test for file_chunker.h.  Writes a ~200 MB file of "id,value" lines,
+//  then counts the lines and sums the values with the chunker and with a
+//  plain getline loop, checks they agree, and times both.
+//
+
+/*
+build this example code from the command line with:
+g++ test_file_chunker.cpp -std=c++17 -O2
+*/
+
+#include "../file_chunker.h"
+#include "../ext_timer.h"
+#include <iostream>
+#include <fstream>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <random>
+#include <string>
+
+
+#define LINES   (10 * 1000 * 1000)
+#define TEST_FILE   "test_file_chunker.tmp"
+
+//-------------------------------------------------------------------------
+// the class that has a lot of work to do:  parse "id,value\n" lines
+
+struct line_summer : file_chunker {
+    std::atomic<uint64_t> _lines{0};
+    std::atomic<uint64_t> _sum{0};
+
+    void do_chunk(int chunkIndex, std::string_view records) {
+        uint64_t lines = 0, sum = 0;
+        while (!records.empty()) {
+            size_t end = records.find('\n');
+            std::string_view line = records.substr(0, end);
+            size_t comma = line.find(',');
+            uint64_t value = 0;
+            for (size_t i = comma + 1; i < line.size(); ++i) value = value * 10 + (line[i] - '0');
+            sum += value;
+            ++lines;
+            records.remove_prefix(end == std::string_view::npos ? records.size() : end + 1);
+        }
+        _lines += lines;
+        _sum += sum;
+    }
+};
+
+void getline_test(uint64_t &lines, uint64_t &sum) {
+    std::ifstream in(TEST_FILE);
+    std::string line;
+    lines = sum = 0;
+    while (std::getline(in, line)) {
+        sum += std::stoull(line.substr(line.find(',') + 1));
+        ++lines;
+    }
+}
+
+//-------------------------------------------------------------------------
+
+int main(int argc, char **argv) {
+    double wall0, cpu0, wall1, cpu1;
+
+    {
+        std::ofstream out(TEST_FILE);
+        std::mt19937 rng(0);
+        for (int i = 0; i < LINES; ++i) out << i << ',' << rng() % (1u << (rng() % 31)) << '\n';
+    }
+
+    uint64_t expectedLines, expectedSum;
+    getline_test(expectedLines, expectedSum);
+
+    // small chunks, so lots of them have to snap to a newline
+    line_summer small;
+    if (!small.open(TEST_FILE, 4096)) {std::cout << "open FAILED" << std::endl; return 1;}
+    small.run(4);
+    if (small._lines != expectedLines || small._sum != expectedSum) {std::cout << "file_chunker FAILED" << std::endl; return 1;}
+
+    // a custom delimiter through the lambda form:  count the commas' records
+    std::atomic<uint64_t> records{0};
+    process_file_chunks(TEST_FILE, [&](int, std::string_view r) {
+        uint64_t count = 0;
+        for (char c : r) count += (c == ',');
+        records += count;
+    }, 1 << 16, ',', 4);
+    if (records != expectedLines) {std::cout << "process_file_chunks FAILED" << std::endl; return 1;}
+    std::cout << "Correctness checks passed, " << small.chunk_count() << " small chunks." << std::endl << std::endl;
+
+    std::cout << "---  " << LINES << " lines  ---" << std::endl;
+
+    wall0 = get_wall_time();
+    cpu0 = get_cpu_time();
+    getline_test(expectedLines, expectedSum);
+    wall1 = get_wall_time();
+    cpu1 = get_cpu_time();
+    std::cout << "getline loop   Wall Time = " << wall1 - wall0 << "  CPU Time = " << cpu1 - cpu0 << std::endl;
+
+    wall0 = get_wall_time();
+    cpu0 = get_cpu_time();
+    line_summer summer;
+    summer.open(TEST_FILE);
+    summer.run();
+    wall1 = get_wall_time();
+    cpu1 = get_cpu_time();
+    std::cout << "file_chunker   Wall Time = " << wall1 - wall0 << "  CPU Time = " << cpu1 - cpu0 << std::endl;
+
+    std::remove(TEST_FILE);
+    return 0;
+}
+
+//-------------------------------------------------------------------------
+//-------------------------------------------------------------------------
+//-------------------------------------------------------------------------
@@ -0,0 +1,146 @@
+//
+//  test_graph.cpp
+//  Test for graph.h.  Builds a random undirected graph of 2M vertices and
+//  16M edges, checks parallel_bfs and parallel_connected_components against
+//  a serial queue BFS and a serial union-find, and times them.
+//
+
+/*
+build this example code from the command line with:
+g++ test_graph.cpp -std=c++14 -O2
+*/
+
+#include "../graph.h"
+#include "../ext_timer.h"
+#include <iostream>
+#include <cstdint>
+#include <numeric>
+#include <queue>
+#include <random>
+#include <vector>
+
+
+#define VERTICES    (1 << 21)
+#define EDGES       (1 << 24)
+#define CHECK_THREADS   4
+
+//-------------------------------------------------------------------------
+
+// random edges, but only within each quarter of the vertices (so there are at
+// least four components), plus some isolated vertices at the end
+csr_graph random_graph(uint32_t vertexCount, size_t edgeCount) {
+    std::mt19937 rng(0);
+    const uint32_t isolated = 1000;
+    const uint32_t quarter = (vertexCount - isolated) / 4;
+    std::vector<std::pair<uint32_t, uint32_t>> edgeList(edgeCount);
+    for (auto &e : edgeList) {
+        uint32_t base = (rng() % 4) * quarter;
+        e.first = base + rng() % quarter;
+        e.second = base + rng() % quarter;
+    }
+    return csr_graph::from_edges(vertexCount, edgeList);
+}
+
+void serial_bfs(const csr_graph &g, uint32_t source, std::vector<int32_t> &depth) {
+    depth.assign(g.vertex_count(), -1);
+    std::queue<uint32_t> q;
+    depth[source] = 0;
+    q.push(source);
+    while (!q.empty()) {
+        uint32_t v = q.front();
+        q.pop();
+        for (size_t e = g.offsets[v]; e < g.offsets[v+1]; ++e) {
+            if (depth[g.edges[e]] < 0) {
+                depth[g.edges[e]] = depth[v] + 1;
+                q.push(g.edges[e]);
+            }
+        }
+    }
+}
+
+uint32_t serial_find(std::vector<uint32_t> &parent, uint32_t v) {
+    while (parent[v] != v) v = parent[v] = parent[parent[v]];
+    return v;
+}
+
+uint32_t serial_components(const csr_graph &g, std::vector<uint32_t> &label) {
+    label.resize(g.vertex_count());
+    std::iota(label.begin(), label.end(), 0);
+    for (uint32_t v = 0; v < g.vertex_count(); ++v) {
+        for (size_t e = g.offsets[v]; e < g.offsets[v+1]; ++e) {
+            uint32_t a = serial_find(label, v), b = serial_find(label, g.edges[e]);
+            if (a != b) label[std::max(a, b)] = std::min(a, b);
+        }
+    }
+    uint32_t components = 0;
+    for (uint32_t v = 0; v < g.vertex_count(); ++v) {
+        label[v] = serial_find(label, v);
+        if (label[v] == v) ++components;
+    }
+    return components;
+}
+
+//-------------------------------------------------------------------------
+
+int main(int argc, char **argv) {
+    double wall0, cpu0, wall1, cpu1;
+
+    csr_graph g = random_graph(VERTICES, EDGES);
+
+    std::vector<int32_t> expectedDepth, depth;
+    serial_bfs(g, 0, expectedDepth);
+    parallel_bfs(g, 0, depth, CHECK_THREADS);
+    if (depth != expectedDepth) {std::cout << "parallel_bfs FAILED" << std::endl; return 1;}
+
+    // directed graphs only ever go top down
+    csr_graph directed = random_graph(VERTICES / 16, EDGES / 16);
+    directed.symmetric = false;
+    serial_bfs(directed, 0, expectedDepth);
+    parallel_bfs(directed, 0, depth, CHECK_THREADS);
+    if (depth != expectedDepth) {std::cout << "parallel_bfs (directed) FAILED" << std::endl; return 1;}
+
+    std::vector<uint32_t> expectedLabel, label;
+    uint32_t expectedComponents = serial_components(g, expectedLabel);
+    uint32_t components = parallel_connected_components(g, label, CHECK_THREADS);
+    if (label != expectedLabel || components != expectedComponents) {
+        std::cout << "parallel_connected_components FAILED" << std::endl;
+        return 1;
+    }
+    std::cout << "Correctness checks passed, " << components << " components." << std::endl << std::endl;
+
+    std::cout << "---  " << VERTICES << " vertices, " << g.edge_count() << " directed edges  ---" << std::endl;
+
+    wall0 = get_wall_time();
+    cpu0 = get_cpu_time();
+    serial_bfs(g, 0, expectedDepth);
+    wall1 = get_wall_time();
+    cpu1 = get_cpu_time();
+    std::cout << "serial BFS                     Wall Time = " << wall1 - wall0 << "  CPU Time = " << cpu1 - cpu0 << std::endl;
+
+    wall0 = get_wall_time();
+    cpu0 = get_cpu_time();
+    parallel_bfs(g, 0, depth);
+    wall1 = get_wall_time();
+    cpu1 = get_cpu_time();
+    std::cout << "parallel_bfs                   Wall Time = " << wall1 - wall0 << "  CPU Time = " << cpu1 - cpu0 << std::endl;
+
+    wall0 = get_wall_time();
+    cpu0 = get_cpu_time();
+    serial_components(g, expectedLabel);
+    wall1 = get_wall_time();
+    cpu1 = get_cpu_time();
+    std::cout << "serial union-find              Wall Time = " << wall1 - wall0 << "  CPU Time = " << cpu1 - cpu0 << std::endl;
+
+    wall0 = get_wall_time();
+    cpu0 = get_cpu_time();
+    parallel_connected_components(g, label);
+    wall1 = get_wall_time();
+    cpu1 = get_cpu_time();
+    std::cout << "parallel_connected_components  Wall Time = " << wall1 - wall0 << "  CPU Time = " << cpu1 - cpu0 << std::endl;
+
+    return 0;
+}
+
+//-------------------------------------------------------------------------
+//-------------------------------------------------------------------------
+//-------------------------------------------------------------------------
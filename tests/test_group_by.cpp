@@ -0,0 +1,150 @@
+//
+//  test_group_by.cpp
+//  Test for group_by.h.  Checks sum/min/max/count group-by and the histogram
+//  against a serial loop for a small K (private bins) and a large K
+//  (partitioned, also with a capped fan-out so it splits twice), then times
+//  both strategies against the serial loop.
+//
+
+/*
+build this example code from the command line with:
+g++ test_group_by.cpp -std=c++14 -O2
+*/
+
+#include "../group_by.h"
+#include "../ext_timer.h"
+#include <iostream>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+
+#define ROWS    (1 << 24)
+#define CHECK_THREADS   4
+
+//-------------------------------------------------------------------------
+// the struct-of-arrays input:  a key column and two value columns
+
+struct table {
+    std::vector<uint32_t> keys;
+    std::vector<int64_t> price;
+    std::vector<int64_t> quantity;
+
+    table(size_t rows, uint32_t binCount) : keys(rows), price(rows), quantity(rows) {
+        std::mt19937 rng(0);
+        for (size_t r = 0; r < rows; ++r) {
+            keys[r] = rng() % binCount;
+            price[r] = (int64_t)(rng() % 100000) - 50000;
+            quantity[r] = rng() % 100;
+        }
+    }
+};
+
+struct results {
+    std::vector<int64_t> sumQuantity, minPrice, maxPrice, count;
+
+    explicit results(uint32_t binCount) : sumQuantity(binCount), minPrice(binCount), maxPrice(binCount), count(binCount) {}
+
+    std::vector<group_by_column<int64_t>> columns(const table &t) {
+        std::vector<group_by_column<int64_t>> c;
+        c.push_back({t.quantity.data(), GROUP_SUM, sumQuantity.data()});
+        c.push_back({t.price.data(), GROUP_MIN, minPrice.data()});
+        c.push_back({t.price.data(), GROUP_MAX, maxPrice.data()});
+        c.push_back({nullptr, GROUP_COUNT, count.data()});
+        return c;
+    }
+
+    bool operator==(const results &o) const {
+        return sumQuantity == o.sumQuantity && minPrice == o.minPrice && maxPrice == o.maxPrice && count == o.count;
+    }
+};
+
+void serial_group_by(const table &t, results &r) {
+    std::fill(r.sumQuantity.begin(), r.sumQuantity.end(), 0);
+    std::fill(r.minPrice.begin(), r.minPrice.end(), std::numeric_limits<int64_t>::max());
+    std::fill(r.maxPrice.begin(), r.maxPrice.end(), std::numeric_limits<int64_t>::lowest());
+    std::fill(r.count.begin(), r.count.end(), 0);
+    for (size_t i = 0; i < t.keys.size(); ++i) {
+        uint32_t k = t.keys[i];
+        r.sumQuantity[k] += t.quantity[i];
+        r.minPrice[k] = std::min(r.minPrice[k], t.price[i]);
+        r.maxPrice[k] = std::max(r.maxPrice[k], t.price[i]);
+        ++r.count[k];
+    }
+}
+
+bool check_correctness(uint32_t binCount) {
+    table t(ROWS / 4 + 5, binCount);
+    results expected(binCount), got(binCount);
+    serial_group_by(t, expected);
+    parallel_group_by(t.keys.data(), t.keys.size(), binCount, got.columns(t), CHECK_THREADS);
+    if (!(expected == got)) {
+        std::cout << "parallel_group_by K = " << binCount << " FAILED" << std::endl;
+        return false;
+    }
+
+    std::vector<size_t> histogram(binCount);
+    parallel_histogram(t.keys.data(), t.keys.size(), binCount, histogram.data(), CHECK_THREADS);
+    for (uint32_t k = 0; k < binCount; ++k) {
+        if ((int64_t)histogram[k] != expected.count[k]) {
+            std::cout << "parallel_histogram K = " << binCount << " FAILED" << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+// the partitioned strategy with a small fan-out, so 4M bins take a second split inside each partition
+bool check_two_pass(uint32_t binCount) {
+    table t(ROWS / 4 + 5, binCount);
+    results expected(binCount), got(binCount);
+    serial_group_by(t, expected);
+    std::vector<group_by_column<int64_t>> columns = got.columns(t);
+    group_by_partitioned(t.keys.data(), t.keys.size(), binCount, columns, CHECK_THREADS, 16);
+    if (!(expected == got)) {
+        std::cout << "group_by_partitioned K = " << binCount << ", 16 partitions FAILED" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+//-------------------------------------------------------------------------
+
+void time_group_by(uint32_t binCount) {
+    double wall0, cpu0, wall1, cpu1;
+    table t(ROWS, binCount);
+    results r(binCount);
+
+    std::cout << "---  K = " << binCount << ", " << ROWS << " rows, 4 aggregates  ---" << std::endl;
+
+    wall0 = get_wall_time();
+    cpu0 = get_cpu_time();
+    serial_group_by(t, r);
+    wall1 = get_wall_time();
+    cpu1 = get_cpu_time();
+    std::cout << "serial loop        Wall Time = " << wall1 - wall0 << "  CPU Time = " << cpu1 - cpu0 << std::endl;
+
+    wall0 = get_wall_time();
+    cpu0 = get_cpu_time();
+    parallel_group_by(t.keys.data(), t.keys.size(), binCount, r.columns(t));
+    wall1 = get_wall_time();
+    cpu1 = get_cpu_time();
+    std::cout << "parallel_group_by  Wall Time = " << wall1 - wall0 << "  CPU Time = " << cpu1 - cpu0 << std::endl;
+    std::cout << std::endl;
+}
+
+int main(int argc, char **argv) {
+    // 256 bins take the private bins path, 4M bins the partitioned path
+    if (!check_correctness(256) || !check_correctness(1 << 22) || !check_two_pass(1 << 22) || !check_two_pass((1 << 22) + 3)) return 1;
+    std::cout << "Correctness checks passed." << std::endl << std::endl;
+
+    time_group_by(256);
+    time_group_by(1 << 12);
+    time_group_by(1 << 22);
+
+    return 0;
+}
+
+//-------------------------------------------------------------------------
+//-------------------------------------------------------------------------
+//-------------------------------------------------------------------------
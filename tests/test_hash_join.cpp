@@ -0,0 +1,98 @@
+//
+//  test_hash_join.cpp
+//  Test for hash_join.h.  Joins a 1M row table against a 4M row table,
+//  checks the matches against a serial std::unordered_multimap join, and
+//  times the two.
+//
+
+/*
+build this example code from the command line with:
+g++ test_hash_join.cpp -std=c++14 -O2
+*/
+
+#include "../hash_join.h"
+#include "../ext_timer.h"
+#include <iostream>
+#include <algorithm>
+#include <cstdint>
+#include <random>
+#include <unordered_map>
+#include <vector>
+
+
+#define BUILD_ROWS  (1 << 20)
+#define PROBE_ROWS  (1 << 22)
+#define CHECK_THREADS   4
+
+//-------------------------------------------------------------------------
+
+// keys drawn from a range a bit bigger than the build side, so some keys
+// repeat and some probe rows have no match
+std::vector<uint64_t> random_keys(size_t rows, unsigned seed) {
+    std::mt19937_64 rng(seed);
+    std::vector<uint64_t> keys(rows);
+    for (auto &k : keys) k = rng() % (BUILD_ROWS + BUILD_ROWS / 2);
+    return keys;
+}
+
+void serial_join(const std::vector<uint64_t> &build, const std::vector<uint64_t> &probe, std::vector<join_match> &matches) {
+    std::unordered_multimap<uint64_t, size_t> table;
+    table.reserve(build.size());
+    for (size_t i = 0; i < build.size(); ++i) table.insert(std::make_pair(build[i], i));
+    for (size_t j = 0; j < probe.size(); ++j) {
+        auto range = table.equal_range(probe[j]);
+        for (auto it = range.first; it != range.second; ++it) matches.push_back({it->second, j});
+    }
+}
+
+bool match_less(const join_match &a, const join_match &b) {
+    return a.probe != b.probe ? a.probe < b.probe : a.build < b.build;
+}
+
+bool match_equal(const join_match &a, const join_match &b) {
+    return a.probe == b.probe && a.build == b.build;
+}
+
+//-------------------------------------------------------------------------
+
+int main(int argc, char **argv) {
+    double wall0, cpu0, wall1, cpu1;
+
+    std::vector<uint64_t> build = random_keys(BUILD_ROWS, 1);
+    std::vector<uint64_t> probe = random_keys(PROBE_ROWS, 2);
+
+    std::vector<join_match> expected, got;
+    serial_join(build, probe, expected);
+    parallel_hash_join(build.data(), build.size(), probe.data(), probe.size(), got, CHECK_THREADS);
+    std::sort(expected.begin(), expected.end(), match_less);
+    std::sort(got.begin(), got.end(), match_less);
+    if (expected.size() != got.size() || !std::equal(expected.begin(), expected.end(), got.begin(), match_equal)) {
+        std::cout << "parallel_hash_join FAILED" << std::endl;
+        return 1;
+    }
+    std::cout << "Correctness check passed, " << got.size() << " matches." << std::endl << std::endl;
+
+    std::cout << "---  " << BUILD_ROWS << " build rows x " << PROBE_ROWS << " probe rows  ---" << std::endl;
+
+    expected.clear();
+    wall0 = get_wall_time();
+    cpu0 = get_cpu_time();
+    serial_join(build, probe, expected);
+    wall1 = get_wall_time();
+    cpu1 = get_cpu_time();
+    std::cout << "unordered_multimap  Wall Time = " << wall1 - wall0 << "  CPU Time = " << cpu1 - cpu0 << std::endl;
+
+    got.clear();
+    wall0 = get_wall_time();
+    cpu0 = get_cpu_time();
+    parallel_hash_join(build.data(), build.size(), probe.data(), probe.size(), got);
+    wall1 = get_wall_time();
+    cpu1 = get_cpu_time();
+    std::cout << "parallel_hash_join  Wall Time = " << wall1 - wall0 << "  CPU Time = " << cpu1 - cpu0 << std::endl;
+
+    return 0;
+}
+
+//-------------------------------------------------------------------------
+//-------------------------------------------------------------------------
+//-------------------------------------------------------------------------
@@ -0,0 +1,144 @@
+//
+//  test_ordered_writer.cpp
+//  Test for ordered_writer.h.  Each of 4000 chunks formats a varying number of
+//  text lines, so chunk sizes are only known once computed.  Checks the file
+//  against a serial build of the same text (and chunks handed in backwards),
+//  and that when chunk 0 is the slowest the chunks parked behind it are
+//  written by several threads at once.  Then compares computing everything
+//  and writing it after join() against write_ordered_chunks writing while
+//  the job runs.
+//
+
+/*
+build this example code from the command line with:
+g++ test_ordered_writer.cpp -std=c++14 -O2
+*/
+
+#include "../ordered_writer.h"
+#include "../ext_timer.h"
+#include <iostream>
+#include <fstream>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+#define TEST_FILE   "test_ordered_writer.tmp"
+#define CHUNKS      4000
+#define CHECK_THREADS   4
+#define BIG_CHUNKS      64
+#define BIG_CHUNK_BYTES (1 << 20)
+#define THREADS     8
+
+//-------------------------------------------------------------------------
+
+// chunk index's output:  a varying number of formatted lines
+void make_chunk(int index, std::string &out) {
+    int lines = (index * 7919) % 1000 + (index % 5 == 0 ? 0 : 50);
+    for (int j = 0; j < lines; ++j) {
+        uint64_t v = (uint64_t)index * 2654435761u + (uint64_t)j * 40503u;
+        out += std::to_string(index) + ',' + std::to_string(j) + ',' + std::to_string(v % 1000003) + '\n';
+    }
+}
+
+std::string read_file(const char *path) {
+    std::ifstream in(path, std::ios::binary);
+    return std::string((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+}
+
+bool check() {
+    std::string expected;
+    for (int i = 0; i < CHUNKS; ++i) make_chunk(i, expected);
+
+    if (!write_ordered_chunks(TEST_FILE, CHUNKS, make_chunk, CHECK_THREADS) || read_file(TEST_FILE) != expected) {
+        std::cout << "write_ordered_chunks FAILED" << std::endl;
+        return false;
+    }
+
+    // the worst order:  nothing can be written until the last chunk handed in, chunk 0
+    ordered_writer writer;
+    writer.open(TEST_FILE, CHUNKS);
+    for (int i = CHUNKS - 1; i >= 0; --i) {
+        std::string out;
+        make_chunk(i, out);
+        writer.write_chunk(i, std::move(out));
+    }
+    if (writer.size() != expected.size() || !writer.close() || read_file(TEST_FILE) != expected) {
+        std::cout << "ordered_writer FAILED with chunks in reverse" << std::endl;
+        return false;
+    }
+
+    // chunk 0 is the slowest:  the rest are parked behind it, and once it is in the idle
+    // threads write them side by side, rather than chunk 0's thread writing them all
+    writer.open(TEST_FILE, BIG_CHUNKS);
+    parallel_for(BIG_CHUNKS + CHECK_THREADS, [&](int index) {
+        if (index >= BIG_CHUNKS) {
+            writer.write_resolved();
+            return;
+        }
+        if (index == 0) std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        writer.write_chunk(index, std::string(BIG_CHUNK_BYTES, (char)('a' + index % 26)));
+    }, CHECK_THREADS);
+    std::string big = read_file(TEST_FILE);
+    bool bigOk = big.size() == (size_t)BIG_CHUNKS * BIG_CHUNK_BYTES;
+    for (int i = 0; bigOk && i < BIG_CHUNKS; ++i) bigOk = big[(size_t)i * BIG_CHUNK_BYTES] == (char)('a' + i % 26);
+    int peak = writer.peak_concurrent_writes();
+    if (!writer.close() || !bigOk || peak < 2) {
+        std::cout << "ordered_writer FAILED with a slow chunk 0, at most " << peak << " writes at once" << std::endl;
+        return false;
+    }
+
+    // a missing chunk is an error
+    writer.open(TEST_FILE, 2);
+    writer.write_chunk(1, std::string("x"));
+    if (writer.close()) {
+        std::cout << "ordered_writer FAILED, missing chunk not reported" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+//-------------------------------------------------------------------------
+
+int main(int argc, char **argv) {
+    double wall0, cpu0, wall1, cpu1;
+
+    if (!check()) {
+        std::remove(TEST_FILE);
+        return 1;
+    }
+    std::cout << "Correctness checks passed." << std::endl << std::endl;
+
+    wall0 = get_wall_time();
+    cpu0 = get_cpu_time();
+    std::vector<std::string> chunks(CHUNKS);
+    parallel_for(CHUNKS, [&](int i) {make_chunk(i, chunks[i]);}, THREADS);
+    {
+        std::ofstream out(TEST_FILE, std::ios::binary);
+        for (auto &c : chunks) out.write(c.data(), c.size());
+    }
+    wall1 = get_wall_time();
+    cpu1 = get_cpu_time();
+    std::cout << "---  compute, then write serially after join  ---" << std::endl;
+    std::cout << "Wall Time = " << wall1 - wall0 << std::endl;
+    std::cout << "CPU Time  = " << cpu1 - cpu0 << std::endl;
+    std::cout << std::endl;
+
+    wall0 = get_wall_time();
+    cpu0 = get_cpu_time();
+    write_ordered_chunks(TEST_FILE, CHUNKS, make_chunk, THREADS);
+    wall1 = get_wall_time();
+    cpu1 = get_cpu_time();
+    std::cout << "---  write_ordered_chunks  ---" << std::endl;
+    std::cout << "Wall Time = " << wall1 - wall0 << std::endl;
+    std::cout << "CPU Time  = " << cpu1 - cpu0 << std::endl;
+
+    std::remove(TEST_FILE);
+    return 0;
+}
+
+//-------------------------------------------------------------------------
+//-------------------------------------------------------------------------
+//-------------------------------------------------------------------------
@@ -0,0 +1,157 @@
+//
+//  test_read_ahead.cpp
+//  Test for read_ahead.h.  Writes 2000 files of 64 KB, then checksums them
+//  three ways:  a plain scheduler whose workers read their own files, and
+//  read_ahead with io_uring and with its fallback reader threads.  Caches are
+//  warm after the first pass, so this mostly shows the reads moving off the
+//  pool's threads, not disk latency being hidden.
+//
+
+/*
+build this example code from the command line with:
+g++ test_read_ahead.cpp -std=c++14 -O2
+*/
+
+#include "../read_ahead.h"
+#include "../ext_timer.h"
+#include <iostream>
+#include <fstream>
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <sys/stat.h>
+
+
+#define TEST_ROOT   "test_read_ahead.tmp"
+#define FILE_COUNT  2000
+#define FILE_BYTES  (64 * 1024)
+#define CHECK_THREADS   4
+#define THREADS     8
+
+//-------------------------------------------------------------------------
+
+std::string test_path(int index) {
+    return TEST_ROOT "/file" + std::to_string(index) + ".bin";
+}
+
+// a little CPU work per byte, so processing isn't free
+uint64_t checksum(const char *data, size_t size) {
+    uint64_t h = 14695981039346656037ull;
+    for (size_t i = 0; i < size; ++i) h = (h ^ (unsigned char)data[i]) * 1099511628211ull;
+    return h;
+}
+
+// writes the files, returns each one's checksum.  the last file is empty.
+std::vector<uint64_t> make_files() {
+    mkdir(TEST_ROOT, 0755);
+    std::vector<uint64_t> sums(FILE_COUNT);
+    std::string contents(FILE_BYTES, 0);
+    for (int i = 0; i < FILE_COUNT; ++i) {
+        size_t size = (i == FILE_COUNT - 1) ? 0 : FILE_BYTES - (i % 1000);
+        for (size_t b = 0; b < size; ++b) contents[b] = (char)(b * 7 + i);
+        std::ofstream out(test_path(i), std::ios::binary);
+        out.write(contents.data(), size);
+        sums[i] = checksum(contents.data(), size);
+    }
+    return sums;
+}
+
+struct summer : read_ahead {
+    std::vector<uint64_t> _sums;
+    int _missing;   // files past FILE_COUNT, which don't exist
+    summer(int missing=0) : _sums(FILE_COUNT + missing, 0), _missing(missing) {}
+
+    std::string file_path(int index) {return test_path(index);}
+    void do_buffer(int index, const char *data, size_t size) {
+        _sums[index] = data ? checksum(data, size) : 1;
+    }
+};
+
+// the baseline:  each worker reads its own file
+struct sync_summer : worker {
+    std::vector<uint64_t> _sums;
+    sync_summer() : _sums(FILE_COUNT, 0) {}
+    void do_work(int work) {
+        std::ifstream in(test_path(work), std::ios::binary);
+        std::string contents((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        _sums[work] = checksum(contents.data(), contents.size());
+    }
+};
+
+bool check(bool forceThreads, int queueDepth, const std::vector<uint64_t> &expected) {
+    summer s(3);
+    s.force_reader_threads(forceThreads);
+    s.run(FILE_COUNT + 3, CHECK_THREADS, queueDepth);
+    for (int i = 0; i < FILE_COUNT; ++i) {
+        if (s._sums[i] != expected[i]) {
+            std::cout << "read_ahead FAILED at file " << i << (s.using_io_uring() ? " (io_uring)" : " (threads)") << std::endl;
+            return false;
+        }
+    }
+    for (int i = FILE_COUNT; i < FILE_COUNT + 3; ++i) {
+        if (s._sums[i] != 1) {
+            std::cout << "read_ahead FAILED, missing file " << i << " wasn't reported" << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+//-------------------------------------------------------------------------
+
+int main(int argc, char **argv) {
+    double wall0, cpu0, wall1, cpu1;
+
+    std::vector<uint64_t> expected = make_files();
+    bool ok = check(false, 1, expected) && check(false, 16, expected) && check(true, 1, expected) && check(true, 64, expected);
+    if (!ok) {
+        std::system("rm -rf " TEST_ROOT);
+        return 1;
+    }
+    summer probe;
+    probe.run(1, 1);
+    std::cout << "Correctness checks passed, io_uring " << (probe.using_io_uring() ? "available." : "not available, reader threads used.") << std::endl << std::endl;
+
+    wall0 = get_wall_time();
+    cpu0 = get_cpu_time();
+    sync_summer ss;
+    scheduler s(&ss, FILE_COUNT, THREADS);
+    s.run();
+    s.join();
+    wall1 = get_wall_time();
+    cpu1 = get_cpu_time();
+    std::cout << "---  workers read their own files  ---" << std::endl;
+    std::cout << "Wall Time = " << wall1 - wall0 << std::endl;
+    std::cout << "CPU Time  = " << cpu1 - cpu0 << std::endl;
+    std::cout << std::endl;
+
+    wall0 = get_wall_time();
+    cpu0 = get_cpu_time();
+    summer ring;
+    ring.run(FILE_COUNT, THREADS);
+    wall1 = get_wall_time();
+    cpu1 = get_cpu_time();
+    std::cout << "---  read_ahead, " << (ring.using_io_uring() ? "io_uring" : "reader threads") << "  ---" << std::endl;
+    std::cout << "Wall Time = " << wall1 - wall0 << std::endl;
+    std::cout << "CPU Time  = " << cpu1 - cpu0 << std::endl;
+    std::cout << std::endl;
+
+    wall0 = get_wall_time();
+    cpu0 = get_cpu_time();
+    summer threads;
+    threads.force_reader_threads(true);
+    threads.run(FILE_COUNT, THREADS);
+    wall1 = get_wall_time();
+    cpu1 = get_cpu_time();
+    std::cout << "---  read_ahead, reader threads  ---" << std::endl;
+    std::cout << "Wall Time = " << wall1 - wall0 << std::endl;
+    std::cout << "CPU Time  = " << cpu1 - cpu0 << std::endl;
+
+    std::system("rm -rf " TEST_ROOT);
+    return 0;
+}
+
+//-------------------------------------------------------------------------
+//-------------------------------------------------------------------------
+//-------------------------------------------------------------------------
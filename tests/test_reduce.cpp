@@ -0,0 +1,148 @@
+//
+//  test_reduce.cpp
+//  Test for parallel_reduce.h.  Checks integer sums and mins of every flavour
+//  against std::accumulate, that deterministic_reduce and reproducible_sum
+//  give bit identical float sums at 1 to 8 threads and on repeated runs, and
+//  that the Kahan sum is within its error bound.  Then sums 32M floats with
+//  each, reporting the time, the error against a long double sum, and how
+//  many distinct results each gave across thread counts and runs.
+//
+
+/*
+build this example code from the command line with:
+g++ test_reduce.cpp -std=c++14 -O2
+*/
+
+#include "../parallel_reduce.h"
+#include "../ext_timer.h"
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <numeric>
+#include <random>
+#include <set>
+#include <vector>
+
+
+#define ELEMENTS        (1 << 25)
+#define CHECK_ELEMENTS  1000003     // not a multiple of the block
+#define REPEATS         5
+#define CHECK_THREADS   4
+
+//-------------------------------------------------------------------------
+
+// floats over many magnitudes and both signs, so the sum is rounding sensitive
+std::vector<float> make_floats(size_t n) {
+    std::mt19937 rng(7);
+    std::uniform_real_distribution<float> mantissa(-1, 1);
+    std::uniform_int_distribution<int> exponent(-8, 8);
+    std::vector<float> data(n);
+    for (auto &x : data) x = std::ldexp(mantissa(rng), exponent(rng));
+    return data;
+}
+
+long double exact_sum(const std::vector<float> &data) {
+    long double sum = 0;
+    for (float x : data) sum += x;
+    return sum;
+}
+
+uint32_t bits(float f) {
+    uint32_t b;
+    memcpy(&b, &f, sizeof(b));
+    return b;
+}
+
+bool check() {
+    std::vector<int64_t> ints(CHECK_ELEMENTS);
+    std::mt19937 rng(3);
+    for (auto &v : ints) v = (int64_t)(rng() % 2000001) - 1000000;
+    int64_t expected = std::accumulate(ints.begin(), ints.end(), (int64_t)5);
+    int64_t expectedMin = *std::min_element(ints.begin(), ints.end());
+    auto min_op = [](int64_t a, int64_t b) {return std::min(a, b);};
+    if (parallel_reduce(ints.data(), ints.size(), (int64_t)5, std::plus<int64_t>(), CHECK_THREADS) != expected ||
+        deterministic_reduce(ints.data(), ints.size(), (int64_t)5, std::plus<int64_t>(), CHECK_THREADS) != expected ||
+        parallel_reduce(ints.data(), ints.size(), std::numeric_limits<int64_t>::max(), min_op, CHECK_THREADS) != expectedMin ||
+        deterministic_reduce(ints.data(), ints.size(), std::numeric_limits<int64_t>::max(), min_op, CHECK_THREADS) != expectedMin) {
+        std::cout << "parallel_reduce FAILED, integer sum or min" << std::endl;
+        return false;
+    }
+    if (parallel_reduce(ints.data(), 0, (int64_t)9) != 9 || deterministic_reduce(ints.data(), 0, (int64_t)9) != 9 ||
+        deterministic_reduce(ints.data(), 3, (int64_t)0) != ints[0] + ints[1] + ints[2]) {
+        std::cout << "parallel_reduce FAILED, empty or tiny input" << std::endl;
+        return false;
+    }
+
+    std::vector<float> data = make_floats(CHECK_ELEMENTS);
+    double magnitude = 0;
+    for (float x : data) magnitude += std::fabs(x);
+    for (int how = SUM_PLAIN; how <= SUM_KAHAN; ++how) {
+        float first = reproducible_sum(data.data(), data.size(), (reduce_summation)how, 1);
+        for (int threads = 1; threads <= 8; ++threads) {
+            for (int r = 0; r < 3; ++r) {
+                if (bits(reproducible_sum(data.data(), data.size(), (reduce_summation)how, threads)) != bits(first)) {
+                    std::cout << "reproducible_sum FAILED, summation " << how << " differs at " << threads << " threads" << std::endl;
+                    return false;
+                }
+            }
+        }
+        if (how == SUM_KAHAN && std::fabs(first - exact_sum(data)) > 1e-6 * magnitude) {
+            std::cout << "reproducible_sum FAILED, Kahan sum is off by " << first - exact_sum(data) << std::endl;
+            return false;
+        }
+    }
+    float first = deterministic_reduce(data.data(), data.size(), 0.0f, std::plus<float>(), 1);
+    for (int threads = 1; threads <= 8; ++threads) {
+        if (bits(deterministic_reduce(data.data(), data.size(), 0.0f, std::plus<float>(), threads)) != bits(first)) {
+            std::cout << "deterministic_reduce FAILED, differs at " << threads << " threads" << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+//-------------------------------------------------------------------------
+
+// times f at 1, 2, 4 and 8 threads, REPEATS times each, and reports the best time, the
+// error of the last result, and how many distinct results there were
+template <typename F>
+void benchmark(const char *name, const std::vector<float> &data, long double exact, F f) {
+    std::set<uint32_t> results;
+    double best = 1e30;
+    float sum = 0;
+    for (int threads : {1, 2, 4, 8}) {
+        for (int r = 0; r < REPEATS; ++r) {
+            double wall0 = get_wall_time();
+            sum = f(threads);
+            double wall1 = get_wall_time();
+            if (threads == CHECK_THREADS) best = std::min(best, wall1 - wall0);
+            results.insert(bits(sum));
+        }
+    }
+    std::cout << name << ":  Wall Time at " << CHECK_THREADS << " threads = " << best << "  error = " << (double)(sum - exact)
+              << "  distinct results = " << results.size() << std::endl;
+}
+
+int main(int argc, char **argv) {
+    if (!check()) return 1;
+    std::cout << "Correctness checks passed." << std::endl << std::endl;
+
+    std::vector<float> data = make_floats(ELEMENTS);
+    long double exact = exact_sum(data);
+    const float *p = data.data();
+    size_t n = data.size();
+    std::cout << "---  sum of " << n << " floats, at 1, 2, 4 and 8 threads, " << REPEATS << " runs each  ---" << std::endl;
+    benchmark("parallel_reduce              ", data, exact, [&](int threads) {return parallel_reduce(p, n, 0.0f, std::plus<float>(), threads);});
+    benchmark("deterministic_reduce         ", data, exact, [&](int threads) {return deterministic_reduce(p, n, 0.0f, std::plus<float>(), threads);});
+    benchmark("reproducible_sum SUM_PLAIN   ", data, exact, [&](int threads) {return reproducible_sum(p, n, SUM_PLAIN, threads);});
+    benchmark("reproducible_sum SUM_PAIRWISE", data, exact, [&](int threads) {return reproducible_sum(p, n, SUM_PAIRWISE, threads);});
+    benchmark("reproducible_sum SUM_KAHAN   ", data, exact, [&](int threads) {return reproducible_sum(p, n, SUM_KAHAN, threads);});
+    return 0;
+}
+
+//-------------------------------------------------------------------------
+//-------------------------------------------------------------------------
+//-------------------------------------------------------------------------
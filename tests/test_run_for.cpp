@@ -0,0 +1,164 @@
+//
+//  test_run_for.cpp
+//  Test for scheduler::run_for and progressive_order.  Checks a run with time
+//  to spare completes everything, that a short budget stops handing out work
+//  on time and that the bitmap matches what actually ran, and that
+//  progressive_order is a permutation.  Then "renders" 1024 rows of a
+//  Mandelbrot set within a few budgets, in row order and coarse to fine,
+//  fills missing rows from the nearest finished one, and reports the error.
+//
+
+/*
+build this example code from the command line with:
+g++ test_run_for.cpp -std=c++14 -O2
+*/
+
+#include "../scheduler.h"
+#include "../ext_timer.h"
+#include <iostream>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <vector>
+
+
+#define ROWS        1024
+#define COLUMNS     1024
+#define ITERATIONS  256
+#define CHECK_THREADS   4
+#define THREADS     4
+
+//-------------------------------------------------------------------------
+
+struct slow_worker : worker {
+    std::vector<std::atomic<int>> _ran;
+    int _microseconds;
+    slow_worker(int n, int microseconds) : _ran(n), _microseconds(microseconds) {}
+    void do_work(int work) {
+        auto end = std::chrono::steady_clock::now() + std::chrono::microseconds(_microseconds);
+        while (std::chrono::steady_clock::now() < end) {}
+        ++_ran[work];
+    }
+};
+
+bool check() {
+    slow_worker quick(1000, 1);
+    scheduler s(&quick, 1000, CHECK_THREADS);
+    std::vector<bool> done = s.run_for(std::chrono::seconds(10));
+    if (std::count(done.begin(), done.end(), true) != 1000) {
+        std::cout << "run_for FAILED, a run with time to spare stopped early" << std::endl;
+        return false;
+    }
+
+    // 1000 items of 1 ms in a 50 ms budget
+    slow_worker slow(1000, 1000);
+    scheduler t(&slow, 1000, CHECK_THREADS);
+    double wall0 = get_wall_time();
+    done = t.run_for(std::chrono::milliseconds(50));
+    double wall = get_wall_time() - wall0;
+    int completed = (int)std::count(done.begin(), done.end(), true);
+    for (int i = 0; i < 1000; ++i) {
+        if (slow._ran[i] != (done[i] ? 1 : 0) || (i > 0 && done[i] && !done[i-1])) {
+            std::cout << "run_for FAILED, bitmap doesn't match at " << i << std::endl;
+            return false;
+        }
+    }
+    if (completed == 0 || completed == 1000 || wall > 0.2) {
+        std::cout << "run_for FAILED, " << completed << " completed in " << wall << " s" << std::endl;
+        return false;
+    }
+
+    for (int n : {0, 1, 2, 7, 8, 1000, 1024}) {
+        std::vector<int> order = progressive_order(n);
+        std::sort(order.begin(), order.end());
+        for (int i = 0; i < n; ++i) {
+            if (order.size() != (size_t)n || order[i] != i) {
+                std::cout << "progressive_order FAILED for " << n << std::endl;
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+//-------------------------------------------------------------------------
+
+struct mandelbrot : worker {
+    std::vector<int> _order;        // work index -> row
+    std::vector<float> _image;
+    mandelbrot(const std::vector<int> &order) : _order(order), _image(ROWS * COLUMNS, 0) {}
+    void do_work(int work) {
+        int row = _order[work];
+        double y = -1.5 + 3.0 * row / ROWS;
+        for (int c = 0; c < COLUMNS; ++c) {
+            double x = -2.0 + 3.0 * c / COLUMNS, zx = 0, zy = 0;
+            int i = 0;
+            for (; i < ITERATIONS && zx * zx + zy * zy < 4; ++i) {
+                double t = zx * zx - zy * zy + x;
+                zy = 2 * zx * zy + y;
+                zx = t;
+            }
+            _image[row * COLUMNS + c] = (float)i / ITERATIONS;
+        }
+    }
+};
+
+// fills each missing row from the nearest finished one, returns the RMS error against the full image
+double fill_and_compare(mandelbrot &m, const std::vector<bool> &done, const std::vector<float> &full) {
+    std::vector<bool> rowDone(ROWS, false);
+    for (int w = 0; w < ROWS; ++w) if (done[w]) rowDone[m._order[w]] = true;
+    double error = 0;
+    for (int r = 0; r < ROWS; ++r) {
+        int nearest = -1;
+        for (int d = 0; d < ROWS && nearest < 0; ++d) {
+            if (r - d >= 0 && rowDone[r - d]) nearest = r - d;
+            else if (r + d < ROWS && rowDone[r + d]) nearest = r + d;
+        }
+        for (int c = 0; c < COLUMNS; ++c) {
+            double v = nearest < 0 ? 0 : m._image[nearest * COLUMNS + c];
+            error += (v - full[r * COLUMNS + c]) * (v - full[r * COLUMNS + c]);
+        }
+    }
+    return std::sqrt(error / (ROWS * COLUMNS));
+}
+
+int main(int argc, char **argv) {
+    double wall0, cpu0, wall1, cpu1;
+
+    if (!check()) return 1;
+    std::cout << "Correctness checks passed." << std::endl << std::endl;
+
+    std::vector<int> rowOrder(ROWS);
+    for (int i = 0; i < ROWS; ++i) rowOrder[i] = i;
+    mandelbrot full(rowOrder);
+    wall0 = get_wall_time();
+    cpu0 = get_cpu_time();
+    run_work(&full, ROWS, THREADS);
+    wall1 = get_wall_time();
+    cpu1 = get_cpu_time();
+    std::cout << "---  full render  ---" << std::endl;
+    std::cout << "Wall Time = " << wall1 - wall0 << std::endl;
+    std::cout << "CPU Time  = " << cpu1 - cpu0 << std::endl << std::endl;
+
+    double fullTime = wall1 - wall0;
+    for (double fraction : {0.1, 0.25, 0.5}) {
+        auto budget = std::chrono::microseconds((long long)(fullTime * fraction * 1e6));
+        std::cout << "---  budget " << budget.count() / 1000.0 << " ms  ---" << std::endl;
+        for (int progressive = 0; progressive < 2; ++progressive) {
+            mandelbrot m(progressive ? progressive_order(ROWS) : rowOrder);
+            scheduler s(&m, ROWS, THREADS);
+            wall0 = get_wall_time();
+            std::vector<bool> done = s.run_for(budget);
+            wall1 = get_wall_time();
+            std::cout << (progressive ? "coarse to fine" : "row order     ") << "  rows = " << std::count(done.begin(), done.end(), true)
+                      << "  Wall Time = " << wall1 - wall0 << "  RMS error = " << fill_and_compare(m, done, full._image) << std::endl;
+        }
+        std::cout << std::endl;
+    }
+    return 0;
+}
+
+//-------------------------------------------------------------------------
+//-------------------------------------------------------------------------
+//-------------------------------------------------------------------------
@@ -0,0 +1,146 @@
+//
+//  test_scan.cpp
+//  Test for parallel_scan.h.  Checks the scans and compaction primitives
+//  against their std:: equivalents, then times them at 1, 2, 4 ... N threads
+//  to show how they scale.
+//
+
+/*
+build this example code from the command line with:
+g++ test_scan.cpp -std=c++14 -O2
+*/
+
+#include "../parallel_scan.h"
+#include "../ext_timer.h"
+#include <iostream>
+#include <numeric>
+#include <iterator>
+#include <algorithm>
+#include <cstdlib>
+#include <vector>
+
+
+#define ELEMENTS    (1 << 24)
+#define REPEATS     5
+#define CHECK_THREADS   4   // one thread per tile in the small check, many tiles per thread in the large one
+
+//-------------------------------------------------------------------------
+
+bool is_odd(int v) {return (v & 1) != 0;}
+
+bool check_correctness(const std::vector<int> &data) {
+    bool ok = true;
+
+    std::vector<int> expected(data.size()), got(data.size());
+    std::partial_sum(data.begin(), data.end(), expected.begin());
+    parallel_scan(data.data(), got.data(), data.size(), std::plus<int>(), CHECK_THREADS);
+    if (expected != got) {std::cout << "parallel_scan FAILED" << std::endl; ok = false;}
+
+    expected[0] = 7;
+    std::partial_sum(data.begin(), data.end() - 1, expected.begin() + 1);
+    for (size_t i = 1; i < expected.size(); ++i) expected[i] += 7;
+    parallel_exclusive_scan(data.data(), got.data(), data.size(), 7, std::plus<int>(), CHECK_THREADS);
+    if (expected != got) {std::cout << "parallel_exclusive_scan FAILED" << std::endl; ok = false;}
+
+    expected.clear();
+    std::copy_if(data.begin(), data.end(), std::back_inserter(expected), is_odd);
+    got.assign(data.size(), 0);
+    size_t copied = parallel_copy_if(data.data(), data.size(), got.data(), is_odd, CHECK_THREADS);
+    got.resize(copied);
+    if (expected != got) {std::cout << "parallel_copy_if FAILED" << std::endl; ok = false;}
+
+    expected = data;
+    std::stable_partition(expected.begin(), expected.end(), is_odd);
+    got.assign(data.size(), 0);
+    parallel_partition(data.data(), data.size(), got.data(), is_odd, CHECK_THREADS);
+    if (expected != got) {std::cout << "parallel_partition FAILED" << std::endl; ok = false;}
+
+    expected = data;
+    expected.erase(std::remove_if(expected.begin(), expected.end(), is_odd), expected.end());
+    got = data;
+    got.resize(parallel_remove_if(got.data(), got.size(), is_odd, CHECK_THREADS));
+    if (expected != got) {std::cout << "parallel_remove_if FAILED" << std::endl; ok = false;}
+
+    return ok;
+}
+
+//-------------------------------------------------------------------------
+
+void print_time(const char *name, int threads, double wall, double cpu) {
+    std::cout << name << " threads = " << threads << std::endl;
+    std::cout << "Wall Time = " << wall / REPEATS << std::endl;
+    std::cout << "CPU Time  = " << cpu / REPEATS << std::endl;
+}
+
+int main(int argc, char **argv) {
+    double wall0, cpu0, wall1, cpu1;
+
+    std::vector<int> data(ELEMENTS);
+    srand(0);
+    for (auto &v : data) v = rand() % 1000;
+
+    // an uneven size, so the last tile is a partial one
+    std::vector<int> small(data.begin(), data.begin() + 3 * SCAN_TILE + 17);
+    if (!check_correctness(small) || !check_correctness(data)) return 1;
+    std::cout << "Correctness checks passed." << std::endl << std::endl;
+
+    std::vector<int> out(ELEMENTS);
+
+    //--- single thread std:: baselines ---
+
+    wall0 = get_wall_time();
+    cpu0 = get_cpu_time();
+    for (int r = 0; r < REPEATS; ++r) std::partial_sum(data.begin(), data.end(), out.begin());
+    wall1 = get_wall_time();
+    cpu1 = get_cpu_time();
+    std::cout << "---  std::partial_sum  ---" << std::endl;
+    print_time("std::partial_sum", 1, wall1 - wall0, cpu1 - cpu0);
+    std::cout << std::endl;
+
+    wall0 = get_wall_time();
+    cpu0 = get_cpu_time();
+    for (int r = 0; r < REPEATS; ++r) std::copy_if(data.begin(), data.end(), out.begin(), is_odd);
+    wall1 = get_wall_time();
+    cpu1 = get_cpu_time();
+    std::cout << "---  std::copy_if  ---" << std::endl;
+    print_time("std::copy_if", 1, wall1 - wall0, cpu1 - cpu0);
+    std::cout << std::endl;
+
+    //--- scaling of the parallel versions ---
+
+    int maxThreads = std::thread::hardware_concurrency();
+    for (int threads = 1; ; threads *= 2) {
+        threads = std::min(threads, maxThreads);
+        std::cout << "---  " << threads << " threads  ---" << std::endl;
+
+        wall0 = get_wall_time();
+        cpu0 = get_cpu_time();
+        for (int r = 0; r < REPEATS; ++r) parallel_scan(data.data(), out.data(), data.size(), std::plus<int>(), threads);
+        wall1 = get_wall_time();
+        cpu1 = get_cpu_time();
+        print_time("parallel_scan", threads, wall1 - wall0, cpu1 - cpu0);
+
+        wall0 = get_wall_time();
+        cpu0 = get_cpu_time();
+        for (int r = 0; r < REPEATS; ++r) parallel_copy_if(data.data(), data.size(), out.data(), is_odd, threads);
+        wall1 = get_wall_time();
+        cpu1 = get_cpu_time();
+        print_time("parallel_copy_if", threads, wall1 - wall0, cpu1 - cpu0);
+
+        wall0 = get_wall_time();
+        cpu0 = get_cpu_time();
+        for (int r = 0; r < REPEATS; ++r) parallel_partition(data.data(), data.size(), out.data(), is_odd, threads);
+        wall1 = get_wall_time();
+        cpu1 = get_cpu_time();
+        print_time("parallel_partition", threads, wall1 - wall0, cpu1 - cpu0);
+        std::cout << std::endl;
+
+        if (threads == maxThreads) break;
+    }
+
+    return 0;
+}
+
+//-------------------------------------------------------------------------
+//-------------------------------------------------------------------------
+//-------------------------------------------------------------------------
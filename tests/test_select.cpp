@@ -0,0 +1,143 @@
+//
+//  test_select.cpp
+//  Test for selection.h.  Takes the top 1000 of 32M scored items and the
+//  median of 32M floats, checks them against std::partial_sort and
+//  std::nth_element, and times them against those and a full std::sort.
+//
+
+/*
+build this example code from the command line with:
+g++ test_select.cpp -std=c++14 -O2
+*/
+
+#include "../selection.h"
+#include "../ext_timer.h"
+#include <iostream>
+#include <algorithm>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+
+#define ELEMENTS    (1 << 25)
+#define TOP_K       1000
+#define CHECK_THREADS   4
+
+//-------------------------------------------------------------------------
+// a scored item, the kind of thing top-k is run on
+
+struct scored {
+    float score;
+    uint32_t id;
+};
+
+bool by_score(const scored &a, const scored &b) {
+    return a.score != b.score ? a.score < b.score : a.id < b.id;
+}
+
+std::vector<scored> random_items(size_t n) {
+    std::mt19937 rng(0);
+    std::uniform_real_distribution<float> dist(0.0f, 1.0f);
+    std::vector<scored> items(n);
+    for (size_t i = 0; i < n; ++i) items[i] = {dist(rng), (uint32_t)i};
+    return items;
+}
+
+//-------------------------------------------------------------------------
+
+bool check_correctness() {
+    std::vector<scored> items = random_items(ELEMENTS / 8 + 7);
+
+    std::vector<scored> expected(TOP_K), got(TOP_K);
+    std::partial_sort_copy(items.begin(), items.end(), expected.begin(), expected.end(),
+                           [](const scored &a, const scored &b) {return by_score(b, a);});
+    parallel_top_k(items.data(), items.size(), TOP_K, got.data(), by_score, CHECK_THREADS);
+    for (int i = 0; i < TOP_K; ++i) {
+        if (expected[i].id != got[i].id) {std::cout << "parallel_top_k FAILED" << std::endl; return false;}
+    }
+
+    std::vector<float> values(items.size());
+    for (size_t i = 0; i < items.size(); ++i) values[i] = items[i].score;
+    // lots of duplicates, so the equal-pivots early out gets exercised too
+    std::vector<float> coarse(values.size());
+    for (size_t i = 0; i < values.size(); ++i) coarse[i] = (float)(int)(values[i] * 10);
+
+    for (auto *input : {&values, &coarse}) {
+        for (size_t nth : {(size_t)0, input->size() / 3, input->size() - 1}) {
+            std::vector<float> a = *input, b = *input;
+            std::nth_element(a.begin(), a.begin() + nth, a.end());
+            parallel_nth_element(b.data(), b.size(), nth, std::less<float>(), CHECK_THREADS);
+            bool ok = a[nth] == b[nth];
+            for (size_t i = 0; i < nth && ok; ++i) ok = !(b[nth] < b[i]);
+            for (size_t i = nth + 1; i < b.size() && ok; ++i) ok = !(b[i] < b[nth]);
+            if (!ok) {std::cout << "parallel_nth_element FAILED" << std::endl; return false;}
+        }
+    }
+    return true;
+}
+
+//-------------------------------------------------------------------------
+
+int main(int argc, char **argv) {
+    double wall0, cpu0, wall1, cpu1;
+
+    if (!check_correctness()) return 1;
+    std::cout << "Correctness checks passed." << std::endl << std::endl;
+
+    std::vector<scored> items = random_items(ELEMENTS);
+    std::vector<scored> top(TOP_K);
+
+    std::cout << "---  top " << TOP_K << " of " << ELEMENTS << " items  ---" << std::endl;
+
+    wall0 = get_wall_time();
+    cpu0 = get_cpu_time();
+    std::partial_sort_copy(items.begin(), items.end(), top.begin(), top.end(),
+                           [](const scored &a, const scored &b) {return by_score(b, a);});
+    wall1 = get_wall_time();
+    cpu1 = get_cpu_time();
+    std::cout << "std::partial_sort_copy  Wall Time = " << wall1 - wall0 << "  CPU Time = " << cpu1 - cpu0 << std::endl;
+
+    wall0 = get_wall_time();
+    cpu0 = get_cpu_time();
+    parallel_top_k(items.data(), items.size(), TOP_K, top.data(), by_score);
+    wall1 = get_wall_time();
+    cpu1 = get_cpu_time();
+    std::cout << "parallel_top_k          Wall Time = " << wall1 - wall0 << "  CPU Time = " << cpu1 - cpu0 << std::endl;
+    std::cout << std::endl;
+
+    std::vector<float> values(items.size());
+    for (size_t i = 0; i < items.size(); ++i) values[i] = items[i].score;
+    std::vector<float> work;
+
+    std::cout << "---  median of " << ELEMENTS << " floats  ---" << std::endl;
+
+    work = values;
+    wall0 = get_wall_time();
+    cpu0 = get_cpu_time();
+    std::sort(work.begin(), work.end());
+    wall1 = get_wall_time();
+    cpu1 = get_cpu_time();
+    std::cout << "std::sort               Wall Time = " << wall1 - wall0 << "  CPU Time = " << cpu1 - cpu0 << std::endl;
+
+    work = values;
+    wall0 = get_wall_time();
+    cpu0 = get_cpu_time();
+    std::nth_element(work.begin(), work.begin() + work.size() / 2, work.end());
+    wall1 = get_wall_time();
+    cpu1 = get_cpu_time();
+    std::cout << "std::nth_element        Wall Time = " << wall1 - wall0 << "  CPU Time = " << cpu1 - cpu0 << std::endl;
+
+    work = values;
+    wall0 = get_wall_time();
+    cpu0 = get_cpu_time();
+    parallel_nth_element(work.data(), work.size(), work.size() / 2);
+    wall1 = get_wall_time();
+    cpu1 = get_cpu_time();
+    std::cout << "parallel_nth_element    Wall Time = " << wall1 - wall0 << "  CPU Time = " << cpu1 - cpu0 << std::endl;
+
+    return 0;
+}
+
+//-------------------------------------------------------------------------
+//-------------------------------------------------------------------------
+//-------------------------------------------------------------------------
@@ -0,0 +1,159 @@
+//
+//  test_sort.cpp
+//  Test for parallel_sort.h.  Checks parallel_radix_sort on 32 and 64 bit
+//  integers, floats, doubles and key-value pairs, then times it against
+//  std::sort and parallel_sort.
+//
+
+/*
+build this example code from the command line with:
+g++ test_sort.cpp -std=c++14 -O2
+*/
+
+#include "../parallel_sort.h"
+#include "../ext_timer.h"
+#include <iostream>
+#include <algorithm>
+#include <cstdint>
+#include <random>
+#include <utility>
+#include <vector>
+
+
+#define ELEMENTS    (1 << 23)
+#define CHECK_THREADS   4
+
+//-------------------------------------------------------------------------
+
+template <typename T>
+std::vector<T> random_keys(size_t n, T low, T high) {
+    std::mt19937_64 rng(0);
+    std::vector<T> keys(n);
+    for (auto &k : keys) {
+        k = (T)((double)low + ((double)high - (double)low) * (double)(rng() >> 11) / (double)(1ull << 53));
+    }
+    return keys;
+}
+
+template <typename T>
+bool check_keys(const char *name, std::vector<T> keys) {
+    std::vector<T> expected = keys;
+    std::sort(expected.begin(), expected.end());
+    parallel_radix_sort(keys.data(), keys.size(), CHECK_THREADS);
+    if (keys != expected) {
+        std::cout << "parallel_radix_sort " << name << " FAILED" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool check_correctness() {
+    bool ok = true;
+    ok &= check_keys("uint32_t", random_keys<uint32_t>(ELEMENTS / 8 + 3, 0, 4e9));
+    ok &= check_keys("int32_t", random_keys<int32_t>(ELEMENTS / 8 + 3, -2e9, 2e9));
+    ok &= check_keys("uint64_t", random_keys<uint64_t>(ELEMENTS / 8 + 3, 0, 1.8e19));
+    ok &= check_keys("int64_t", random_keys<int64_t>(ELEMENTS / 8 + 3, -9e18, 9e18));
+    ok &= check_keys("float", random_keys<float>(ELEMENTS / 8 + 3, -1e6, 1e6));
+    ok &= check_keys("double", random_keys<double>(ELEMENTS / 8 + 3, -1e300, 1e300));
+    ok &= check_keys("narrow uint32_t", random_keys<uint32_t>(ELEMENTS / 8 + 3, 0, 1000));
+
+    // key-value pairs:  the sort is stable, so it must match std::stable_sort
+    std::vector<uint32_t> keys = random_keys<uint32_t>(ELEMENTS / 8 + 3, 0, 5000);
+    std::vector<uint32_t> values(keys.size());
+    std::vector<std::pair<uint32_t, uint32_t>> expected;
+    for (size_t i = 0; i < keys.size(); ++i) {
+        values[i] = (uint32_t)i;
+        expected.push_back(std::make_pair(keys[i], values[i]));
+    }
+    std::stable_sort(expected.begin(), expected.end(),
+                     [](const std::pair<uint32_t, uint32_t> &a, const std::pair<uint32_t, uint32_t> &b) {return a.first < b.first;});
+    parallel_radix_sort(keys.data(), values.data(), keys.size(), CHECK_THREADS);
+    for (size_t i = 0; i < keys.size(); ++i) {
+        if (keys[i] != expected[i].first || values[i] != expected[i].second) {
+            std::cout << "parallel_radix_sort key-value FAILED" << std::endl;
+            ok = false;
+            break;
+        }
+    }
+
+    std::vector<double> doubles = random_keys<double>(ELEMENTS / 8 + 3, -1e6, 1e6);
+    std::vector<double> sorted = doubles;
+    std::sort(sorted.begin(), sorted.end());
+    parallel_sort(doubles.data(), doubles.size(), std::less<double>(), CHECK_THREADS);
+    if (doubles != sorted) {std::cout << "parallel_sort FAILED" << std::endl; ok = false;}
+
+    return ok;
+}
+
+//-------------------------------------------------------------------------
+
+template <typename T>
+void time_sorts(const char *name, const std::vector<T> &original) {
+    double wall0, cpu0, wall1, cpu1;
+    std::vector<T> keys;
+
+    std::cout << "---  " << name << ", " << original.size() << " keys  ---" << std::endl;
+
+    keys = original;
+    wall0 = get_wall_time();
+    cpu0 = get_cpu_time();
+    std::sort(keys.begin(), keys.end());
+    wall1 = get_wall_time();
+    cpu1 = get_cpu_time();
+    std::cout << "std::sort            Wall Time = " << wall1 - wall0 << "  CPU Time = " << cpu1 - cpu0 << std::endl;
+
+    keys = original;
+    wall0 = get_wall_time();
+    cpu0 = get_cpu_time();
+    parallel_sort(keys.data(), keys.size());
+    wall1 = get_wall_time();
+    cpu1 = get_cpu_time();
+    std::cout << "parallel_sort        Wall Time = " << wall1 - wall0 << "  CPU Time = " << cpu1 - cpu0 << std::endl;
+
+    keys = original;
+    wall0 = get_wall_time();
+    cpu0 = get_cpu_time();
+    parallel_radix_sort(keys.data(), keys.size());
+    wall1 = get_wall_time();
+    cpu1 = get_cpu_time();
+    std::cout << "parallel_radix_sort  Wall Time = " << wall1 - wall0 << "  CPU Time = " << cpu1 - cpu0 << std::endl;
+    std::cout << std::endl;
+}
+
+int main(int argc, char **argv) {
+    if (!check_correctness()) return 1;
+    std::cout << "Correctness checks passed." << std::endl << std::endl;
+
+    time_sorts("uint32_t", random_keys<uint32_t>(ELEMENTS, 0, 4e9));
+    time_sorts("uint64_t", random_keys<uint64_t>(ELEMENTS, 0, 1.8e19));
+    time_sorts("float", random_keys<float>(ELEMENTS, -1e6, 1e6));
+    time_sorts("double", random_keys<double>(ELEMENTS, -1e6, 1e6));
+
+    // key-value, compared against sorting pairs
+    std::vector<uint32_t> keys = random_keys<uint32_t>(ELEMENTS, 0, 4e9);
+    std::vector<uint32_t> values(keys.size());
+    std::vector<std::pair<uint32_t, uint32_t>> pairs;
+    for (size_t i = 0; i < keys.size(); ++i) {
+        values[i] = (uint32_t)i;
+        pairs.push_back(std::make_pair(keys[i], values[i]));
+    }
+    std::cout << "---  uint32_t key + uint32_t value, " << keys.size() << " pairs  ---" << std::endl;
+    double wall0 = get_wall_time();
+    double cpu0 = get_cpu_time();
+    std::sort(pairs.begin(), pairs.end());
+    double wall1 = get_wall_time();
+    double cpu1 = get_cpu_time();
+    std::cout << "std::sort (pairs)    Wall Time = " << wall1 - wall0 << "  CPU Time = " << cpu1 - cpu0 << std::endl;
+    wall0 = get_wall_time();
+    cpu0 = get_cpu_time();
+    parallel_radix_sort(keys.data(), values.data(), keys.size());
+    wall1 = get_wall_time();
+    cpu1 = get_cpu_time();
+    std::cout << "parallel_radix_sort  Wall Time = " << wall1 - wall0 << "  CPU Time = " << cpu1 - cpu0 << std::endl;
+
+    return 0;
+}
+
+//-------------------------------------------------------------------------
+//-------------------------------------------------------------------------
+//-------------------------------------------------------------------------
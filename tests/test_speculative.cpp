@@ -0,0 +1,126 @@
+//
+//  test_speculative.cpp
+//  Test for speculative_scheduler.h.  Checks every item finishes once with a
+//  winning attempt, that an item whose first attempt hangs is duplicated and
+//  won by the duplicate, with the hung attempt seeing cancelled(), and that
+//  each item's kept result is its winner's.  Then times 400 items of 2 ms
+//  with one that stalls for 300 ms on its first attempt (a hiccup) and one
+//  that is slow on every attempt (a pathological input), on a scheduler and
+//  on speculative_scheduler.
+//
+
+/*
+build this example code from the command line with:
+g++ test_speculative.cpp -std=c++14 -O2
+*/
+
+#include "../speculative_scheduler.h"
+#include "../ext_timer.h"
+#include <iostream>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+
+#define ITEMS           400
+#define ITEM_US         2000
+#define STALL_US        300000  // the hiccup
+#define SLOW_US         20000   // the pathological item, every attempt
+#define CHECK_THREADS   4
+#define THREADS         4
+
+//-------------------------------------------------------------------------
+
+// items wait in 100 us steps, polling cancelled()
+struct waiting_worker : worker {
+    int _stalled;           // this item's first attempt takes STALL_US
+    int _slow;              // this item always takes SLOW_US
+    std::vector<int> _result[2];    // per attempt
+    std::atomic<int> _cancelledAttempts{0};
+
+    waiting_worker(int stalled, int slow) : _stalled(stalled), _slow(slow) {
+        _result[0].assign(ITEMS, -1);
+        _result[1].assign(ITEMS, -1);
+    }
+
+    void do_work(int work) {
+        int attempt = speculative_scheduler::attempt();
+        int us = ITEM_US;
+        if (work == _stalled && attempt == 0) us = STALL_US;
+        if (work == _slow) us = SLOW_US;
+        for (int t = 0; t < us; t += 100) {
+            if (speculative_scheduler::cancelled()) {
+                ++_cancelledAttempts;
+                return;
+            }
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+        }
+        _result[attempt][work] = work * 3;
+    }
+};
+
+bool check() {
+    waiting_worker w(37, -1);
+    speculative_scheduler s(&w, ITEMS, CHECK_THREADS);
+    s.run();
+    s.join();
+    for (int i = 0; i < ITEMS; ++i) {
+        int winner = s.winner(i);
+        if (winner < 0 || w._result[winner][i] != i * 3) {
+            std::cout << "speculative_scheduler FAILED, item " << i << " has no winning result" << std::endl;
+            return false;
+        }
+    }
+    if (s.winner(37) != 1 || s.duplicates_won() < 1) {
+        std::cout << "speculative_scheduler FAILED, the stalled item wasn't won by a duplicate" << std::endl;
+        return false;
+    }
+    if (w._cancelledAttempts < 1 || w._result[0][37] != -1) {
+        std::cout << "speculative_scheduler FAILED, the stalled attempt wasn't cancelled" << std::endl;
+        return false;
+    }
+
+    // an empty run finishes
+    speculative_scheduler e(&w, 0, CHECK_THREADS);
+    e.run();
+    e.join();
+    return true;
+}
+
+//-------------------------------------------------------------------------
+
+void benchmark(const char *name, int stalled, int slow) {
+    std::cout << "---  " << name << "  ---" << std::endl;
+    {
+        waiting_worker w(stalled, slow);
+        double wall0 = get_wall_time();
+        run_work(&w, ITEMS, THREADS);
+        double wall1 = get_wall_time();
+        std::cout << "scheduler:              Wall Time = " << wall1 - wall0 << std::endl;
+    }
+    {
+        waiting_worker w(stalled, slow);
+        speculative_scheduler s(&w, ITEMS, THREADS);
+        double wall0 = get_wall_time();
+        s.run();
+        s.join();
+        double wall1 = get_wall_time();
+        std::cout << "speculative_scheduler:  Wall Time = " << wall1 - wall0 << "  duplicates = " << s.duplicates_launched()
+                  << "  won by a duplicate = " << s.duplicates_won() << std::endl << std::endl;
+    }
+}
+
+int main(int argc, char **argv) {
+    if (!check()) return 1;
+    std::cout << "Correctness checks passed." << std::endl << std::endl;
+
+    benchmark("no stragglers", -1, -1);
+    benchmark("one item stalls on its first attempt", ITEMS - 10, -1);
+    benchmark("one item is slow on every attempt", -1, ITEMS - 10);
+    return 0;
+}
+
+//-------------------------------------------------------------------------
+//-------------------------------------------------------------------------
+//-------------------------------------------------------------------------
@@ -0,0 +1,212 @@
+//
+//  test_timer_wheel.cpp
+//  Test for timer_wheel.h.  With a wheel driven by hand (advance()), checks
+//  200000 timers spread over every level fire in deadline order and on the
+//  right tick, that cancel works, and periodic timers.  With the timerfd
+//  driver, checks timers never fire early and reports how late they are.
+//  Then times schedule + cancel of 1M pending timers against a std::multimap,
+//  and firing them.
+//
+
+/*
+build this example code from the command line with:
+g++ test_timer_wheel.cpp -std=c++14 -O2
+*/
+
+#include "../timer_wheel.h"
+#include "../ext_timer.h"
+#include <iostream>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <random>
+#include <thread>
+#include <vector>
+
+
+#define CHECK_TIMERS    200000
+#define BENCH_TIMERS    1000000
+#define REAL_TIMERS     200
+#define CHECK_THREADS   4
+
+//-------------------------------------------------------------------------
+
+// records the tick each work item ran on, and that they ran in deadline order
+struct tick_recorder : worker {
+    timer_wheel *_wheel;
+    std::vector<uint64_t> _deadline, _fired;
+    uint64_t _last = 0;
+    bool _inOrder = true;
+
+    void do_work(int work) {
+        uint64_t now = _wheel->now_ticks();     // advance() has finished the whole batch, so the tick is in _deadline
+        if (_deadline[work] < _last) _inOrder = false;
+        _last = _deadline[work];
+        _fired[work] = now;
+    }
+};
+
+struct counter : worker {
+    std::atomic<int> _count{0};
+    void do_work(int work) {++_count;}
+};
+
+bool check_manual() {
+    timer_wheel wheel(1);
+    tick_recorder r;
+    r._wheel = &wheel;
+    r._deadline.resize(CHECK_TIMERS);
+    r._fired.assign(CHECK_TIMERS, 0);
+    std::mt19937_64 rng(0);
+    std::vector<timer_id> ids(CHECK_TIMERS);
+    for (int i = 0; i < CHECK_TIMERS; ++i) {
+        uint64_t delay = rng() % (1ull << (2 + 6 * (i % 5)));     // up to 2^26 ticks, so all four levels are used
+        r._deadline[i] = delay;
+        ids[i] = wheel.schedule(&r, i, delay);
+    }
+    // cancel every 7th, twice
+    for (int i = 0; i < CHECK_TIMERS; i += 7) {
+        if (!wheel.cancel(ids[i]) || wheel.cancel(ids[i])) {
+            std::cout << "timer_wheel::cancel FAILED" << std::endl;
+            return false;
+        }
+    }
+
+    // advance in uneven steps, checking what came due in each one
+    uint64_t before = 0;
+    while (wheel.pending() > 0) {
+        uint64_t step = 1 + rng() % (1ull << (rng() % 22));
+        wheel.advance(step);
+        uint64_t after = wheel.now_ticks();
+        for (int i = 0; i < CHECK_TIMERS; ++i) {
+            bool due = r._deadline[i] >= before && r._deadline[i] < after && i % 7 != 0;
+            if (due != (r._fired[i] == after)) {
+                std::cout << "timer_wheel FAILED, timer " << i << " due at " << r._deadline[i] << " fired at " << r._fired[i] << std::endl;
+                return false;
+            }
+        }
+        before = after;
+        if (before > (1ull << 27)) break;
+    }
+    if (!r._inOrder || wheel.pending() != 0 || wheel.cancel(ids[1])) {
+        std::cout << "timer_wheel FAILED, order or leftovers" << std::endl;
+        return false;
+    }
+
+    // periodic:  first at 5, then every 10
+    counter c;
+    timer_id id = wheel.schedule(&c, 0, 5, 10);
+    wheel.advance(1006);
+    bool periodicOk = c._count == 101;
+    wheel.cancel(id);
+    wheel.advance(1000);
+    if (!periodicOk || c._count != 101) {
+        std::cout << "timer_wheel FAILED, periodic ran " << c._count << " times" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// with the timerfd driver:  the microseconds each timer ran after its deadline
+struct lateness_recorder : worker {
+    std::vector<std::chrono::steady_clock::time_point> _deadline;
+    std::vector<double> _late;
+    std::atomic<int> _count{0};
+    void do_work(int work) {
+        _late[work] = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - _deadline[work]).count();
+        ++_count;
+    }
+};
+
+bool check_real(std::vector<double> &late) {
+    timer_wheel wheel;
+    wheel.start(CHECK_THREADS);
+    lateness_recorder r;
+    r._deadline.resize(REAL_TIMERS);
+    r._late.resize(REAL_TIMERS);
+    std::mt19937 rng(1);
+    for (int i = 0; i < REAL_TIMERS; ++i) {
+        uint64_t delay = 1000 + rng() % 100000;
+        r._deadline[i] = std::chrono::steady_clock::now() + std::chrono::microseconds(delay);
+        wheel.schedule(&r, i, delay);
+    }
+    counter c;
+    timer_id periodic = wheel.schedule(&c, 0, 10000, 10000);
+    std::this_thread::sleep_for(std::chrono::milliseconds(205));
+    wheel.cancel(periodic);
+    int periodicCount = c._count;
+    std::this_thread::sleep_for(std::chrono::milliseconds(30));
+    wheel.stop();
+
+    late = r._late;
+    std::sort(late.begin(), late.end());
+    if (r._count != REAL_TIMERS || late[0] < 0) {
+        std::cout << "timer_wheel FAILED, " << r._count << " ran, earliest " << late[0] << " us" << std::endl;
+        return false;
+    }
+    if (periodicCount < 15 || periodicCount > 21 || c._count != periodicCount) {
+        std::cout << "timer_wheel FAILED, periodic ran " << periodicCount << " then " << c._count << " times" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+//-------------------------------------------------------------------------
+
+int main(int argc, char **argv) {
+    double wall0, cpu0, wall1, cpu1;
+
+    std::vector<double> late;
+    if (!check_manual() || !check_real(late)) return 1;
+    std::cout << "Correctness checks passed." << std::endl << std::endl;
+    std::cout << "---  lateness with a 1 ms tick  ---" << std::endl;
+    std::cout << "p50 = " << late[late.size() / 2] << " us  p99 = " << late[late.size() * 99 / 100] << " us" << std::endl << std::endl;
+
+    std::mt19937_64 rng(2);
+    std::vector<uint64_t> delays(BENCH_TIMERS);
+    for (auto &d : delays) d = rng() % 10000000;
+    counter c;
+
+    wall0 = get_wall_time();
+    cpu0 = get_cpu_time();
+    std::multimap<uint64_t, int> map;
+    std::vector<std::multimap<uint64_t, int>::iterator> its(BENCH_TIMERS);
+    for (int i = 0; i < BENCH_TIMERS; ++i) its[i] = map.insert(std::make_pair(delays[i], i));
+    for (int i = 0; i < BENCH_TIMERS; ++i) map.erase(its[i]);
+    wall1 = get_wall_time();
+    cpu1 = get_cpu_time();
+    std::cout << "---  std::multimap, 1M inserts then cancels  ---" << std::endl;
+    std::cout << "Wall Time = " << wall1 - wall0 << "  ns/op = " << (wall1 - wall0) * 1e9 / (2.0 * BENCH_TIMERS) << std::endl;
+    std::cout << "CPU Time  = " << cpu1 - cpu0 << std::endl;
+    std::cout << std::endl;
+
+    timer_wheel wheel(1);
+    std::vector<timer_id> ids(BENCH_TIMERS);
+    wall0 = get_wall_time();
+    cpu0 = get_cpu_time();
+    for (int i = 0; i < BENCH_TIMERS; ++i) ids[i] = wheel.schedule(&c, i, delays[i]);
+    for (int i = 0; i < BENCH_TIMERS; ++i) wheel.cancel(ids[i]);
+    wall1 = get_wall_time();
+    cpu1 = get_cpu_time();
+    std::cout << "---  timer_wheel, 1M schedules then cancels  ---" << std::endl;
+    std::cout << "Wall Time = " << wall1 - wall0 << "  ns/op = " << (wall1 - wall0) * 1e9 / (2.0 * BENCH_TIMERS) << std::endl;
+    std::cout << "CPU Time  = " << cpu1 - cpu0 << std::endl;
+    std::cout << std::endl;
+
+    for (int i = 0; i < BENCH_TIMERS; ++i) wheel.schedule(&c, i, delays[i]);
+    wall0 = get_wall_time();
+    cpu0 = get_cpu_time();
+    wheel.advance(10000000);
+    wall1 = get_wall_time();
+    cpu1 = get_cpu_time();
+    std::cout << "---  timer_wheel, firing 1M timers over 10M ticks  ---" << std::endl;
+    std::cout << "Wall Time = " << wall1 - wall0 << "  fired = " << c._count << std::endl;
+    std::cout << "CPU Time  = " << cpu1 - cpu0 << std::endl;
+
+    return 0;
+}
+
+//-------------------------------------------------------------------------
+//-------------------------------------------------------------------------
+//-------------------------------------------------------------------------
@@ -0,0 +1,124 @@
+//
+//  test_unique.cpp
+//  Test for parallel_unique.h.  Dedups 16M values with 1M distinct ones,
+//  checks both output modes against serial versions, and times them against
+//  sort + unique and a std::unordered_set loop.
+//
+
+/*
+build this example code from the command line with:
+g++ test_unique.cpp -std=c++14 -O2
+*/
+
+#include "../parallel_unique.h"
+#include "../ext_timer.h"
+#include <iostream>
+#include <algorithm>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+
+#define ELEMENTS    (1 << 24)
+#define DISTINCT    (1 << 20)
+#define CHECK_THREADS   4
+
+//-------------------------------------------------------------------------
+
+std::vector<uint64_t> random_values(size_t n) {
+    std::mt19937_64 rng(0);
+    std::vector<uint64_t> values(n);
+    for (auto &v : values) v = (rng() % DISTINCT) * 0x9E3779B97F4A7C15ULL;
+    return values;
+}
+
+// first occurrences, in input order
+std::vector<uint64_t> serial_unique(const std::vector<uint64_t> &values) {
+    std::unordered_set<uint64_t> seen;
+    std::vector<uint64_t> out;
+    for (auto v : values) {
+        if (seen.insert(v).second) out.push_back(v);
+    }
+    return out;
+}
+
+bool check_correctness() {
+    std::vector<uint64_t> values = random_values(ELEMENTS / 4 + 3);
+    std::vector<uint64_t> expected = serial_unique(values);
+    std::vector<uint64_t> got(values.size());
+
+    got.resize(parallel_unique_unordered(values.data(), values.size(), got.data(), true, CHECK_THREADS));
+    if (got != expected) {std::cout << "parallel_unique_unordered (first order) FAILED" << std::endl; return false;}
+
+    got.assign(values.size(), 0);
+    got.resize(parallel_unique_unordered(values.data(), values.size(), got.data(), false, CHECK_THREADS));
+    std::sort(got.begin(), got.end());
+    std::sort(expected.begin(), expected.end());
+    if (got != expected) {std::cout << "parallel_unique_unordered FAILED" << std::endl; return false;}
+
+    // a non-integer type, through std::hash<std::string>
+    std::vector<std::string> words;
+    for (size_t i = 0; i < 100000; ++i) words.push_back(std::to_string(values[i] % 5000));
+    std::vector<std::string> wordsOut(words.size());
+    wordsOut.resize(parallel_unique_unordered(words.data(), words.size(), wordsOut.data(), true, CHECK_THREADS));
+    std::unordered_set<std::string> seen;
+    std::vector<std::string> wordsExpected;
+    for (auto &w : words) {
+        if (seen.insert(w).second) wordsExpected.push_back(w);
+    }
+    if (wordsOut != wordsExpected) {std::cout << "parallel_unique_unordered (strings) FAILED" << std::endl; return false;}
+    return true;
+}
+
+//-------------------------------------------------------------------------
+
+int main(int argc, char **argv) {
+    double wall0, cpu0, wall1, cpu1;
+
+    if (!check_correctness()) return 1;
+    std::cout << "Correctness checks passed." << std::endl << std::endl;
+
+    std::vector<uint64_t> values = random_values(ELEMENTS);
+    std::vector<uint64_t> out(values.size());
+
+    std::cout << "---  " << ELEMENTS << " values, " << DISTINCT << " distinct  ---" << std::endl;
+
+    wall0 = get_wall_time();
+    cpu0 = get_cpu_time();
+    out = values;
+    std::sort(out.begin(), out.end());
+    out.erase(std::unique(out.begin(), out.end()), out.end());
+    wall1 = get_wall_time();
+    cpu1 = get_cpu_time();
+    std::cout << "sort + unique                  Wall Time = " << wall1 - wall0 << "  CPU Time = " << cpu1 - cpu0 << std::endl;
+
+    wall0 = get_wall_time();
+    cpu0 = get_cpu_time();
+    out = serial_unique(values);
+    wall1 = get_wall_time();
+    cpu1 = get_cpu_time();
+    std::cout << "std::unordered_set             Wall Time = " << wall1 - wall0 << "  CPU Time = " << cpu1 - cpu0 << std::endl;
+
+    out.resize(values.size());
+    wall0 = get_wall_time();
+    cpu0 = get_cpu_time();
+    parallel_unique_unordered(values.data(), values.size(), out.data());
+    wall1 = get_wall_time();
+    cpu1 = get_cpu_time();
+    std::cout << "parallel_unique_unordered      Wall Time = " << wall1 - wall0 << "  CPU Time = " << cpu1 - cpu0 << std::endl;
+
+    wall0 = get_wall_time();
+    cpu0 = get_cpu_time();
+    parallel_unique_unordered(values.data(), values.size(), out.data(), true);
+    wall1 = get_wall_time();
+    cpu1 = get_cpu_time();
+    std::cout << "  ... keeping first order      Wall Time = " << wall1 - wall0 << "  CPU Time = " << cpu1 - cpu0 << std::endl;
+
+    return 0;
+}
+
+//-------------------------------------------------------------------------
+//-------------------------------------------------------------------------
+//-------------------------------------------------------------------------
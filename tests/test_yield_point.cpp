@@ -0,0 +1,152 @@
+//
+//  test_yield_point.cpp
+//  Test for scheduler::add_priority_work and scheduler::yield_point.  Checks
+//  every priority task runs exactly once and on a pool thread, that a busy
+//  pool runs them inside its long items' yield points, and that yield_point
+//  does nothing off a pool thread.  Then keeps every thread busy with long
+//  items and measures how long urgent tasks wait to start, with items that
+//  never yield and with items that call yield_point every 100 us.
+//
+
+/*
+build this example code from the command line with:
+g++ test_yield_point.cpp -std=c++14 -O2
+*/
+
+#include "../scheduler.h"
+#include "../ext_timer.h"
+#include <iostream>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+
+#define LONG_ITEMS      16
+#define LONG_ITEM_MS    100     // each long item
+#define CHECKPOINT_US   100     // between a long item's yield points
+#define URGENT_TASKS    100
+#define URGENT_EVERY_US 3000    // an urgent task arrives this often
+#define CHECK_THREADS   4
+#define THREADS         4
+
+//-------------------------------------------------------------------------
+
+void spin(int microseconds) {
+    auto end = std::chrono::steady_clock::now() + std::chrono::microseconds(microseconds);
+    while (std::chrono::steady_clock::now() < end) {}
+}
+
+// long items, made of checkpoints that optionally yield
+struct long_worker : worker {
+    bool _yield;
+    std::atomic<int> _count{0};
+    std::atomic<int> _yieldsThatRan{0};
+    long_worker(bool yield) : _yield(yield) {}
+    void do_work(int work) {
+        for (int t = 0; t < LONG_ITEM_MS * 1000; t += CHECKPOINT_US) {
+            spin(CHECKPOINT_US);
+            if (_yield && scheduler::yield_point()) ++_yieldsThatRan;
+        }
+        ++_count;
+    }
+};
+
+// records when each urgent task started, and on which thread
+struct urgent_worker : worker {
+    std::vector<double> _queued;
+    std::vector<double> _started;
+    std::vector<std::atomic<int>> _runs;
+    std::vector<int> _thread;
+    urgent_worker(int n) : _queued(n), _started(n), _runs(n), _thread(n) {
+        for (auto &r : _runs) r = 0;
+    }
+    void do_work(int work) {
+        _started[work] = get_wall_time();
+        _thread[work] = scheduler::thread_index();
+        ++_runs[work];
+        spin(20);
+    }
+};
+
+// queues the urgent tasks on a schedule, while the pool runs the long items
+void feed_urgent(scheduler &s, urgent_worker &u, int count) {
+    for (int i = 0; i < count; ++i) {
+        std::this_thread::sleep_for(std::chrono::microseconds(URGENT_EVERY_US));
+        u._queued[i] = get_wall_time();
+        s.add_priority_work(&u, i);
+    }
+}
+
+bool check() {
+    if (scheduler::yield_point()) {
+        std::cout << "yield_point FAILED, ran work off a pool thread" << std::endl;
+        return false;
+    }
+    long_worker lw(true);
+    urgent_worker u(20);
+    scheduler s(&lw, CHECK_THREADS, CHECK_THREADS);     // one long item per thread, so only yield points can run urgent work
+    s.run();
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    feed_urgent(s, u, 20);
+    s.join();
+    for (int i = 0; i < 20; ++i) {
+        if (u._runs[i] != 1 || u._thread[i] < 0) {
+            std::cout << "yield_point FAILED, urgent task " << i << " ran " << u._runs[i] << " times" << std::endl;
+            return false;
+        }
+    }
+    if (lw._yieldsThatRan == 0 || lw._count != CHECK_THREADS) {
+        std::cout << "yield_point FAILED, no urgent task ran inside a long item" << std::endl;
+        return false;
+    }
+
+    // priority work on an otherwise idle scheduler is taken by free threads
+    urgent_worker idle(50);
+    scheduler t(&lw, 0, CHECK_THREADS);
+    t.run();
+    for (int i = 0; i < 50; ++i) t.add_priority_work(&idle, i);
+    t.join();
+    for (int i = 0; i < 50; ++i) {
+        if (idle._runs[i] != 1) {
+            std::cout << "add_priority_work FAILED, task " << i << " ran " << idle._runs[i] << " times" << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+//-------------------------------------------------------------------------
+
+void benchmark(bool yield) {
+    long_worker lw(yield);
+    urgent_worker u(URGENT_TASKS);
+    scheduler s(&lw, LONG_ITEMS, THREADS);
+    double wall0 = get_wall_time();
+    s.run();
+    feed_urgent(s, u, URGENT_TASKS);
+    s.join();
+    double wall1 = get_wall_time();
+
+    std::vector<double> wait;
+    for (int i = 0; i < URGENT_TASKS; ++i) wait.push_back((u._started[i] - u._queued[i]) * 1000);
+    std::sort(wait.begin(), wait.end());
+    std::cout << "---  " << (yield ? "long items call yield_point" : "long items never yield") << "  ---" << std::endl;
+    std::cout << "urgent task wait ms:  p50 = " << wait[wait.size() / 2] << "  p99 = " << wait[wait.size() * 99 / 100]
+              << "  max = " << wait.back() << std::endl;
+    std::cout << "Wall Time = " << wall1 - wall0 << std::endl << std::endl;
+}
+
+int main(int argc, char **argv) {
+    if (!check()) return 1;
+    std::cout << "Correctness checks passed." << std::endl << std::endl;
+
+    benchmark(false);
+    benchmark(true);
+    return 0;
+}
+
+//-------------------------------------------------------------------------
+//-------------------------------------------------------------------------
+//-------------------------------------------------------------------------
@@ -0,0 +1,375 @@
+//
+//  timer_wheel.h
+//  Delayed and periodic work:  "run w->do_work(work) in 50 ms", or "every
+//  second".  Pending timers live in a hierarchical timing wheel, four levels
+//  of 256 slots, so insert and cancel are O(1) (a push onto or unlink from a
+//  slot's list) however many timers are pending.  Level 0 holds timers due in
+//  the next 256 ticks, one slot per tick;  each level above covers 256 times
+//  the range, and its slots are cascaded down a level as the wheel below
+//  wraps, the way the classic Linux kernel timer did it.
+//
+//  One driver thread sleeps on a timerfd that ticks while timers are pending
+//  (disarmed when none are), advances the wheel to the clock, and hands due
+//  work to the pool.  Like event_loop.h, each pool thread is one long running
+//  work item of a scheduler, taking due work off a queue until stop().
+//
+//  Linux only (timerfd, eventfd).
+//
+
+#ifndef timer_wheel_h
+#define timer_wheel_h
+
+#include "scheduler.h"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <errno.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
+
+#define TIMER_WHEEL_LEVELS  4
+#define TIMER_WHEEL_BITS    8
+#define TIMER_WHEEL_SLOTS   (1 << TIMER_WHEEL_BITS)
+
+// default tick, the wheel's resolution
+#define TIMER_WHEEL_TICK_US 1000
+
+// identifies a scheduled timer, for cancel()
+typedef uint64_t timer_id;
+
+struct timer_wheel : worker {
+    timer_wheel(uint64_t tickMicroseconds=TIMER_WHEEL_TICK_US) : _tickUs(tickMicroseconds ? tickMicroseconds : 1), _base(0), _pending(0),
+                                                                _timerFd(-1), _wake(-1), _armed(false), _stopping(false) {
+        for (auto &level : _slots) {
+            for (auto &head : level) head = -1;
+        }
+        _startUs = monotonic_us();
+    }
+    ~timer_wheel() {stop();}
+
+    // starts the driver thread and threadCount pool threads.  false if the timerfd can't be made.
+    bool start(int threadCount=0) {
+        _timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        _wake = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (_timerFd < 0 || _wake < 0) {
+            close_fds();
+            return false;
+        }
+        _stopping = false;
+        {
+            std::lock_guard<std::mutex> lk(_mutex);
+            if (_pending > 0) arm(true);
+        }
+        threadCount = scheduler::resolve_thread_count(threadCount);
+        _pool.reset(new scheduler(this, threadCount, threadCount));     // a work item per thread, each one a loop over due work
+        _pool->run();
+        _driver = std::thread(&timer_wheel::driver, this);
+        return true;
+    }
+
+    // stops the driver, lets the pool run what is already due, and joins every thread.
+    // timers not yet due stay pending.
+    void stop() {
+        if (!_pool) return;
+        {
+            std::lock_guard<std::mutex> lk(_mutex);
+            _stopping = true;
+        }
+        uint64_t one = 1;
+        ssize_t r = write(_wake, &one, sizeof(one));
+        (void)r;
+        _driver.join();
+        {
+            std::lock_guard<std::mutex> lk(_dueMutex);
+            _dueCv.notify_all();
+        }
+        _pool->join();
+        _pool.reset();
+        close_fds();
+    }
+
+    // runs w->do_work(work) on the pool after delayMicroseconds, and then every periodMicroseconds
+    // if that isn't 0.  It runs on the first tick at or after the deadline, never before.
+    // returns an id for cancel().
+    timer_id schedule(worker *w, int work, uint64_t delayMicroseconds, uint64_t periodMicroseconds=0) {
+        uint64_t deadline = monotonic_us() - _startUs + delayMicroseconds;
+        std::lock_guard<std::mutex> lk(_mutex);
+        int index = allocate();
+        timer_node &n = _nodes[index];
+        n.w = w;
+        n.work = work;
+        n.period = periodMicroseconds ? (periodMicroseconds + _tickUs - 1) / _tickUs : 0;
+        if (_timerFd < 0) {
+            n.expires = _base + (delayMicroseconds + _tickUs - 1) / _tickUs;    // not started, time is what advance() says
+        } else {
+            n.expires = std::max((deadline + _tickUs - 1) / _tickUs, _base);
+        }
+        insert(index);
+        if (++_pending == 1 && _timerFd >= 0) arm(true);
+        return (uint64_t)n.generation << 32 | (uint32_t)index;
+    }
+
+    // stops a timer from running (again).  false if it already ran, or was already cancelled.
+    // A periodic timer whose work is running right now finishes that run.
+    bool cancel(timer_id id) {
+        std::lock_guard<std::mutex> lk(_mutex);
+        uint32_t index = (uint32_t)id;
+        if (index >= _nodes.size() || _nodes[index].generation != (uint32_t)(id >> 32)) return false;
+        timer_node &n = _nodes[index];
+        if (n.state == NODE_WHEEL) {
+            unlink(index);
+            --_pending;
+        }
+        release(index);     // a queued run sees the generation change and is skipped
+        return true;
+    }
+
+    // timers waiting in the wheel
+    size_t pending() {
+        std::lock_guard<std::mutex> lk(_mutex);
+        return _pending;
+    }
+
+    // for a wheel that isn't start()ed:  moves its clock on by ticks and runs whatever
+    // comes due on this thread, in order.  For simulations and tests.
+    void advance(uint64_t ticks) {
+        std::vector<due_run> runs;
+        {
+            std::lock_guard<std::mutex> lk(_mutex);
+            advance_to(_base + ticks, runs);
+        }
+        for (auto &r : runs) run(r);
+    }
+
+    // ticks the wheel has processed
+    uint64_t now_ticks() {
+        std::lock_guard<std::mutex> lk(_mutex);
+        return _base;
+    }
+
+    // the pool's work item:  run due work until stop()
+    void do_work(int work) {
+        for (;;) {
+            due_run r;
+            {
+                std::unique_lock<std::mutex> lk(_dueMutex);
+                _dueCv.wait(lk, [this] {return _stopping || !_due.empty();});
+                if (_due.empty()) return;
+                r = _due.front();
+                _due.pop_front();
+            }
+            run(r);
+        }
+    }
+
+private:
+    enum {NODE_FREE, NODE_WHEEL, NODE_DUE};
+
+    struct timer_node {
+        int prev, next;         // in its slot's list
+        int state;
+        uint32_t generation;    // bumped when the node is freed, so stale ids and queued runs are ignored
+        uint64_t expires;       // tick
+        uint64_t period;        // ticks, 0 for one shot
+        int level, slot;
+        worker *w;
+        int work;
+    };
+
+    // a timer's work, queued for the pool
+    struct due_run {
+        int index;
+        uint32_t generation;
+        worker *w;
+        int work;
+    };
+
+    uint64_t _tickUs;
+    uint64_t _startUs;              // CLOCK_MONOTONIC at construction, tick 0
+    uint64_t _base;                 // the next tick to process
+    size_t _pending;
+    int _slots[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS];     // list heads
+    std::deque<timer_node> _nodes;  // a deque, so growing never moves a node
+    std::vector<int> _free;
+    std::mutex _mutex;              // guards the wheel and the nodes
+    std::deque<due_run> _due;
+    std::mutex _dueMutex;
+    std::condition_variable _dueCv;
+    int _timerFd;
+    int _wake;                      // eventfd that stop() uses to wake the driver
+    bool _armed;
+    std::atomic<bool> _stopping;
+    std::thread _driver;
+    std::unique_ptr<scheduler> _pool;
+
+    static uint64_t monotonic_us() {
+        timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+    }
+
+    uint64_t clock_ticks() {
+        return (monotonic_us() - _startUs) / _tickUs;
+    }
+
+    void close_fds() {
+        if (_timerFd >= 0) close(_timerFd);
+        if (_wake >= 0) close(_wake);
+        _timerFd = _wake = -1;
+        _armed = false;
+    }
+
+    // ticks the timerfd every tick while there are timers, stops it when there aren't.
+    // The ticks are on the wheel's tick boundaries, so nothing waits an extra partial tick.
+    void arm(bool on) {
+        if (on == _armed) return;
+        itimerspec spec = {};
+        if (on) {
+            uint64_t first = _startUs + (clock_ticks() + 1) * _tickUs;
+            spec.it_interval.tv_sec = _tickUs / 1000000;
+            spec.it_interval.tv_nsec = (_tickUs % 1000000) * 1000;
+            spec.it_value.tv_sec = first / 1000000;
+            spec.it_value.tv_nsec = (first % 1000000) * 1000;
+        }
+        timerfd_settime(_timerFd, TFD_TIMER_ABSTIME, &spec, nullptr);
+        _armed = on;
+    }
+
+    int allocate() {
+        int index;
+        if (!_free.empty()) {
+            index = _free.back();
+            _free.pop_back();
+        } else {
+            index = (int)_nodes.size();
+            _nodes.push_back(timer_node());
+            _nodes.back().generation = 1;
+        }
+        return index;
+    }
+
+    void release(int index) {
+        timer_node &n = _nodes[index];
+        n.state = NODE_FREE;
+        ++n.generation;
+        _free.push_back(index);
+    }
+
+    // puts a node in the slot for its expiry, relative to _base
+    void insert(int index) {
+        timer_node &n = _nodes[index];
+        uint64_t delta = n.expires - _base;     // expires >= _base
+        uint64_t expires = n.expires;
+        int level = 0;
+        while (level < TIMER_WHEEL_LEVELS - 1 && delta >= (1ull << (TIMER_WHEEL_BITS * (level + 1)))) ++level;
+        uint64_t range = 1ull << (TIMER_WHEEL_BITS * TIMER_WHEEL_LEVELS);
+        if (delta >= range) expires = _base + range - 1;   // past the top level:  park it at the far end, it is re-placed when that comes round
+        n.level = level;
+        n.slot = (int)((expires >> (TIMER_WHEEL_BITS * level)) & (TIMER_WHEEL_SLOTS - 1));
+        n.state = NODE_WHEEL;
+        int &head = _slots[level][n.slot];
+        n.prev = -1;
+        n.next = head;
+        if (head >= 0) _nodes[head].prev = index;
+        head = index;
+    }
+
+    void unlink(int index) {
+        timer_node &n = _nodes[index];
+        if (n.prev >= 0) _nodes[n.prev].next = n.next;
+        else _slots[n.level][n.slot] = n.next;
+        if (n.next >= 0) _nodes[n.next].prev = n.prev;
+    }
+
+    // empties a slot, returning its list
+    int take_slot(int level, int slot) {
+        int head = _slots[level][slot];
+        _slots[level][slot] = -1;
+        return head;
+    }
+
+    // processes ticks up to (not including) target, collecting due work in order
+    void advance_to(uint64_t target, std::vector<due_run> &runs) {
+        while (_base < target) {
+            if (_pending == 0) {
+                _base = target;     // nothing to find, skip the empty ticks
+                break;
+            }
+            int index = (int)(_base & (TIMER_WHEEL_SLOTS - 1));
+            // level 0 wrapped:  bring the next slot of each level above down, as far as it wrapped
+            for (int level = 1; level < TIMER_WHEEL_LEVELS && index == 0; ++level) {
+                index = (int)((_base >> (TIMER_WHEEL_BITS * level)) & (TIMER_WHEEL_SLOTS - 1));
+                for (int i = take_slot(level, index); i >= 0; ) {
+                    int next = _nodes[i].next;
+                    insert(i);
+                    i = next;
+                }
+            }
+            for (int i = take_slot(0, (int)(_base & (TIMER_WHEEL_SLOTS - 1))); i >= 0; ) {
+                timer_node &n = _nodes[i];
+                int next = n.next;
+                if (n.expires > _base) {
+                    insert(i);      // one parked past the top level, not due yet
+                } else {
+                    runs.push_back({i, n.generation, n.w, n.work});
+                    if (n.period) {
+                        n.expires = _base + n.period;
+                        insert(i);
+                    } else {
+                        n.state = NODE_DUE;
+                        --_pending;
+                    }
+                }
+                i = next;
+            }
+            ++_base;
+        }
+    }
+
+    // runs a timer's work, unless it was cancelled after it came due
+    void run(const due_run &r) {
+        {
+            std::lock_guard<std::mutex> lk(_mutex);
+            timer_node &n = _nodes[r.index];
+            if (n.generation != r.generation) return;
+            if (n.state == NODE_DUE) release(r.index);     // a one shot is done once it starts
+        }
+        r.w->do_work(r.work);
+    }
+
+    void driver() {
+        pollfd fds[2] = {{_timerFd, POLLIN, 0}, {_wake, POLLIN, 0}};
+        std::vector<due_run> runs;
+        while (!_stopping) {
+            if (poll(fds, 2, -1) < 0 && errno != EINTR) break;
+            uint64_t expirations;
+            ssize_t r = read(_timerFd, &expirations, sizeof(expirations));
+            (void)r;
+            runs.clear();
+            {
+                std::lock_guard<std::mutex> lk(_mutex);
+                if (_stopping) break;
+                advance_to(clock_ticks() + 1, runs);
+                if (_pending == 0) arm(false);
+            }
+            if (runs.empty()) continue;
+            {
+                std::lock_guard<std::mutex> lk(_dueMutex);
+                _due.insert(_due.end(), runs.begin(), runs.end());
+            }
+            if (runs.size() == 1) _dueCv.notify_one();
+            else _dueCv.notify_all();
+        }
+    }
+};
+
+#endif /* timer_wheel_h */